@@ -0,0 +1,31 @@
+// The firmware's state machine as a Linux process, on the POSIX HAL backend
+// with the idle rig (see hal/hal_posix.h). Telemetry goes to RECV_IP_ADDR and
+// dashboard commands are accepted on UDP 5006, as on the board.
+//
+//   ./build-host/esp_controller            connection state machine
+//   ./build-host/esp_controller --testing  TestingState bench scripts
+
+#include <cstdio>
+#include <cstring>
+
+void run_state_machine_connection();
+void run_state_machine_testing();
+
+int main(int argc, char **argv)
+{
+    bool testing = argc > 1 && std::strcmp(argv[1], "--testing") == 0;
+    if (argc > 1 && !testing)
+    {
+        std::fprintf(stderr, "usage: %s [--testing]\n", argv[0]);
+        return 2;
+    }
+
+    // Line at a time, like the UART console, so piped logs stay current
+    std::setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    if (testing)
+        run_state_machine_testing();
+    else
+        run_state_machine_connection();
+    return 0;
+}
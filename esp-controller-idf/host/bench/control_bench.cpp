@@ -0,0 +1,601 @@
+// Host microbenchmarks for the control math.
+//
+// Sweeps random orientations and joystick inputs through the solver and the
+// helpers it is built from, and prints ns/call and cycles/call as JSON so two
+// builds can be compared before flashing. Inputs are generated up front from
+// a fixed seed, so every run times the same calls.
+//
+// It also checks that pair pruning is exact: every random input is solved
+// with pruning on and off, and any difference in the magnets or currents
+// returned makes it exit with 1. The speedup is printed on stderr. The
+// allocation table's shortlist is approximate, so its agreement with the full
+// search and its allocation error are only reported.
+//
+// "candidateForces" times the per-magnet force computation at the head of
+// solve() (getForceScale on the cos-indexed LUT) against the one it replaced
+// (acosf, a 128-entry table over the angle and a normalised projection),
+// kept here as "candidateForces_acos". Both report their interpolation error
+// against the force curve evaluated exactly; the maximum comes from the step
+// at the 0.1 rad cutoff, which both tables interpolate across.
+//
+// The yaw offset fit is checked against a simulated operator: a calibration
+// of CalibrationSequence's three steps, with the joystick answer off by
+// OPERATOR_NOISE_DEG (normal), is repeated over random orientations and
+// offsets. The fit over all steps must beat a single step, or it exits
+// with 1.
+//
+//   control_bench [--iterations N] [--repeat R] [--seed S] [--output FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <esp_cpu.h>
+#include "control/BallController.h"
+#include "control/fast_math.h"
+#include "control/magnet_geometry.h"
+#include "core/global_state.h"
+
+struct BenchInput
+{
+    Quaternion q;
+    float joy_x;
+    float joy_y;
+};
+
+struct BenchResult
+{
+    std::string name;
+    int calls = 0;
+    double ns_per_call = 0.0;
+    double cycles_per_call = 0.0;
+    std::string extra; // Additional JSON members, e.g. "\"cache_hit_rate\": 0.8"
+};
+
+// Keeps results observable so the compiler cannot drop the timed calls
+static volatile float g_sink;
+
+static Quaternion randomQuaternion(std::mt19937 &rng)
+{
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    float w = normal(rng);
+    float x = normal(rng);
+    float y = normal(rng);
+    float z = normal(rng);
+    float n = sqrtf(w * w + x * x + y * y + z * z);
+    return Quaternion(w / n, x / n, y / n, z / n);
+}
+
+// Uniform over the unit joystick disc
+static void randomJoystick(std::mt19937 &rng, float &joy_x, float &joy_y)
+{
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    do
+    {
+        joy_x = uniform(rng);
+        joy_y = uniform(rng);
+    } while (joy_x * joy_x + joy_y * joy_y > 1.0f);
+}
+
+static std::vector<BenchInput> randomInputs(int count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<BenchInput> inputs(count);
+    for (BenchInput &input : inputs)
+    {
+        input.q = randomQuaternion(rng);
+        randomJoystick(rng, input.joy_x, input.joy_y);
+    }
+    return inputs;
+}
+
+// A rolling ball: small rotations and joystick changes between consecutive
+// ticks, which is what the incremental solve cache is built for
+static std::vector<BenchInput> trajectoryInputs(int count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<BenchInput> inputs(count);
+
+    Quaternion q = randomQuaternion(rng);
+    float joy_x = 0.6f;
+    float joy_y = 0.0f;
+    const float kStepRad = 0.004f;  // Rotation per tick
+    const float kJoyStep = 0.005f;  // Joystick drift per tick
+    for (BenchInput &input : inputs)
+    {
+        // q <- q * exp(0.5 * dtheta), small-angle
+        float ax = 0.5f * kStepRad * normal(rng);
+        float ay = 0.5f * kStepRad * normal(rng);
+        float az = 0.5f * kStepRad * normal(rng);
+        Quaternion next(q.w - q.x * ax - q.y * ay - q.z * az,
+                        q.x + q.w * ax + q.y * az - q.z * ay,
+                        q.y + q.w * ay + q.z * ax - q.x * az,
+                        q.z + q.w * az + q.x * ay - q.y * ax);
+        float n = sqrtf(next.w * next.w + next.x * next.x + next.y * next.y + next.z * next.z);
+        q = Quaternion(next.w / n, next.x / n, next.y / n, next.z / n);
+
+        joy_x += kJoyStep * normal(rng);
+        joy_y += kJoyStep * normal(rng);
+        float joy_len = sqrtf(joy_x * joy_x + joy_y * joy_y);
+        if (joy_len > 1.0f)
+        {
+            joy_x /= joy_len;
+            joy_y /= joy_len;
+        }
+
+        input.q = q;
+        input.joy_x = joy_x;
+        input.joy_y = joy_y;
+    }
+    return inputs;
+}
+
+// Runs `body(i)` for i in [0, calls) `repeat` times after one warm-up pass and
+// keeps the fastest pass (least disturbed by the OS)
+static BenchResult measure(const char *name, int calls, int repeat, const std::function<void(int)> &body)
+{
+    for (int i = 0; i < calls; i++)
+        body(i);
+
+    BenchResult result;
+    result.name = name;
+    result.calls = calls;
+    for (int r = 0; r < repeat; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t start_cycles = esp_cpu_get_cycle_count();
+        for (int i = 0; i < calls; i++)
+            body(i);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        if (r == 0 || ns / calls < result.ns_per_call)
+        {
+            result.ns_per_call = ns / calls;
+            result.cycles_per_call = (double)cycles / calls;
+        }
+    }
+    return result;
+}
+
+static bool sameCommands(const MagnetCommand *a, int count_a, const MagnetCommand *b, int count_b)
+{
+    if (count_a != count_b)
+        return false;
+    for (int k = 0; k < count_a; k++)
+    {
+        if (a[k].id != b[k].id || a[k].current != b[k].current)
+            return false;
+    }
+    return true;
+}
+
+// Solves every input with pair pruning on and off; the results must match
+// exactly. Returns the number of inputs that differ (printing the first few).
+static int pairPruningMismatches(const std::vector<BenchInput> &inputs)
+{
+    BallController pruned;
+    BallController exhaustive;
+    exhaustive.setPairPruning(false);
+
+    int mismatches = 0;
+    for (const BenchInput &input : inputs)
+    {
+        MagnetCommand a[BallController::MAX_ACTIVE_MAGNETS] = {};
+        MagnetCommand b[BallController::MAX_ACTIVE_MAGNETS] = {};
+        int count_a = pruned.solve(input.joy_x, input.joy_y, input.q, a);
+        int count_b = exhaustive.solve(input.joy_x, input.joy_y, input.q, b);
+        if (sameCommands(a, count_a, b, count_b))
+            continue;
+        if (++mismatches <= 5)
+            fprintf(stderr, "pair pruning mismatch: q=(%.6f, %.6f, %.6f, %.6f) joy=(%.6f, %.6f)\n",
+                    input.q.w, input.q.x, input.q.y, input.q.z, input.joy_x, input.joy_y);
+    }
+    return mismatches;
+}
+
+struct TableComparison
+{
+    double agreement = 0.0;  // fraction of inputs assigned the same magnets
+    double full_error = 0.0; // mean relative allocation error, full search
+    double table_error = 0.0;
+};
+
+static TableComparison compareTableLookup(const std::vector<BenchInput> &inputs)
+{
+    BallController full;
+    BallController table;
+    table.setTableLookup(true);
+
+    TableComparison comparison;
+    int same = 0;
+    for (const BenchInput &input : inputs)
+    {
+        MagnetCommand a[BallController::MAX_ACTIVE_MAGNETS] = {};
+        MagnetCommand b[BallController::MAX_ACTIVE_MAGNETS] = {};
+        int count_a = full.solve(input.joy_x, input.joy_y, input.q, a);
+        int count_b = table.solve(input.joy_x, input.joy_y, input.q, b);
+
+        bool same_magnets = count_a == count_b;
+        for (int k = 0; same_magnets && k < count_a; k++)
+            same_magnets = a[k].id == b[k].id;
+        same += same_magnets ? 1 : 0;
+
+        comparison.full_error += full.allocationError(input.joy_x, input.joy_y, input.q, a, count_a);
+        comparison.table_error += table.allocationError(input.joy_x, input.joy_y, input.q, b, count_b);
+    }
+    comparison.agreement = (double)same / inputs.size();
+    comparison.full_error /= inputs.size();
+    comparison.table_error /= inputs.size();
+    return comparison;
+}
+
+// Torque per amp over the angle from gravity, as solve() tabulated it before
+// the LUT was indexed by cos(angle)
+struct AngleLut
+{
+    static constexpr int SIZE = 128;
+    float torque[SIZE];
+
+    AngleLut()
+    {
+        for (int i = 0; i < SIZE; i++)
+        {
+            float angle = ((float)i / (SIZE - 1)) * 1.570796f;
+            float value = angle < 0.1f ? 0.0f : (60.0f * sinf(angle) / (0.01f + 1.0f - cosf(angle))) * expf(-2.5f * angle) / 8.0f;
+            torque[i] = value > 0.0f ? value : 0.0f;
+        }
+    }
+
+    float torqueFactor(float angle) const
+    {
+        if (angle >= 1.570796f || angle < 0.1f)
+            return 0.0f;
+        float index = (angle / 1.570796f) * (SIZE - 1);
+        int i = (int)index;
+        if (i >= SIZE - 1)
+            return torque[SIZE - 1];
+        float fraction = index - i;
+        return torque[i] * (1.0f - fraction) + torque[i + 1] * fraction;
+    }
+};
+
+// Force vector of every magnet for one gravity direction, the old way
+static void candidateForcesAcos(const AngleLut &lut, const Vector3 &gravity, Vector3 forces[magnet_geometry::MAGNET_COUNT])
+{
+    for (int k = 0; k < magnet_geometry::MAGNET_COUNT; k++)
+    {
+        const Vector3 &magnet = magnet_geometry::UNIT_MAGNETS[k];
+        float dot = magnet.dot(gravity);
+        float strength = lut.torqueFactor(acosf(fmaxf(-1.0f, fminf(1.0f, dot))));
+        Vector3 projection = magnet - gravity * dot;
+        forces[k] = (strength > 0.00001f && projection.norm() >= 0.01f) ? projection.normalized() * strength : Vector3(0, 0, 0);
+    }
+}
+
+// ... and as solve() computes it now
+static void candidateForcesCos(const Vector3 &gravity, Vector3 forces[magnet_geometry::MAGNET_COUNT])
+{
+    for (int k = 0; k < magnet_geometry::MAGNET_COUNT; k++)
+    {
+        const Vector3 &magnet = magnet_geometry::UNIT_MAGNETS[k];
+        float dot = magnet.dot(gravity);
+        forces[k] = (magnet - gravity * dot) * BallController::getForceScale(dot);
+    }
+}
+
+// Interpolation error of both against the force curve evaluated exactly
+struct CandidateForceError
+{
+    double rms = 0.0; // relative to the strongest force for that gravity
+    double max = 0.0;
+};
+
+static void candidateForceErrors(const AngleLut &lut, const std::vector<Vector3> &gravities, CandidateForceError &acos_error, CandidateForceError &cos_error)
+{
+    int count = 0;
+    for (const Vector3 &gravity : gravities)
+    {
+        Vector3 exact[magnet_geometry::MAGNET_COUNT];
+        Vector3 a[magnet_geometry::MAGNET_COUNT];
+        Vector3 b[magnet_geometry::MAGNET_COUNT];
+        float strongest = 0.0f;
+        for (int k = 0; k < magnet_geometry::MAGNET_COUNT; k++)
+        {
+            const Vector3 &magnet = magnet_geometry::UNIT_MAGNETS[k];
+            double dot = magnet.dot(gravity);
+            double angle = std::acos(std::min(1.0, std::max(-1.0, dot)));
+            double torque = (dot <= 0.0 || angle < magnet_geometry::MIN_ANGLE_RAD)
+                                ? 0.0
+                                : (60.0 * std::sin(angle) / (0.01 + 1.0 - dot)) * std::exp(-2.5 * angle) / 8.0;
+            Vector3 projection = magnet - gravity * (float)dot;
+            exact[k] = projection.norm() > 0.0f ? projection.normalized() * (float)torque : Vector3(0, 0, 0);
+            strongest = std::max(strongest, exact[k].norm());
+        }
+        if (strongest <= 0.0f)
+            continue;
+        candidateForcesAcos(lut, gravity, a);
+        candidateForcesCos(gravity, b);
+        for (int k = 0; k < magnet_geometry::MAGNET_COUNT; k++)
+        {
+            double error_a = (a[k] - exact[k]).norm() / strongest;
+            double error_b = (b[k] - exact[k]).norm() / strongest;
+            acos_error.rms += error_a * error_a;
+            cos_error.rms += error_b * error_b;
+            acos_error.max = std::max(acos_error.max, error_a);
+            cos_error.max = std::max(cos_error.max, error_b);
+            count++;
+        }
+    }
+    if (count > 0)
+    {
+        acos_error.rms = std::sqrt(acos_error.rms / count);
+        cos_error.rms = std::sqrt(cos_error.rms / count);
+    }
+}
+
+struct CalibrationFitCheck
+{
+    double rms_one_deg = 0.0;    // yaw error from the first step alone
+    double rms_all_deg = 0.0;    // yaw error from all steps
+    double separation_deg = 0.0; // mean of the closest pair of firing headings
+};
+
+static constexpr int CALIBRATION_STEPS = 3;     // CalibrationSequence::MAX_CALIBRATION_STEPS
+static constexpr float OPERATOR_NOISE_DEG = 15.0f;
+
+// One calibration per trial: the steps pick magnets as CalibrationSequence
+// does, and the operator reports each pull's heading in the joystick frame
+// (IMU heading minus the true offset) with normal noise
+static CalibrationFitCheck checkCalibrationFit(int trials, uint32_t seed, std::vector<CalibrationSample> &samples)
+{
+    BallController controller;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> offset(-3.14159265f, 3.14159265f);
+    std::normal_distribution<float> noise(0.0f, OPERATOR_NOISE_DEG * 3.14159265f / 180.0f);
+
+    CalibrationFitCheck check;
+    samples.clear();
+    for (int t = 0; t < trials; t++)
+    {
+        Quaternion q = randomQuaternion(rng);
+        float true_offset = offset(rng);
+        CalibrationSample steps[CALIBRATION_STEPS];
+        float fired[CALIBRATION_STEPS];
+        for (int k = 0; k < CALIBRATION_STEPS; k++)
+        {
+            int id = controller.getCalibrationMagnet(q, fired, k);
+            float heading = controller.calibrationForceAngle(id, q) - true_offset + noise(rng);
+            steps[k] = controller.calibrationSample(id, q, cosf(heading), sinf(heading));
+            fired[k] = steps[k].theta_imu;
+            samples.push_back(steps[k]);
+        }
+
+        double error_one = std::remainder(BallController::fitYawOffset(steps, 1).yaw_offset - true_offset, 2.0 * M_PI);
+        double error_all = std::remainder(BallController::fitYawOffset(steps, CALIBRATION_STEPS).yaw_offset - true_offset, 2.0 * M_PI);
+        check.rms_one_deg += error_one * error_one;
+        check.rms_all_deg += error_all * error_all;
+
+        double closest = M_PI;
+        for (int a = 0; a < CALIBRATION_STEPS; a++)
+        {
+            for (int b = a + 1; b < CALIBRATION_STEPS; b++)
+                closest = std::min(closest, std::fabs(std::remainder((double)fired[a] - fired[b], 2.0 * M_PI)));
+        }
+        check.separation_deg += closest;
+    }
+    check.rms_one_deg = std::sqrt(check.rms_one_deg / trials) * 180.0 / M_PI;
+    check.rms_all_deg = std::sqrt(check.rms_all_deg / trials) * 180.0 / M_PI;
+    check.separation_deg = check.separation_deg / trials * 180.0 / M_PI;
+    return check;
+}
+
+static void writeJson(FILE *out, const std::vector<BenchResult> &results, int iterations, int repeat, uint32_t seed)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"control_math\",\n");
+    fprintf(out, "  \"iterations\": %d,\n", iterations);
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"seed\": %u,\n", (unsigned)seed);
+    fprintf(out, "  \"cycle_counter\": \"%s\",\n", host_cycle_counter_name());
+    fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(out, "  \"fast_math\": %s,\n", control_math::FAST ? "true" : "false");
+    fprintf(out, "  \"results\": [\n");
+    for (size_t k = 0; k < results.size(); k++)
+    {
+        const BenchResult &r = results[k];
+        fprintf(out, "    {\"name\": \"%s\", \"calls\": %d, \"ns_per_call\": %.2f, \"cycles_per_call\": %.1f",
+                r.name.c_str(), r.calls, r.ns_per_call, r.cycles_per_call);
+        if (!r.extra.empty())
+            fprintf(out, ", %s", r.extra.c_str());
+        fprintf(out, "}%s\n", k + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--iterations N] [--repeat R] [--seed S] [--output FILE]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 100000;
+    int repeat = 5;
+    uint32_t seed = 42;
+    const char *output_path = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--iterations") == 0 && has_value)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && has_value)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            output_path = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0 || repeat <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const std::vector<BenchInput> inputs = randomInputs(iterations, seed);
+    const std::vector<BenchInput> trajectory = trajectoryInputs(iterations, seed + 1);
+    std::vector<BenchResult> results;
+
+    // Geometry helpers
+    results.push_back(measure("quatToMatrix", iterations, repeat, [&](int i)
+                              { g_sink = BallController::quatToMatrix(inputs[i].q).m[2][2]; }));
+    results.push_back(measure("getTorqueFactor", iterations, repeat, [&](int i)
+                              { g_sink = BallController::getTorqueFactor(inputs[i].joy_x); }));
+    {
+        std::vector<Vector3> gravities;
+        for (const BenchInput &input : inputs)
+            gravities.push_back(BallController::quatToMatrix(input.q).multiplyTranspose(Vector3(0, 0, -1.0f)));
+        const AngleLut lut;
+        Vector3 forces[magnet_geometry::MAGNET_COUNT];
+        BenchResult result = measure("candidateForces", iterations, repeat, [&](int i)
+                                     {
+                                         candidateForcesCos(gravities[i], forces);
+                                         g_sink = forces[i % magnet_geometry::MAGNET_COUNT].x;
+                                     });
+        BenchResult baseline = measure("candidateForces_acos", iterations, repeat, [&](int i)
+                                       {
+                                           candidateForcesAcos(lut, gravities[i], forces);
+                                           g_sink = forces[i % magnet_geometry::MAGNET_COUNT].x;
+                                       });
+        CandidateForceError acos_error;
+        CandidateForceError cos_error;
+        candidateForceErrors(lut, gravities, acos_error, cos_error);
+        char extra[96];
+        snprintf(extra, sizeof(extra), "\"rms_rel_error\": %.5f, \"max_rel_error\": %.5f", cos_error.rms, cos_error.max);
+        result.extra = extra;
+        snprintf(extra, sizeof(extra), "\"rms_rel_error\": %.5f, \"max_rel_error\": %.5f", acos_error.rms, acos_error.max);
+        baseline.extra = extra;
+        fprintf(stderr, "candidate forces: %.1f ns with the cos-indexed LUT, %.1f ns with acosf (%.2fx)\n",
+                result.ns_per_call, baseline.ns_per_call, baseline.ns_per_call / result.ns_per_call);
+        results.push_back(result);
+        results.push_back(baseline);
+    }
+
+    // Solvers over random inputs
+    const int pruning_mismatches = pairPruningMismatches(inputs);
+    MagnetCommand output[BallController::MAX_ACTIVE_MAGNETS];
+    {
+        BallController controller;
+        results.push_back(measure("solve", iterations, repeat, [&](int i)
+                                  { g_sink = (float)controller.solve(inputs[i].joy_x, inputs[i].joy_y, inputs[i].q, output); }));
+    }
+    {
+        BallController controller;
+        controller.setPairPruning(false);
+        BenchResult result = measure("solve_exhaustive", iterations, repeat, [&](int i)
+                                     { g_sink = (float)controller.solve(inputs[i].joy_x, inputs[i].joy_y, inputs[i].q, output); });
+        const double speedup = result.ns_per_call / results.back().ns_per_call;
+        char extra[96];
+        snprintf(extra, sizeof(extra), "\"pruning_mismatches\": %d, \"pruning_speedup\": %.3f", pruning_mismatches, speedup);
+        result.extra = extra;
+        fprintf(stderr, "pair pruning: %d of %d inputs differ; solve %.1f ns with pruning, %.1f ns without (%.2fx)\n",
+                pruning_mismatches, iterations, results.back().ns_per_call, result.ns_per_call, speedup);
+        results.push_back(result);
+    }
+    {
+        BallController controller;
+        controller.setTableLookup(true);
+        BenchResult result = measure("solve_table", iterations, repeat, [&](int i)
+                                     { g_sink = (float)controller.solve(inputs[i].joy_x, inputs[i].joy_y, inputs[i].q, output); });
+        const TableComparison comparison = compareTableLookup(inputs);
+        char extra[128];
+        snprintf(extra, sizeof(extra), "\"agreement\": %.5f, \"rel_error\": %.5f, \"rel_error_full\": %.5f",
+                 comparison.agreement, comparison.table_error, comparison.full_error);
+        result.extra = extra;
+        results.push_back(result);
+    }
+    {
+        BallController controller;
+        results.push_back(measure("solveNNLS", iterations, repeat, [&](int i)
+                                  { g_sink = (float)controller.solveNNLS(inputs[i].joy_x, inputs[i].joy_y, inputs[i].q, output); }));
+    }
+
+    // Incremental solve along a rolling trajectory; the hit rate is from the
+    // last timed pass
+    {
+        BallController controller;
+        controller.setIncremental(true);
+        BenchResult result = measure("solve_incremental", iterations, repeat, [&](int i)
+                                     {
+                                         if (i == 0)
+                                         {
+                                             controller.invalidateCache();
+                                             controller.resetCacheStats();
+                                         }
+                                         g_sink = (float)controller.solve(trajectory[i].joy_x, trajectory[i].joy_y, trajectory[i].q, output);
+                                     });
+        uint32_t hits = controller.getCacheHits();
+        uint32_t misses = controller.getCacheMisses();
+        char extra[64];
+        snprintf(extra, sizeof(extra), "\"cache_hit_rate\": %.3f", hits + misses > 0 ? (double)hits / (hits + misses) : 0.0);
+        result.extra = extra;
+        results.push_back(result);
+    }
+
+    // Yaw offset fit over the simulated operator's calibrations; timed per fit
+    // of one calibration's steps
+    std::vector<CalibrationSample> calibration_samples;
+    const int calibration_trials = std::min(iterations, 10000);
+    const CalibrationFitCheck calibration = checkCalibrationFit(calibration_trials, seed + 2, calibration_samples);
+    const bool calibration_ok = calibration.rms_all_deg < calibration.rms_one_deg;
+    {
+        BenchResult result = measure("fitYawOffset", calibration_trials, repeat, [&](int i)
+                                     { g_sink = BallController::fitYawOffset(&calibration_samples[i * CALIBRATION_STEPS], CALIBRATION_STEPS).yaw_offset; });
+        char extra[128];
+        snprintf(extra, sizeof(extra), "\"yaw_rms_one_deg\": %.2f, \"yaw_rms_deg\": %.2f, \"separation_deg\": %.1f",
+                 calibration.rms_one_deg, calibration.rms_all_deg, calibration.separation_deg);
+        result.extra = extra;
+        fprintf(stderr, "calibration fit: %.0f deg operator noise, yaw error %.2f deg RMS from one step, %.2f deg from %d; "
+                        "firings %.1f deg apart\n",
+                OPERATOR_NOISE_DEG, calibration.rms_one_deg, calibration.rms_all_deg, CALIBRATION_STEPS, calibration.separation_deg);
+        results.push_back(result);
+    }
+
+    // Fast-loop PI step (one magnet, varying setpoint)
+    {
+        MagnetInfo magnet(1, Vector3(0.0f, 0.0f, 1.0f), 0.000650f, ADCAddress(GPIO_NUM_27, 0), PWMAddress(0x40, 0));
+        magnet.setCurrentValue(CurrentInfo(1, 1.0f));
+        results.push_back(measure("getNextCurrentValuePI", iterations, repeat, [&](int i)
+                                  { g_sink = magnet.getNextCurrentValuePI(1.0f + inputs[i].joy_x); }));
+    }
+
+    FILE *out = stdout;
+    if (output_path != nullptr)
+    {
+        out = fopen(output_path, "w");
+        if (out == nullptr)
+        {
+            fprintf(stderr, "cannot open %s\n", output_path);
+            return 1;
+        }
+    }
+    writeJson(out, results, iterations, repeat, seed);
+    if (out != stdout)
+        fclose(out);
+    return pruning_mismatches > 0 || !calibration_ok ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+// Checks the documented error bounds of control/fast_math.h and times each
+// approximation against libm.
+//
+// Errors are measured against double-precision references over the full
+// input range (plus an exhaustive sweep of one binade pair for invSqrt).
+// Prints JSON; exits with status 1 if any bound is exceeded.
+//
+//   fast_math_bench [--iterations N] [--output FILE]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <esp_cpu.h>
+#include "control/fast_math.h"
+
+struct AccuracyResult
+{
+    const char *name;
+    const char *kind; // "absolute" or "relative"
+    double max_error = 0.0;
+    double bound = 0.0;
+    double worst_input = 0.0;
+    double libm_ns = 0.0;
+    double fast_ns = 0.0;
+    double libm_cycles = 0.0;
+    double fast_cycles = 0.0;
+};
+
+static volatile float g_sink;
+
+static void track(AccuracyResult &result, double error, double input)
+{
+    if (error > result.max_error)
+    {
+        result.max_error = error;
+        result.worst_input = input;
+    }
+}
+
+// Times `body(i)` over all inputs, best of five passes
+template <typename Body>
+static void timeCalls(int calls, Body body, double &ns_per_call, double &cycles_per_call)
+{
+    for (int i = 0; i < calls; i++)
+        body(i);
+    ns_per_call = 0.0;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t start_cycles = esp_cpu_get_cycle_count();
+        for (int i = 0; i < calls; i++)
+            body(i);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+        if (pass == 0 || ns < ns_per_call)
+        {
+            ns_per_call = ns;
+            cycles_per_call = (double)cycles / calls;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 1000000;
+    const char *output_path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--iterations") == 0 && has_value)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && has_value)
+            output_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--iterations N] [--output FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "--iterations must be positive\n");
+        return 2;
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> log_range(-30.0f, 30.0f);
+
+    std::vector<float> xs(iterations);
+    std::vector<float> ys(iterations);
+    std::vector<AccuracyResult> results;
+
+    // atan2: random points at every scale, both signs
+    {
+        AccuracyResult r{"atan2", "absolute"};
+        r.bound = fast_math::ATAN2_MAX_ERROR;
+        for (int i = 0; i < iterations; i++)
+        {
+            float scale = powf(10.0f, log_range(rng));
+            xs[i] = unit(rng) * scale;
+            ys[i] = unit(rng) * scale;
+            double exact = std::atan2((double)ys[i], (double)xs[i]);
+            track(r, fabs(fast_math::atan2(ys[i], xs[i]) - exact), std::atan2(ys[i], xs[i]));
+        }
+        timeCalls(iterations, [&](int i)
+                  { g_sink = atan2f(ys[i], xs[i]); }, r.libm_ns, r.libm_cycles);
+        timeCalls(iterations, [&](int i)
+                  { g_sink = fast_math::atan2(ys[i], xs[i]); }, r.fast_ns, r.fast_cycles);
+        results.push_back(r);
+    }
+
+    // sincos: |angle| <= 1000 rad
+    {
+        AccuracyResult r{"sincos", "absolute"};
+        r.bound = fast_math::SINCOS_MAX_ERROR;
+        for (int i = 0; i < iterations; i++)
+        {
+            xs[i] = (i % 2 == 0) ? unit(rng) * 1000.0f : unit(rng) * 2.0f * fast_math::PI;
+            float s, c;
+            fast_math::sincos(xs[i], s, c);
+            double error = fmax(fabs(s - std::sin((double)xs[i])), fabs(c - std::cos((double)xs[i])));
+            track(r, error, xs[i]);
+        }
+        timeCalls(iterations, [&](int i)
+                  { g_sink = sinf(xs[i]) + cosf(xs[i]); }, r.libm_ns, r.libm_cycles);
+        timeCalls(iterations, [&](int i)
+                  { float s, c; fast_math::sincos(xs[i], s, c); g_sink = s + c; }, r.fast_ns, r.fast_cycles);
+        results.push_back(r);
+    }
+
+    // acos: evenly spaced over [-1, 1], endpoints included
+    {
+        AccuracyResult r{"acos", "absolute"};
+        r.bound = fast_math::ACOS_MAX_ERROR;
+        for (int i = 0; i < iterations; i++)
+        {
+            xs[i] = -1.0f + 2.0f * (float)i / (float)(iterations > 1 ? iterations - 1 : 1);
+            track(r, fabs(fast_math::acos(xs[i]) - std::acos((double)xs[i])), xs[i]);
+        }
+        timeCalls(iterations, [&](int i)
+                  { g_sink = acosf(xs[i]); }, r.libm_ns, r.libm_cycles);
+        timeCalls(iterations, [&](int i)
+                  { g_sink = fast_math::acos(xs[i]); }, r.fast_ns, r.fast_cycles);
+        results.push_back(r);
+    }
+
+    // invSqrt: the seed's error repeats every two binades, so [1, 4) is swept
+    // exhaustively; random inputs cover the rest of the normal range
+    {
+        AccuracyResult r{"invSqrt", "relative"};
+        r.bound = fast_math::INV_SQRT_MAX_REL_ERROR;
+        for (float x = 1.0f; x < 4.0f; x = nextafterf(x, 5.0f))
+        {
+            double exact = 1.0 / std::sqrt((double)x);
+            track(r, fabs(fast_math::invSqrt(x) - exact) / exact, x);
+        }
+        for (int i = 0; i < iterations; i++)
+        {
+            xs[i] = powf(10.0f, log_range(rng));
+            double exact = 1.0 / std::sqrt((double)xs[i]);
+            track(r, fabs(fast_math::invSqrt(xs[i]) - exact) / exact, xs[i]);
+        }
+        timeCalls(iterations, [&](int i)
+                  { g_sink = 1.0f / sqrtf(xs[i]); }, r.libm_ns, r.libm_cycles);
+        timeCalls(iterations, [&](int i)
+                  { g_sink = fast_math::invSqrt(xs[i]); }, r.fast_ns, r.fast_cycles);
+        results.push_back(r);
+    }
+
+    // sqrt (x * invSqrt(x)), same inputs
+    {
+        AccuracyResult r{"sqrt", "relative"};
+        r.bound = fast_math::INV_SQRT_MAX_REL_ERROR;
+        for (int i = 0; i < iterations; i++)
+        {
+            double exact = std::sqrt((double)xs[i]);
+            track(r, fabs(fast_math::sqrt(xs[i]) - exact) / exact, xs[i]);
+        }
+        timeCalls(iterations, [&](int i)
+                  { g_sink = sqrtf(xs[i]); }, r.libm_ns, r.libm_cycles);
+        timeCalls(iterations, [&](int i)
+                  { g_sink = fast_math::sqrt(xs[i]); }, r.fast_ns, r.fast_cycles);
+        results.push_back(r);
+    }
+
+    FILE *out = stdout;
+    if (output_path != nullptr)
+    {
+        out = fopen(output_path, "w");
+        if (out == nullptr)
+        {
+            fprintf(stderr, "cannot open %s\n", output_path);
+            return 1;
+        }
+    }
+
+    bool all_pass = true;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"fast_math\",\n");
+    fprintf(out, "  \"iterations\": %d,\n", iterations);
+    fprintf(out, "  \"cycle_counter\": \"%s\",\n", host_cycle_counter_name());
+    fprintf(out, "  \"results\": [\n");
+    for (size_t k = 0; k < results.size(); k++)
+    {
+        const AccuracyResult &r = results[k];
+        bool pass = r.max_error <= r.bound;
+        all_pass = all_pass && pass;
+        fprintf(out, "    {\"name\": \"%s\", \"error_kind\": \"%s\", \"max_error\": %.3e, \"bound\": %.3e, \"worst_input\": %.9g, \"pass\": %s, "
+                     "\"libm_ns_per_call\": %.2f, \"fast_ns_per_call\": %.2f, \"libm_cycles_per_call\": %.1f, \"fast_cycles_per_call\": %.1f, \"speedup\": %.2f}%s\n",
+                r.name, r.kind, r.max_error, r.bound, r.worst_input, pass ? "true" : "false",
+                r.libm_ns, r.fast_ns, r.libm_cycles, r.fast_cycles, r.fast_ns > 0.0 ? r.libm_ns / r.fast_ns : 0.0,
+                k + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"pass\": %s\n", all_pass ? "true" : "false");
+    fprintf(out, "}\n");
+    if (out != stdout)
+        fclose(out);
+    return all_pass ? 0 : 1;
+}
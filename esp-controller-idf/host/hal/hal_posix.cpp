@@ -0,0 +1,213 @@
+// POSIX backend of the HAL, for running the controller as a Linux process.
+// Hardware calls go to the installed PosixDevice; storage is one file per key
+// in $HOST_STORAGE_DIR (default: the working directory). ADC samples, PWM
+// writes and IMU reports pass through the trace recorder like on the board.
+
+#include "hal_posix.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <comms/comms_config.h>
+#include <core/shtp_parser.h>
+#include <hal/trace.h>
+#include <string>
+
+namespace hal
+{
+namespace
+{
+const std::chrono::steady_clock::time_point s_start = std::chrono::steady_clock::now();
+
+PosixDevice s_idle_device;
+PosixDevice *s_device = &s_idle_device;
+
+void putQ(uint8_t *out, float value, int q)
+{
+    float scaled = std::round(value * std::ldexp(1.0f, q));
+    int16_t raw = static_cast<int16_t>(std::fmax(-32768.0f, std::fmin(32767.0f, scaled)));
+    out[0] = static_cast<uint8_t>(raw);
+    out[1] = static_cast<uint8_t>(static_cast<uint16_t>(raw) >> 8);
+}
+
+// Packs a device's samples into one SHTP channel 3 packet the way the BNO08x
+// reports them (rotation vector Q14, gyroscope Q9), so a recording holds raw
+// packets whatever the device. Returns the packet length.
+uint16_t encodeReports(const IMUData &data, uint8_t *packet, size_t capacity)
+{
+    size_t length = SHTP_HEADER_SIZE;
+    auto fits = [&](size_t report) { return length + report <= capacity; };
+
+    // Base timestamp reference; the parser skips it
+    if (fits(5))
+    {
+        uint8_t *report = packet + length;
+        report[0] = 0xFB;
+        report[1] = report[2] = report[3] = report[4] = 0;
+        length += 5;
+    }
+    for (const Orientation &o : data.orientation)
+    {
+        if (!fits(14))
+            break;
+        uint8_t *report = packet + length;
+        report[0] = 0x05; // rotation vector
+        report[1] = report[2] = report[3] = 0;
+        putQ(report + 4, o.x, 14);
+        putQ(report + 6, o.y, 14);
+        putQ(report + 8, o.z, 14);
+        putQ(report + 10, o.w, 14);
+        report[12] = report[13] = 0; // accuracy estimate
+        length += 14;
+    }
+    for (const AngularVelocity &av : data.angular_velocity)
+    {
+        if (!fits(10))
+            break;
+        uint8_t *report = packet + length;
+        report[0] = 0x02; // calibrated gyroscope
+        report[1] = report[2] = report[3] = 0;
+        putQ(report + 4, av.x, 9);
+        putQ(report + 6, av.y, 9);
+        putQ(report + 8, av.z, 9);
+        length += 10;
+    }
+
+    packet[0] = static_cast<uint8_t>(length);
+    packet[1] = static_cast<uint8_t>(length >> 8);
+    packet[2] = 3; // sensor reports channel
+    packet[3] = 0;
+    return static_cast<uint16_t>(length);
+}
+
+std::string storagePath(const char *space, const char *key)
+{
+    const char *dir = std::getenv("HOST_STORAGE_DIR");
+    std::string path = (dir && dir[0]) ? dir : ".";
+    return path + "/nvs_" + space + "_" + key + ".bin";
+}
+} // namespace
+
+uint16_t PosixDevice::adcRead(const ADCAddress &address)
+{
+    (void)address;
+    return 0;
+}
+
+void PosixDevice::pwmWrite(const PWMAddress &address, int duty_0_255)
+{
+    (void)address;
+    (void)duty_0_255;
+}
+
+IMUData PosixDevice::imuPoll()
+{
+    IMUData data;
+    const int64_t now_us = micros();
+    if (now_us >= next_imu_us)
+    {
+        next_imu_us = now_us + imuOrientationIntervalUs();
+        data.orientation.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+        data.angular_velocity.emplace_back(0.0f, 0.0f, 0.0f);
+    }
+    return data;
+}
+
+int64_t PosixDevice::micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+void setPosixDevice(PosixDevice *device)
+{
+    s_device = device ? device : &s_idle_device;
+}
+
+void init(int adc_clock_speed_hz, int uart_baud_rate)
+{
+    (void)adc_clock_speed_hz;
+    (void)uart_baud_rate;
+    std::printf("Host HAL: no hardware, telemetry to %s\n", RECV_IP_ADDR);
+}
+
+uint16_t adcRead(const ADCAddress &address)
+{
+    uint16_t value = s_device->adcRead(address);
+    trace::recordAdc(address, value);
+    return value;
+}
+
+void pwmWrite(const PWMAddress &address, int duty_0_255)
+{
+    trace::recordPwm(address, duty_0_255);
+    s_device->pwmWrite(address, duty_0_255);
+}
+
+IMUData imuPoll()
+{
+    IMUData data = s_device->imuPoll();
+    if (!trace::recording() || (data.orientation.empty() && data.angular_velocity.empty()))
+        return data;
+
+    // Record it as the sensor would have sent it, and hand on what the
+    // firmware's parser makes of that so a replay sees the same values
+    uint8_t packet[256];
+    uint16_t length = encodeReports(data, packet, sizeof(packet));
+    trace::recordShtpPacket(packet, length);
+    return shtp_parse_packet(packet, length);
+}
+
+uint32_t imuOrientationIntervalUs()
+{
+    return s_device->imuOrientationIntervalUs();
+}
+
+uint8_t imuOrientationReportId()
+{
+    return s_device->imuOrientationReportId();
+}
+
+int64_t micros()
+{
+    return s_device->micros();
+}
+
+void serialWrite(const char *data, size_t length)
+{
+    std::fwrite(data, 1, length, stdout);
+    std::fflush(stdout);
+}
+
+bool storageLoad(const char *space, const char *key, void *data, size_t size)
+{
+    FILE *file = std::fopen(storagePath(space, key).c_str(), "rb");
+    if (!file)
+        return false;
+
+    size_t length = std::fread(data, 1, size, file);
+    bool exact = length == size && std::fgetc(file) == EOF;
+    std::fclose(file);
+    return exact;
+}
+
+bool storageSave(const char *space, const char *key, const void *data, size_t size)
+{
+    FILE *file = std::fopen(storagePath(space, key).c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = std::fwrite(data, 1, size, file) == size;
+    return std::fclose(file) == 0 && written;
+}
+
+void storageErase(const char *space, const char *key)
+{
+    std::remove(storagePath(space, key).c_str());
+}
+
+void startUpdateServer()
+{
+    // Firmware updates only make sense on the board
+}
+} // namespace hal
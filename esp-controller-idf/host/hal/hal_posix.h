@@ -0,0 +1,30 @@
+#pragma once
+
+#include <hal/hal.h>
+
+namespace hal
+{
+// What the POSIX backend reads and drives in place of the board. The default
+// device is an idle rig: every current reads zero, PWM writes go nowhere and
+// the IMU reports a ball at rest at the default 100 Hz, on the real clock.
+// Override it (e.g. with a simulator) and install it with setPosixDevice.
+class PosixDevice
+{
+public:
+    virtual ~PosixDevice() = default;
+
+    virtual uint16_t adcRead(const ADCAddress &address);
+    virtual void pwmWrite(const PWMAddress &address, int duty_0_255);
+    virtual IMUData imuPoll();
+    virtual uint32_t imuOrientationIntervalUs() { return 10000; }
+    virtual uint8_t imuOrientationReportId() { return IMU_ROTATION_VECTOR; }
+    virtual int64_t micros();
+
+private:
+    int64_t next_imu_us = 0;
+};
+
+// Installs the device behind the HAL (nullptr restores the idle rig). Not
+// synchronised: install it before the controller starts.
+void setPosixDevice(PosixDevice *device);
+} // namespace hal
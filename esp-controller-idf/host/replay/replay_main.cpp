@@ -0,0 +1,189 @@
+// Replays a recorded trace through this build's control code and reports
+// what it did: event counts, how well the recorded ADC samples matched the
+// reads, a digest of every PWM write, the CPU time per tick and the held vs
+// predicted orientation error at the actuation instant. If the trace holds
+// the recorded PWM writes, they are compared write by write.
+//
+// Record on the board with the dashboard's trace command
+// (telemetry-dashboard/trace_capture.py) or on the host with
+// ball_sim --record. Settings come from the trace and can be overridden to
+// compare configurations on identical input.
+//
+//   trace_replay TRACE [--nnls | --pair-search] [--kp KP] [--ki KI]
+//                [--penalty P] [--pwm-out FILE]
+//
+// Exits with 1 if the recorded PWM writes differ from the replayed ones.
+// Built with CONTROL_PROFILE=ON it also prints the profiling zones
+// (src/utils/profile.h) for the replay.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "trace_replay.h"
+#include <mag_selection_control/control_algorithm.h>
+#include <utils/profile.h>
+
+// FNV-1a over every write, for telling two replays apart at a glance
+static uint64_t digest(const std::vector<TraceReplay::PwmWrite> &writes)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++)
+        {
+            hash ^= (value >> (8 * i)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const TraceReplay::PwmWrite &w : writes)
+    {
+        mix(static_cast<uint64_t>(w.time_us), 8);
+        mix(static_cast<uint64_t>(w.driver), 1);
+        mix(static_cast<uint64_t>(w.channel), 1);
+        mix(static_cast<uint64_t>(w.duty), 1);
+    }
+    return hash;
+}
+
+static bool writeOutputs(const char *path, const std::vector<TraceReplay::PwmWrite> &writes)
+{
+    FILE *out = fopen(path, "w");
+    if (out == nullptr)
+        return false;
+    fprintf(out, "time_us,driver,channel,duty\n");
+    for (const TraceReplay::PwmWrite &w : writes)
+        fprintf(out, "%lld,%d,%d,%d\n", (long long)w.time_us, w.driver, w.channel, w.duty);
+    return fclose(out) == 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s TRACE [--nnls | --pair-search] [--kp KP] [--ki KI]\n"
+            "       [--penalty P] [--pwm-out FILE]\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    const char *pwm_out = nullptr;
+    int allocation = -1; // keep the recorded mode
+    float kp = -1.0f;
+    float ki = -1.0f;
+    float penalty = -1.0f;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--nnls") == 0)
+            allocation = (int)AllocationMode::NNLS;
+        else if (strcmp(argv[i], "--pair-search") == 0)
+            allocation = (int)AllocationMode::PAIR_SEARCH;
+        else if (strcmp(argv[i], "--kp") == 0 && has_value)
+            kp = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--ki") == 0 && has_value)
+            ki = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--penalty") == 0 && has_value)
+            penalty = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--pwm-out") == 0 && has_value)
+            pwm_out = argv[++i];
+        else if (argv[i][0] != '-' && path == nullptr)
+            path = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    TraceReplay replay;
+    std::string error;
+    if (!replay.load(path, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+
+    replay.applyConfig();
+    GlobalState &state = GlobalState::instance();
+    if (allocation >= 0)
+        setAllocationMode((AllocationMode)allocation);
+    if (kp >= 0.0f || ki >= 0.0f)
+    {
+        for (int magnetId = 1; magnetId <= 20; magnetId++)
+        {
+            float magnet_kp, magnet_ki;
+            state.getCurrentLoopGains(magnetId, magnet_kp, magnet_ki);
+            state.setCurrentLoopGains(magnetId, kp >= 0.0f ? kp : magnet_kp, ki >= 0.0f ? ki : magnet_ki);
+        }
+    }
+    if (penalty >= 0.0f)
+        getControllerInstance().setCurrentPenalty(penalty);
+
+    replay.run();
+
+    const TraceReplay::Stats &stats = replay.stats();
+    const std::vector<TraceReplay::PwmWrite> &replayed = replay.replayedOutputs();
+    const std::vector<TraceReplay::PwmWrite> &recorded = replay.recordedOutputs();
+
+    printf("trace        %s: %.3f s%s\n", path, stats.duration_s, replay.truncated() ? " (recording filled its buffer)" : "");
+    printf("events       %d fast ticks, %d slow ticks, %d ADC samples, %d SHTP packets, %d commands\n",
+           stats.fast_ticks, stats.slow_ticks, stats.adc_samples, stats.shtp_packets, stats.commands);
+    printf("ADC reads    %d, %d with no recorded sample, %d samples unread\n", stats.adc_reads, stats.adc_held, stats.adc_unread);
+    printf("PWM writes   %zu, digest %016llx\n", replayed.size(), (unsigned long long)digest(replayed));
+    if (stats.fast_ticks > 0)
+        printf("fast tick    mean %.2f us, max %.2f us\n", stats.fast_tick_total_us / stats.fast_ticks, stats.fast_tick_max_us);
+    if (stats.slow_ticks > 0)
+        printf("slow tick    mean %.2f us, max %.2f us\n", stats.slow_tick_total_us / stats.slow_ticks, stats.slow_tick_max_us);
+    const TraceReplay::PredictionStats prediction = replay.predictionStats();
+    if (prediction.ticks > 0)
+        printf("orientation  at +%.1f ms: held mean %.3f deg, max %.3f deg; predicted mean %.3f deg, max %.3f deg (%d ticks)\n",
+               prediction.lead_s * 1e3, prediction.hold_mean_deg, prediction.hold_max_deg, prediction.predicted_mean_deg,
+               prediction.predicted_max_deg, prediction.ticks);
+    if (profile::ENABLED)
+    {
+        static char text[2048];
+        profile::format(text, sizeof(text));
+        fputs(text, stdout);
+    }
+
+    if (pwm_out != nullptr && !writeOutputs(pwm_out, replayed))
+    {
+        fprintf(stderr, "cannot write %s\n", pwm_out);
+        return 2;
+    }
+
+    if (!replay.hasRecordedOutputs())
+        return 0;
+
+    size_t common = std::min(recorded.size(), replayed.size());
+    size_t first = 0;
+    while (first < common && recorded[first] == replayed[first])
+        first++;
+    if (first == common && recorded.size() == replayed.size())
+    {
+        printf("recording    all %zu PWM writes identical\n", recorded.size());
+        return 0;
+    }
+    if (first < common)
+    {
+        const TraceReplay::PwmWrite &r = recorded[first];
+        const TraceReplay::PwmWrite &p = replayed[first];
+        printf("recording    differs from write %zu at %.6f s: recorded %d/%d=%d, replayed %d/%d=%d\n", first + 1,
+               (r.time_us - stats.start_us) * 1e-6, r.driver, r.channel, r.duty, p.driver, p.channel, p.duty);
+    }
+    else
+    {
+        printf("recording    %zu PWM writes recorded, %zu replayed; the first %zu match\n", recorded.size(), replayed.size(), common);
+    }
+    return 1;
+}
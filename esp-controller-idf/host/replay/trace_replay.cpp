@@ -0,0 +1,286 @@
+#include "trace_replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <comms/wifi_client.h>
+#include <core/imu_task.h>
+#include <core/shtp_parser.h>
+#include <hal/trace.h>
+#include <mag_selection_control/control_algorithm.h>
+
+namespace
+{
+int channelKey(int chip_select, int channel)
+{
+    return (chip_select << 8) | channel;
+}
+
+double elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Angle (deg) of the rotation between two unit quaternions
+double angleBetweenDeg(const Quaternion &a, const Quaternion &b)
+{
+    double dot = std::fabs((double)a.w * b.w + (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z);
+    return 2.0 * std::acos(std::min(dot, 1.0)) * 180.0 / M_PI;
+}
+
+// Normalised linear interpolation, taking the short way round
+Quaternion nlerp(const Quaternion &a, const Quaternion &b, float t)
+{
+    float sign = (a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z) < 0.0f ? -1.0f : 1.0f;
+    Quaternion q(a.w + t * (sign * b.w - a.w), a.x + t * (sign * b.x - a.x), a.y + t * (sign * b.y - a.y),
+                 a.z + t * (sign * b.z - a.z));
+    float n = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return Quaternion(q.w / n, q.x / n, q.y / n, q.z / n);
+}
+} // namespace
+
+TraceReplay::TraceReplay()
+{
+    hal::setPosixDevice(this);
+}
+
+TraceReplay::~TraceReplay()
+{
+    hal::setPosixDevice(nullptr);
+}
+
+bool TraceReplay::load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    trace::Reader reader(bytes.data(), bytes.size());
+    if (!reader.valid())
+    {
+        error = path + " is not a version " + std::to_string(trace::VERSION) + " trace";
+        return false;
+    }
+    flags = reader.flags();
+
+    trace::Event event;
+    if (!reader.next(event) || event.type != trace::EventType::Config)
+    {
+        error = "trace does not start with its settings";
+        return false;
+    }
+    if (event.length != sizeof(TraceConfig))
+    {
+        error = "trace settings are from another build (" + std::to_string(event.length) + " bytes, expected " +
+                std::to_string(sizeof(TraceConfig)) + ")";
+        return false;
+    }
+    memcpy(&recorded_config, event.payload, sizeof(TraceConfig));
+    if (recorded_config.version != TraceConfig::VERSION)
+    {
+        error = "trace settings have version " + std::to_string(recorded_config.version);
+        return false;
+    }
+
+    while (reader.next(event))
+        events.push_back(event);
+    if (reader.failed())
+    {
+        error = "trace is corrupt";
+        return false;
+    }
+    return true;
+}
+
+void TraceReplay::applyConfig()
+{
+    trace_apply_config(recorded_config);
+}
+
+bool TraceReplay::truncated() const
+{
+    return (flags & trace::FLAG_TRUNCATED) != 0;
+}
+
+bool TraceReplay::hasRecordedOutputs() const
+{
+    return (flags & trace::FLAG_OUTPUTS) != 0;
+}
+
+void TraceReplay::run()
+{
+    if (events.empty())
+        return;
+
+    run_stats.start_us = events.front().time_us;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const trace::Event &e = events[i];
+        now_us = e.time_us;
+
+        switch (e.type)
+        {
+        case trace::EventType::FastTick:
+            fastTick(i);
+            break;
+
+        case trace::EventType::SlowTick:
+            slowTick();
+            break;
+
+        case trace::EventType::Adc:
+            run_stats.adc_samples++; // served by the fast tick it belongs to
+            break;
+
+        case trace::EventType::Pwm:
+            recorded.push_back({e.time_us, e.payload[0], e.payload[1], e.payload[2]});
+            break;
+
+        case trace::EventType::ShtpPacket:
+            run_stats.shtp_packets++;
+            packet = e.payload;
+            packet_length = e.length;
+            imu_poll_once();
+            packet = nullptr;
+            break;
+
+        case trace::EventType::Command:
+        {
+            run_stats.commands++;
+            DashboardCommand cmd = {};
+            memcpy(&cmd, e.payload, std::min(e.length, sizeof(cmd)));
+            process_dashboard_command(&cmd);
+            break;
+        }
+
+        case trace::EventType::ZeroControl:
+            GlobalState::instance().zeroControl();
+            break;
+
+        case trace::EventType::Config:
+            break;
+        }
+    }
+    run_stats.duration_s = (events.back().time_us - run_stats.start_us) * 1e-6;
+}
+
+void TraceReplay::fastTick(size_t index)
+{
+    // Queue this tick's samples: the ADC events up to the next tick marker
+    for (size_t i = index + 1; i < events.size(); i++)
+    {
+        const trace::Event &e = events[i];
+        if (e.type == trace::EventType::FastTick || e.type == trace::EventType::SlowTick ||
+            e.type == trace::EventType::ZeroControl)
+            break;
+        if (e.type == trace::EventType::Adc)
+            channels[channelKey(e.payload[0], e.payload[1])].pending.push_back(static_cast<uint16_t>(e.payload[2] | (e.payload[3] << 8)));
+    }
+
+    run_stats.fast_ticks++;
+    auto start = std::chrono::steady_clock::now();
+    GlobalState::instance().currentControlLoop();
+    double us = elapsedUs(start);
+    run_stats.fast_tick_total_us += us;
+    run_stats.fast_tick_max_us = std::max(run_stats.fast_tick_max_us, us);
+
+    for (auto &entry : channels)
+    {
+        run_stats.adc_unread += (int)entry.second.pending.size();
+        entry.second.pending.clear();
+    }
+}
+
+void TraceReplay::slowTick()
+{
+    GlobalState &state = GlobalState::instance();
+
+    run_stats.slow_ticks++;
+    auto start = std::chrono::steady_clock::now();
+    imu_update_global_state();
+    computeControl(state.getOrientationHistory(10), state.getAngularVelocityHistory(10), state.getIdealDirection(), frame);
+    state.applyControlFrame(frame);
+    double us = elapsedUs(start);
+    run_stats.slow_tick_total_us += us;
+    run_stats.slow_tick_max_us = std::max(run_stats.slow_tick_max_us, us);
+
+    // What the solver was handed this tick, with prediction on whatever the
+    // settings say, so hold and predicted are always both scored
+    if (reports.empty())
+        return;
+    Orientation orientation = state.getOrientation();
+    OrientationPredictor predictor = getOrientationPredictor();
+    predictor.setEnabled(true);
+    tick_orientations.push_back({now_us + static_cast<int64_t>(predictor.getActuationLead() * 1e6f),
+                                 Quaternion(orientation.w, orientation.x, orientation.y, orientation.z),
+                                 predictor.predict(orientation, state.getAngularVelocity(), hal::Clock::now())});
+}
+
+TraceReplay::PredictionStats TraceReplay::predictionStats() const
+{
+    PredictionStats result;
+    result.lead_s = getOrientationPredictor().getActuationLead();
+    for (const TickOrientation &tick : tick_orientations)
+    {
+        // The first report at or after the actuation instant, and the one before it
+        auto after = std::lower_bound(reports.begin(), reports.end(), tick.actuation_us,
+                                      [](const OrientationReport &r, int64_t t) { return r.time_us < t; });
+        if (after == reports.begin() || after == reports.end())
+            continue;
+        auto before = after - 1;
+        float t = (float)(tick.actuation_us - before->time_us) / (float)(after->time_us - before->time_us);
+        Quaternion actual = nlerp(before->q, after->q, t);
+
+        double hold = angleBetweenDeg(tick.held, actual);
+        double predicted = angleBetweenDeg(tick.predicted, actual);
+        result.ticks++;
+        result.hold_mean_deg += hold;
+        result.predicted_mean_deg += predicted;
+        result.hold_max_deg = std::max(result.hold_max_deg, hold);
+        result.predicted_max_deg = std::max(result.predicted_max_deg, predicted);
+    }
+    if (result.ticks > 0)
+    {
+        result.hold_mean_deg /= result.ticks;
+        result.predicted_mean_deg /= result.ticks;
+    }
+    return result;
+}
+
+uint16_t TraceReplay::adcRead(const ADCAddress &address)
+{
+    Channel &channel = channels[channelKey(address.adc_gpio_address, address.channel)];
+    run_stats.adc_reads++;
+    if (channel.pending.empty())
+    {
+        run_stats.adc_held++;
+        return channel.last;
+    }
+    channel.last = channel.pending.front();
+    channel.pending.pop_front();
+    return channel.last;
+}
+
+void TraceReplay::pwmWrite(const PWMAddress &address, int duty_0_255)
+{
+    int duty = std::clamp(duty_0_255, 0, 255);
+    replayed.push_back({now_us, address.driver_i2c_address, address.channel, duty});
+}
+
+IMUData TraceReplay::imuPoll()
+{
+    if (packet == nullptr)
+        return IMUData();
+    IMUData data = shtp_parse_packet(packet, static_cast<uint16_t>(packet_length));
+    for (const Orientation &o : data.orientation)
+        reports.push_back({now_us, Quaternion(o.w, o.x, o.y, o.z)});
+    return data;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "hal/hal_posix.h"
+#include <core/trace_session.h>
+#include <hal/trace.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// Feeds a recorded trace (src/hal/trace.h) back through the firmware's own
+// control code on the recorded clock.
+//
+// As a HAL device it serves the recorded ADC samples and SHTP packets and
+// reports the recorded time; as a driver it walks the events in recorded
+// order: each FastTick runs GlobalState::currentControlLoop, each SlowTick
+// the control task's IMU hand-off, computeControl and applyControlFrame, each
+// ShtpPacket one imu_poll_once, each Command process_dashboard_command and
+// each ZeroControl GlobalState::zeroControl.
+//
+// ADC samples are served per channel, in recorded order, to the fast tick
+// they were read in. A read with no sample left repeats the channel's last
+// value and a sample left unread is dropped; both are counted, so a build that
+// reads differently still replays, and the counters show that it did.
+//
+// Every slow tick also scores the orientation the solver is given: the newest
+// IMU orientation held as it is, and the OrientationPredictor's extrapolation
+// of it, against the IMU orientation at the actuation instant (the tick plus
+// the predictor's actuation lead, interpolated between the recorded reports).
+//
+// GlobalState and the controller are process-wide singletons: one replay per
+// process, never alongside the state machine or a Simulation.
+class TraceReplay : public hal::PosixDevice
+{
+public:
+    struct PwmWrite
+    {
+        int64_t time_us;
+        int driver;
+        int channel;
+        int duty;
+
+        bool operator==(const PwmWrite &other) const
+        {
+            return driver == other.driver && channel == other.channel && duty == other.duty;
+        }
+    };
+
+    struct Stats
+    {
+        int64_t start_us = 0; // recorded clock at the first event
+        double duration_s = 0.0;
+        int fast_ticks = 0;
+        int slow_ticks = 0;
+        int adc_samples = 0;
+        int shtp_packets = 0;
+        int commands = 0;
+
+        int adc_reads = 0;
+        int adc_held = 0;   // reads with no recorded sample left for the channel
+        int adc_unread = 0; // recorded samples no read asked for
+
+        // Wall time spent in the firmware per tick
+        double fast_tick_total_us = 0.0;
+        double fast_tick_max_us = 0.0;
+        double slow_tick_total_us = 0.0;
+        double slow_tick_max_us = 0.0;
+    };
+
+    // Orientation error at the actuation instant, over the slow ticks that have
+    // IMU reports on both sides of it
+    struct PredictionStats
+    {
+        int ticks = 0;
+        double lead_s = 0.0;
+        double hold_mean_deg = 0.0;
+        double hold_max_deg = 0.0;
+        double predicted_mean_deg = 0.0;
+        double predicted_max_deg = 0.0;
+    };
+
+    TraceReplay();
+    ~TraceReplay();
+
+    TraceReplay(const TraceReplay &) = delete;
+    TraceReplay &operator=(const TraceReplay &) = delete;
+
+    // Reads and checks a trace file. On failure returns false with `error` set.
+    bool load(const std::string &path, std::string &error);
+
+    // Settings recorded in the trace; applyConfig hands them to the firmware
+    const TraceConfig &config() const { return recorded_config; }
+    void applyConfig();
+
+    bool truncated() const;
+    bool hasRecordedOutputs() const;
+
+    // Runs every event. Call once, after load (then applyConfig and any overrides).
+    void run();
+
+    const Stats &stats() const { return run_stats; }
+    PredictionStats predictionStats() const;
+    const std::vector<PwmWrite> &replayedOutputs() const { return replayed; }
+    const std::vector<PwmWrite> &recordedOutputs() const { return recorded; }
+
+    uint16_t adcRead(const ADCAddress &address) override;
+    void pwmWrite(const PWMAddress &address, int duty_0_255) override;
+    IMUData imuPoll() override;
+    uint32_t imuOrientationIntervalUs() override { return recorded_config.imu_interval_us; }
+    int64_t micros() override { return now_us; }
+
+private:
+    struct Channel
+    {
+        std::deque<uint16_t> pending;
+        uint16_t last = 0;
+    };
+
+    struct OrientationReport
+    {
+        int64_t time_us;
+        Quaternion q;
+    };
+
+    struct TickOrientation
+    {
+        int64_t actuation_us;
+        Quaternion held;
+        Quaternion predicted;
+    };
+
+    void fastTick(size_t index);
+    void slowTick();
+
+    std::vector<uint8_t> bytes;
+    std::vector<trace::Event> events; // after the Config event, pointing into bytes
+    TraceConfig recorded_config;
+    uint16_t flags = 0;
+
+    int64_t now_us = 0;
+    std::map<int, Channel> channels; // by (chip select << 8) | channel
+    const uint8_t *packet = nullptr; // SHTP packet for the next imuPoll
+    size_t packet_length = 0;
+    ControlFrame frame;
+
+    std::vector<PwmWrite> recorded;
+    std::vector<PwmWrite> replayed;
+    Stats run_stats;
+
+    std::vector<OrientationReport> reports;      // every orientation the IMU reported
+    std::vector<TickOrientation> tick_orientations;
+};
@@ -0,0 +1,220 @@
+#include "ball_sim.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Magnet index behind an ADC channel or PWM output (-1 if none)
+int magnetIndex(const ADCAddress &address)
+{
+    for (const auto &entry : MAGNET_CONFIG)
+    {
+        const ADCAddress &a = std::get<2>(entry);
+        if (a.adc_gpio_address == address.adc_gpio_address && a.channel == address.channel)
+            return std::get<0>(entry) - 1;
+    }
+    return -1;
+}
+
+int magnetIndex(const PWMAddress &address)
+{
+    for (const auto &entry : MAGNET_CONFIG)
+    {
+        const PWMAddress &a = std::get<3>(entry);
+        if (a.driver_i2c_address == address.driver_i2c_address && a.channel == address.channel)
+            return std::get<0>(entry) - 1;
+    }
+    return -1;
+}
+
+// Rotates v by the unit quaternion q (w, x, y, z)
+void rotate(const double q[4], const double v[3], double out[3])
+{
+    // t = 2 (q_vec x v); out = v + w t + q_vec x t
+    double tx = 2.0 * (q[2] * v[2] - q[3] * v[1]);
+    double ty = 2.0 * (q[3] * v[0] - q[1] * v[2]);
+    double tz = 2.0 * (q[1] * v[1] - q[2] * v[0]);
+    out[0] = v[0] + q[0] * tx + (q[2] * tz - q[3] * ty);
+    out[1] = v[1] + q[0] * ty + (q[3] * tx - q[1] * tz);
+    out[2] = v[2] + q[0] * tz + (q[1] * ty - q[2] * tx);
+}
+} // namespace
+
+BallSim::BallSim(const SimParams &params) : params(params), rng(params.seed)
+{
+}
+
+void BallSim::reset(const Quaternion &orientation)
+{
+    double n = std::sqrt((double)orientation.w * orientation.w + (double)orientation.x * orientation.x +
+                         (double)orientation.y * orientation.y + (double)orientation.z * orientation.z);
+    q[0] = orientation.w / n;
+    q[1] = orientation.x / n;
+    q[2] = orientation.y / n;
+    q[3] = orientation.z / n;
+    omega[0] = omega[1] = omega[2] = 0.0;
+    pos[0] = pos[1] = 0.0;
+    std::fill(std::begin(current), std::end(current), 0.0);
+    std::fill(std::begin(duty), std::end(duty), 0);
+    energy = 0.0;
+    next_report_us = time_us;
+}
+
+void BallSim::advance(double seconds)
+{
+    double remaining = seconds;
+    while (remaining > 1e-12)
+    {
+        double dt = std::min(remaining, params.step_s);
+        step(dt);
+        remaining -= dt;
+    }
+
+    // Keep micros() exact over many small advances
+    time_remainder_s += seconds;
+    int64_t whole_us = (int64_t)(time_remainder_s * 1e6);
+    time_us += whole_us;
+    time_remainder_s -= whole_us * 1e-6;
+}
+
+void BallSim::step(double dt)
+{
+    // Coils: L dI/dt = V - R I, exact for a held voltage. The driver is
+    // unipolar, so the flyback diode keeps the current from going negative.
+    const double decay = std::exp(-dt * params.coil_resistance_ohm / params.coil_inductance_h);
+    for (int i = 0; i < magnet_geometry::MAGNET_COUNT; i++)
+    {
+        double steady = params.supply_voltage * duty[i] / 255.0 / params.coil_resistance_ohm;
+        current[i] = std::max(0.0, steady + (current[i] - steady) * decay);
+        energy += dt * params.coil_resistance_ohm * current[i] * current[i];
+    }
+
+    double force[2];
+    rollingForce(current, force);
+    // torque = z x force, so the ball rolls along the force
+    double torque[3] = {-params.torque_per_unit * force[1], params.torque_per_unit * force[0], 0.0};
+
+    // Rolling without slipping: horizontal axes see the inertia about the contact point
+    const double r = params.ball_radius_m;
+    const double inertia = 0.4 * params.ball_mass_kg * r * r;
+    const double rolling_inertia = inertia + params.ball_mass_kg * r * r;
+    omega[0] += dt * (torque[0] - params.rolling_damping * omega[0]) / rolling_inertia;
+    omega[1] += dt * (torque[1] - params.rolling_damping * omega[1]) / rolling_inertia;
+    omega[2] += dt * (torque[2] - params.spin_damping * omega[2]) / inertia;
+
+    // The centre moves at omega x (r z)
+    pos[0] += dt * r * omega[1];
+    pos[1] -= dt * r * omega[0];
+
+    // dq/dt = 0.5 (0, omega) q, with omega in the world frame
+    double dw = 0.5 * dt * (-omega[0] * q[1] - omega[1] * q[2] - omega[2] * q[3]);
+    double dx = 0.5 * dt * (omega[0] * q[0] + omega[1] * q[3] - omega[2] * q[2]);
+    double dy = 0.5 * dt * (-omega[0] * q[3] + omega[1] * q[0] + omega[2] * q[1]);
+    double dz = 0.5 * dt * (omega[0] * q[2] - omega[1] * q[1] + omega[2] * q[0]);
+    q[0] += dw;
+    q[1] += dx;
+    q[2] += dy;
+    q[3] += dz;
+    double n = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (double &c : q)
+        c /= n;
+}
+
+// Torque: the same model as the solver's LUT. Each coil pulls its side of the
+// ball towards the floor; the tangential part of its direction, scaled by the
+// LUT, is the way the ball rolls.
+void BallSim::rollingForce(const double amps[magnet_geometry::MAGNET_COUNT], double force[2]) const
+{
+    force[0] = 0.0;
+    force[1] = 0.0;
+    for (int i = 0; i < magnet_geometry::MAGNET_COUNT; i++)
+    {
+        if (amps[i] <= 0.0)
+            continue;
+
+        const Vector3 &u_body = magnet_geometry::UNIT_MAGNETS[i];
+        double u_b[3] = {u_body.x, u_body.y, u_body.z};
+        double u[3];
+        rotate(q, u_b, u);
+
+        // Gravity is (0, 0, -1), so cos(angle) = -u.z and the tangential part is (u.x, u.y)
+        double scale = BallController::getForceScale((float)-u[2]) * params.coil_gain[i] * amps[i];
+        force[0] += u[0] * scale;
+        force[1] += u[1] * scale;
+    }
+}
+
+Vector3 BallSim::rollingForce() const
+{
+    double force[2];
+    rollingForce(current, force);
+    return Vector3((float)force[0], (float)force[1], 0.0f);
+}
+
+Vector3 BallSim::rollingForce(const ControlFrame &frame) const
+{
+    double amps[magnet_geometry::MAGNET_COUNT] = {};
+    for (int k = 0; k < frame.count; k++)
+    {
+        int index = frame.magnetIds[k] - 1;
+        if (index >= 0 && index < magnet_geometry::MAGNET_COUNT)
+            amps[index] = frame.currents[k];
+    }
+    double force[2];
+    rollingForce(amps, force);
+    return Vector3((float)force[0], (float)force[1], 0.0f);
+}
+
+uint16_t BallSim::adcRead(const ADCAddress &address)
+{
+    int index = magnetIndex(address);
+    if (index < 0)
+        return 0;
+
+    double counts = current[index] / MagnetInfo::NOMINAL_AMPS_PER_COUNT + params.adc_noise_counts * adc_noise(rng);
+    return (uint16_t)std::clamp(std::lround(counts), 0L, 4095L);
+}
+
+void BallSim::pwmWrite(const PWMAddress &address, int duty_0_255)
+{
+    int index = magnetIndex(address);
+    if (index >= 0)
+        duty[index] = std::clamp(duty_0_255, 0, 255);
+}
+
+IMUData BallSim::imuPoll()
+{
+    IMUData data;
+    if (time_us < next_report_us)
+        return data;
+    next_report_us = time_us + params.imu_interval_us;
+
+    // The sensor's world frame is yawed by imu_yaw_offset_rad from ours
+    double half = 0.5 * params.imu_yaw_offset_rad;
+    double cz = std::cos(half), sz = std::sin(half);
+    data.orientation.emplace_back((float)(cz * q[0] - sz * q[3]), (float)(cz * q[1] - sz * q[2]),
+                                  (float)(cz * q[2] + sz * q[1]), (float)(cz * q[3] + sz * q[0]));
+
+    // Gyro reports the body-frame rate: rotate omega by the inverse orientation
+    double q_inv[4] = {q[0], -q[1], -q[2], -q[3]};
+    double rate[3];
+    rotate(q_inv, omega, rate);
+    data.angular_velocity.emplace_back((float)rate[0], (float)rate[1], (float)rate[2]);
+    return data;
+}
+
+Quaternion BallSim::orientation() const
+{
+    return Quaternion((float)q[0], (float)q[1], (float)q[2], (float)q[3]);
+}
+
+Vector3 BallSim::angularVelocity() const
+{
+    return Vector3((float)omega[0], (float)omega[1], (float)omega[2]);
+}
+
+Vector3 BallSim::position() const
+{
+    return Vector3((float)pos[0], (float)pos[1], 0.0f);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "hal/hal_posix.h"
+#include <control/BallController.h>
+#include <control/magnet_geometry.h>
+
+#include <random>
+
+// Physical constants of the simulated rig. The defaults are order-of-magnitude
+// estimates for the prototype, not measurements: fit torque_per_unit and the
+// coil gains with tools/fit_magnet_geometry.py and R/L from a current step.
+struct SimParams
+{
+    // Ball: a solid sphere rolling without slipping on a flat floor
+    double ball_radius_m = 0.14;
+    double ball_mass_kg = 1.2;
+    double rolling_damping = 0.02; // N m s/rad, about horizontal axes
+    double spin_damping = 0.005;   // N m s/rad, about the vertical axis
+
+    // Torque: torque_per_unit * current * BallController::getTorqueFactor(cos)
+    // times the coil's true gain, about the axis that rolls the coil downwards
+    double torque_per_unit = 0.2; // N m per LUT unit per amp
+    float coil_gain[magnet_geometry::MAGNET_COUNT];
+
+    // Coils: R-L driven by the PWM duty cycle as an average voltage
+    // (the PCA9685 carrier is far faster than L/R)
+    double coil_resistance_ohm = 1.5;
+    double coil_inductance_h = 0.008;
+    double supply_voltage = 12.0;
+
+    // Current sense: ideal shunt amplifier plus white noise, in ADC counts
+    double adc_noise_counts = 2.0;
+
+    // IMU: orientation and gyro reports at this interval, with the sensor's
+    // yaw zero this far from the joystick frame (what calibration fits)
+    uint32_t imu_interval_us = 10000;
+    double imu_yaw_offset_rad = 0.0;
+
+    // Physics sub-step
+    double step_s = 0.0001;
+
+    uint32_t seed = 1;
+
+    SimParams()
+    {
+        for (float &gain : coil_gain)
+            gain = 1.0f;
+    }
+};
+
+// The ball, its 20 coils and the sensors, as a HAL device. Install it with
+// hal::setPosixDevice and the unmodified current loop and solver drive it:
+// PWM writes set coil voltages, ADC reads return coil currents and the IMU
+// reports the ball's orientation, all on simulated time that only moves when
+// advance() is called.
+class BallSim : public hal::PosixDevice
+{
+public:
+    explicit BallSim(const SimParams &params = SimParams());
+
+    // Puts the ball at rest at `orientation` (body to world) with the coils off
+    void reset(const Quaternion &orientation);
+
+    // Integrates the coils and the ball over `seconds`, holding the PWM duties
+    void advance(double seconds);
+
+    uint16_t adcRead(const ADCAddress &address) override;
+    void pwmWrite(const PWMAddress &address, int duty_0_255) override;
+    IMUData imuPoll() override;
+    uint32_t imuOrientationIntervalUs() override { return params.imu_interval_us; }
+    int64_t micros() override { return time_us; }
+
+    const SimParams &getParams() const { return params; }
+    Quaternion orientation() const;
+    Vector3 angularVelocity() const;   // world frame, rad/s
+    Vector3 position() const;          // contact point on the floor, m
+    float coilCurrent(int index) const { return (float)current[index]; } // A, by magnet index
+    double coilEnergy() const { return energy; } // J dissipated in the coils since reset
+
+    // Horizontal rolling force (LUT units, world frame) at the current
+    // orientation: from the coil currents now, or from a frame's setpoints as
+    // if every coil were exactly at its setpoint
+    Vector3 rollingForce() const;
+    Vector3 rollingForce(const ControlFrame &frame) const;
+    double time() const { return time_us * 1e-6; }
+
+private:
+    void step(double dt);
+    void rollingForce(const double amps[magnet_geometry::MAGNET_COUNT], double force[2]) const;
+
+    SimParams params;
+    std::mt19937 rng;
+    std::normal_distribution<double> adc_noise{0.0, 1.0};
+
+    int64_t time_us = 0;
+    double time_remainder_s = 0.0; // sub-microsecond part of the simulated time
+
+    // Ball state, world frame
+    double q[4] = {1.0, 0.0, 0.0, 0.0}; // w, x, y, z
+    double omega[3] = {0.0, 0.0, 0.0};
+    double pos[2] = {0.0, 0.0};
+
+    // Coil state, by magnet index
+    double current[magnet_geometry::MAGNET_COUNT] = {};
+    int duty[magnet_geometry::MAGNET_COUNT] = {};
+    double energy = 0.0;
+
+    int64_t next_report_us = 0;
+};
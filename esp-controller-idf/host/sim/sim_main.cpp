@@ -0,0 +1,341 @@
+// Runs random manoeuvres through the firmware's control loops against the
+// ball simulator and reports how well the ball follows the joystick, plus how
+// much faster than real time the simulation ran.
+//
+// Each manoeuvre starts the ball at rest in a random orientation and holds a
+// random unit joystick direction for --seconds. It is scored on:
+//   heading    angle between the joystick and the way the ball ended up rolling
+//   settle     time until the rolling direction stays within 15 deg of the joystick
+//   overshoot  largest heading error once it first got within 15 deg
+//   energy     heat dissipated in the coils
+// and, over every fast tick, on torque ripple: the rolling force the coils
+// produce against what the solver's latest frame asks for, as an rms error
+// relative to the request and the 1st percentile of the share of the request
+// delivered along it (negative: pushing the wrong way). --transition-ticks
+// sets the crossfade on a magnet switch (0 steps; src/core/transition_scheduler.h).
+//
+// The controller settings can be overridden for tuning, the outer loop
+// included (--outer-loop with the two gains dashboard command 4 takes: kp/kd
+// for pd, kv/ki for velocity); --stick scales the joystick. --score prints the
+// means on one line for autotune (host/tune). --record writes a trace of the
+// run, PWM writes included, for trace_replay (host/replay). Built with
+// CONTROL_PROFILE=ON it ends with the profiling zones (src/utils/profile.h).
+//
+//   ball_sim [--manoeuvres N] [--seconds S] [--seed S] [--nnls] [--yaw-offset RAD]
+//            [--kp KP] [--ki KI] [--penalty P] [--fast-loop S] [--slow-loop S]
+//            [--outer-loop direct|pd|velocity] [--outer-gain-1 G] [--outer-gain-2 G]
+//            [--stick S] [--transition-ticks N] [--score] [--record FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "simulation.h"
+#include <core/trace_session.h>
+#include <hal/trace.h>
+#include <mag_selection_control/control_algorithm.h>
+#include <utils/profile.h>
+
+// Rolling direction counts as on target within this angle
+static constexpr double SETTLE_BAND_DEG = 15.0;
+
+// Below this speed the rolling direction is not meaningful (m/s)
+static constexpr double MIN_SPEED = 0.005;
+
+// Trace buffer for --record; only the part written is ever touched
+static constexpr size_t RECORD_CAPACITY = 256u * 1024u * 1024u;
+
+struct ManoeuvreResult
+{
+    double heading_deg = 180.0;
+    double distance_m = 0.0;
+    double settle_s = 0.0;
+    double overshoot_deg = 180.0;
+    double energy_j = 0.0;
+};
+
+static Quaternion randomQuaternion(std::mt19937 &rng)
+{
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    float w = normal(rng);
+    float x = normal(rng);
+    float y = normal(rng);
+    float z = normal(rng);
+    float n = sqrtf(w * w + x * x + y * y + z * z);
+    return Quaternion(w / n, x / n, y / n, z / n);
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static double mean(const std::vector<double> &values)
+{
+    double sum = 0.0;
+    for (double v : values)
+        sum += v;
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+// Angle between the rolling direction and the joystick, deg (180 if not rolling)
+static double headingError(const Vector3 &velocity, double theta)
+{
+    if (std::hypot(velocity.x, velocity.y) < MIN_SPEED)
+        return 180.0;
+    double error = std::remainder(std::atan2(velocity.y, velocity.x) - theta, 2.0 * M_PI);
+    return std::fabs(error) * 180.0 / M_PI;
+}
+
+static ManoeuvreResult runManoeuvre(Simulation &sim, const Quaternion &start, double theta, double stick, double seconds)
+{
+    sim.reset(start);
+    sim.setTarget((float)(stick * cos(theta)), (float)(stick * sin(theta)));
+
+    ManoeuvreResult result;
+    const double slice = GlobalState::instance().slowLoopTime;
+    const double t0 = sim.ball().time();
+    const double r = sim.ball().getParams().ball_radius_m;
+    bool entered = false;
+    double last_outside = 0.0;
+    double worst_after_entry = 0.0;
+
+    while (sim.ball().time() - t0 < seconds)
+    {
+        sim.run(slice);
+        double t = sim.ball().time() - t0;
+
+        // Centre velocity of the rolling ball: omega x (r z)
+        Vector3 omega = sim.ball().angularVelocity();
+        double error = headingError(Vector3(r * omega.y, -r * omega.x, 0.0f), theta);
+        if (error > SETTLE_BAND_DEG)
+            last_outside = t;
+        else
+            entered = true;
+        if (entered)
+            worst_after_entry = std::max(worst_after_entry, error);
+    }
+
+    double elapsed = sim.ball().time() - t0;
+    Vector3 moved = sim.ball().position();
+    result.distance_m = std::hypot(moved.x, moved.y);
+    if (result.distance_m >= 1e-3)
+        result.heading_deg = std::fabs(std::remainder(std::atan2(moved.y, moved.x) - theta, 2.0 * M_PI)) * 180.0 / M_PI;
+    result.settle_s = std::min(last_outside, elapsed);
+    if (entered)
+        result.overshoot_deg = worst_after_entry;
+    result.energy_j = sim.ball().coilEnergy();
+    return result;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--manoeuvres N] [--seconds S] [--seed S] [--nnls] [--yaw-offset RAD]\n"
+            "       [--kp KP] [--ki KI] [--penalty P] [--fast-loop S] [--slow-loop S]\n"
+            "       [--outer-loop direct|pd|velocity] [--outer-gain-1 G] [--outer-gain-2 G]\n"
+            "       [--stick S] [--transition-ticks N] [--score] [--record FILE]\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    int manoeuvres = 200;
+    double seconds = 1.0;
+    uint32_t seed = 42;
+    bool nnls = false;
+    bool score_only = false;
+    const char *record_path = nullptr;
+    SimParams params;
+
+    // Controller settings; negative means keep the firmware default
+    float kp = -1.0f;
+    float ki = -1.0f;
+    float penalty = -1.0f;
+    float fast_loop = -1.0f;
+    float slow_loop = -1.0f;
+    const char *outer_loop = nullptr;
+    float outer_gain_1 = -1.0f;
+    float outer_gain_2 = -1.0f;
+    double stick = 1.0;
+    int transition_ticks = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--manoeuvres") == 0 && has_value)
+            manoeuvres = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && has_value)
+            seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--nnls") == 0)
+            nnls = true;
+        else if (strcmp(argv[i], "--yaw-offset") == 0 && has_value)
+            params.imu_yaw_offset_rad = atof(argv[++i]);
+        else if (strcmp(argv[i], "--kp") == 0 && has_value)
+            kp = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--ki") == 0 && has_value)
+            ki = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--penalty") == 0 && has_value)
+            penalty = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--fast-loop") == 0 && has_value)
+            fast_loop = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--slow-loop") == 0 && has_value)
+            slow_loop = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--outer-loop") == 0 && has_value)
+            outer_loop = argv[++i];
+        else if (strcmp(argv[i], "--outer-gain-1") == 0 && has_value)
+            outer_gain_1 = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--outer-gain-2") == 0 && has_value)
+            outer_gain_2 = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--stick") == 0 && has_value)
+            stick = atof(argv[++i]);
+        else if (strcmp(argv[i], "--transition-ticks") == 0 && has_value)
+            transition_ticks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--score") == 0)
+            score_only = true;
+        else if (strcmp(argv[i], "--record") == 0 && has_value)
+            record_path = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    // Outer loop mode and gains, as dashboard command 4 sets them
+    OuterLoopParams outer = getOuterLoopParams();
+    if (outer_loop != nullptr)
+    {
+        if (strcmp(outer_loop, "direct") == 0)
+            outer.mode = OuterLoopMode::DIRECT;
+        else if (strcmp(outer_loop, "pd") == 0)
+            outer.mode = OuterLoopMode::PD;
+        else if (strcmp(outer_loop, "velocity") == 0)
+            outer.mode = OuterLoopMode::VELOCITY;
+        else
+            manoeuvres = 0;
+    }
+    float &gain_1 = outer.mode == OuterLoopMode::VELOCITY ? outer.kv : outer.kp;
+    float &gain_2 = outer.mode == OuterLoopMode::VELOCITY ? outer.ki : outer.kd;
+    if (outer_gain_1 >= 0.0f)
+        gain_1 = outer_gain_1;
+    if (outer_gain_2 >= 0.0f)
+        gain_2 = outer_gain_2;
+
+    if (manoeuvres <= 0 || seconds <= 0.0 || stick <= 0.0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    params.seed = seed;
+    Simulation sim(params);
+    setAllocationMode(nnls ? AllocationMode::NNLS : AllocationMode::PAIR_SEARCH);
+
+    GlobalState &state = GlobalState::instance();
+    if (kp >= 0.0f || ki >= 0.0f)
+    {
+        for (int magnetId = 1; magnetId <= 20; magnetId++)
+        {
+            float magnet_kp, magnet_ki;
+            state.getCurrentLoopGains(magnetId, magnet_kp, magnet_ki);
+            state.setCurrentLoopGains(magnetId, kp >= 0.0f ? kp : magnet_kp, ki >= 0.0f ? ki : magnet_ki);
+        }
+    }
+    if (penalty >= 0.0f)
+        getControllerInstance().setCurrentPenalty(penalty);
+    if (fast_loop > 0.0f)
+        state.setFastLoopTime(fast_loop);
+    if (slow_loop > 0.0f)
+    {
+        state.slowLoopTime = slow_loop;
+        getOrientationPredictor().setActuationLead(0.5f * slow_loop);
+    }
+
+    if (transition_ticks >= 0)
+        state.setTransitionTicks(transition_ticks);
+    setOuterLoopParams(outer);
+
+    if (record_path != nullptr && !trace_start_recording(RECORD_CAPACITY, true))
+        return 1;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+    std::vector<double> heading_deg, distance_m, settle_s, overshoot_deg, energy_j;
+    int stalled = 0;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    double sim_start = sim.ball().time();
+
+    for (int m = 0; m < manoeuvres; m++)
+    {
+        Quaternion start = randomQuaternion(rng);
+        ManoeuvreResult result = runManoeuvre(sim, start, angle(rng), stick, seconds);
+
+        distance_m.push_back(result.distance_m);
+        heading_deg.push_back(result.heading_deg);
+        settle_s.push_back(result.settle_s);
+        overshoot_deg.push_back(result.overshoot_deg);
+        energy_j.push_back(result.energy_j);
+        if (result.distance_m < 1e-3)
+            stalled++;
+    }
+
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    double sim_s = sim.ball().time() - sim_start;
+
+    if (record_path != nullptr)
+    {
+        trace_stop_recording();
+        FILE *out = fopen(record_path, "wb");
+        bool written = out != nullptr && fwrite(trace::data(), 1, trace::size(), out) == trace::size();
+        if (out == nullptr || fclose(out) != 0 || !written)
+        {
+            fprintf(stderr, "cannot write %s\n", record_path);
+            return 1;
+        }
+        trace::release();
+    }
+
+    const Simulation::Ripple &ripple = sim.ripple();
+    if (score_only)
+    {
+        printf("score heading_deg=%.4f settle_s=%.5f overshoot_deg=%.4f energy_j=%.6f distance_m=%.5f stalled=%d"
+               " ripple_rms=%.4f ripple_p1=%.4f\n",
+               mean(heading_deg), mean(settle_s), mean(overshoot_deg), mean(energy_j), mean(distance_m), stalled,
+               ripple.relativeRms(), percentile(ripple.along, 0.01));
+        return 0;
+    }
+
+    static const char *const OUTER_LOOP_NAMES[] = {"direct", "PD", "velocity"};
+    printf("manoeuvres      %d x %.2f s (%s, %s outer loop", manoeuvres, seconds, nnls ? "NNLS" : "pair search",
+           OUTER_LOOP_NAMES[(int)outer.mode]);
+    if (outer.mode != OuterLoopMode::DIRECT)
+        printf(" %.3g/%.3g", gain_1, gain_2);
+    printf(", stick %.2f)\n", stick);
+    printf("heading error   median %.1f deg, p90 %.1f deg (stalled count as 180)\n", percentile(heading_deg, 0.5), percentile(heading_deg, 0.9));
+    printf("settling time   median %.3f s, p90 %.3f s\n", percentile(settle_s, 0.5), percentile(settle_s, 0.9));
+    printf("overshoot       median %.1f deg, p90 %.1f deg\n", percentile(overshoot_deg, 0.5), percentile(overshoot_deg, 0.9));
+    printf("coil energy     mean %.3f J per manoeuvre\n", mean(energy_j));
+    printf("distance rolled median %.3f m, p10 %.3f m, stalled %d\n", percentile(distance_m, 0.5), percentile(distance_m, 0.1), stalled);
+    printf("torque ripple   rms %.3f of the request, along-request p1 %.2f, median %.2f (%d-tick crossfade)\n",
+           ripple.relativeRms(), percentile(ripple.along, 0.01), percentile(ripple.along, 0.5), state.getTransitionTicks());
+    printf("simulated %.1f s in %.2f s wall: %.0fx real time\n", sim_s, wall_s, sim_s / wall_s);
+    if (profile::ENABLED)
+    {
+        static char text[2048];
+        profile::format(text, sizeof(text));
+        fputs(text, stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "simulation.h"
+
+#include <comms/wifi_client.h>
+#include <core/imu_task.h>
+#include <hal/trace.h>
+#include <mag_selection_control/control_algorithm.h>
+
+Simulation::Simulation(const SimParams &params) : sim(params)
+{
+    hal::setPosixDevice(&sim);
+
+    // A perfect calibration: the sensor's yaw offset is known exactly
+    BallController &controller = getControllerInstance();
+    ControllerCalibration cal = controller.getCalibration();
+    cal.is_calibrated = true;
+    cal.yaw_offset = (float)params.imu_yaw_offset_rad;
+    cal.yaw_residual = 0.0f;
+    controller.publishCalibration(cal);
+
+    GlobalState &state = GlobalState::instance();
+    state.slowLoopTime = params.imu_interval_us / 1000000.0f;
+    getOrientationPredictor().setActuationLead(0.5f * state.slowLoopTime);
+}
+
+Simulation::~Simulation()
+{
+    hal::setPosixDevice(nullptr);
+}
+
+void Simulation::reset(const Quaternion &orientation)
+{
+    GlobalState &state = GlobalState::instance();
+    setTarget(0.0f, 0.0f);
+
+    // Let the transition scheduler fade the last frame out, as a stop would
+    state.zeroControl();
+    for (int i = 0; i < 200; i++)
+    {
+        state.currentControlLoop();
+        sim.advance(state.fastLoopTime);
+    }
+
+    sim.reset(orientation);
+}
+
+void Simulation::setTarget(float x, float y)
+{
+    // Recorded as the dashboard command it stands for, so a replay sees it
+    DashboardCommand cmd = {};
+    cmd.command_type = 0;
+    cmd.ideal_direction_x = x;
+    cmd.ideal_direction_y = y;
+    trace::recordCommand(&cmd, sizeof(cmd));
+
+    GlobalState::instance().setIdealDirection(Vector3(x, y, 0.0f));
+}
+
+void Simulation::slowTick()
+{
+    GlobalState &state = GlobalState::instance();
+    imu_poll_once(); // the IMU task's share of this instant, ahead of the tick as on the board
+    trace::recordSlowTick();
+    imu_update_global_state();
+    computeControl(state.getOrientationHistory(10), state.getAngularVelocityHistory(10), state.getIdealDirection(), frame);
+    state.applyControlFrame(frame);
+}
+
+void Simulation::recordRipple()
+{
+    // Below a tenth of an amp in total the request is mostly current sense noise
+    float total = 0.0f;
+    for (int k = 0; k < frame.count; k++)
+        total += frame.currents[k];
+    Vector3 requested = sim.rollingForce(frame);
+    double requested_sq = requested.dot(requested);
+    if (total < 0.1f || requested_sq < 1e-12)
+        return;
+
+    Vector3 produced = sim.rollingForce();
+    Vector3 error = produced - requested;
+    torque_ripple.error_sq += error.dot(error);
+    torque_ripple.requested_sq += requested_sq;
+    torque_ripple.along.push_back(produced.dot(requested) / requested_sq);
+}
+
+void Simulation::run(double seconds)
+{
+    GlobalState &state = GlobalState::instance();
+    const double end = sim.time() + seconds;
+
+    while (sim.time() < end)
+    {
+        slowTick();
+
+        const double tick_end = sim.time() + state.slowLoopTime;
+        while (sim.time() < tick_end)
+        {
+            state.currentControlLoop();
+            imu_poll_once();
+            sim.advance(state.fastLoopTime);
+            recordRipple();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ball_sim.h"
+
+#include <cmath>
+#include <vector>
+
+// Closes the firmware's control loops around a BallSim in simulated time.
+//
+// run() follows core1LoopTask tick for tick: every slow-loop period the
+// newest IMU sample goes to GlobalState and computeControl picks the coils,
+// then GlobalState::currentControlLoop runs every fast-loop period with the
+// physics advanced in between. Only the scheduling is replaced; the current
+// loop, the solver and the IMU path are the firmware's own code. Nothing
+// sleeps, so it runs as fast as the host can compute.
+//
+// GlobalState and the controller are process-wide singletons: keep one
+// Simulation at a time, and never alongside the state machine.
+class Simulation
+{
+public:
+    // Torque ripple over every fast tick run() has run with a frame asking for
+    // at least 0.1 A:
+    // the rolling force the coils produce against the force the solver's
+    // latest frame asks for (BallSim::rollingForce)
+    struct Ripple
+    {
+        double error_sq = 0.0;          // sum of |produced - requested|^2
+        double requested_sq = 0.0;      // sum of |requested|^2
+        std::vector<double> along;      // produced . requested / |requested|^2, per tick
+
+        double relativeRms() const { return requested_sq > 0.0 ? std::sqrt(error_sq / requested_sq) : 0.0; }
+    };
+
+    explicit Simulation(const SimParams &params = SimParams());
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    // Ramps the coils out, then puts the ball at rest at `orientation`
+    void reset(const Quaternion &orientation);
+
+    // Joystick target, as the dashboard would send it
+    void setTarget(float x, float y);
+
+    // Runs the control loops for `seconds` of simulated time
+    void run(double seconds);
+
+    BallSim &ball() { return sim; }
+    const Ripple &ripple() const { return torque_ripple; }
+
+private:
+    void slowTick();
+    void recordRipple();
+
+    BallSim sim;
+    ControlFrame frame;
+    Ripple torque_ripple;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Host cycle counter with the device's signature. On x86 this is the TSC,
+// which ticks at a constant reference rate rather than the core clock; on
+// AArch64 it is the generic timer. Only differences are meaningful.
+static inline uint32_t esp_cpu_get_cycle_count()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return (uint32_t)value;
+#else
+    return 0;
+#endif
+}
+
+// Name of the counter behind esp_cpu_get_cycle_count(), for reports
+static inline const char *host_cycle_counter_name()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return "rdtsc";
+#elif defined(__aarch64__)
+    return "cntvct_el0";
+#else
+    return "none";
+#endif
+}
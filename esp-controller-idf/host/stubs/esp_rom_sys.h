@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+
+#include "esp_cpu.h"
+
+// Rate of esp_cpu_get_cycle_count() in ticks per microsecond. The device
+// returns the CPU clock; here it is measured once against the steady clock
+// over a few milliseconds, since the host counter's rate is not the core's.
+static inline uint32_t esp_rom_get_cpu_ticks_per_us()
+{
+    static const uint32_t ticks_per_us = [] {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point start = clock::now();
+        const uint32_t start_ticks = esp_cpu_get_cycle_count();
+        while (clock::now() - start < std::chrono::milliseconds(20))
+        {
+        }
+        const uint32_t ticks = esp_cpu_get_cycle_count() - start_ticks;
+        const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+        const double rate = ticks / us + 0.5;
+        return rate >= 1.0 ? static_cast<uint32_t>(rate) : 1u;
+    }();
+    return ticks_per_us;
+}
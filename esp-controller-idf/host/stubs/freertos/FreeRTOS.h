@@ -0,0 +1,23 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF FreeRTOS headers: just enough of the API for
+// the control code to compile and run natively (see host/CMakeLists.txt).
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks) ((TickType_t)(ticks))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
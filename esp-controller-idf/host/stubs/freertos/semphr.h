@@ -0,0 +1,8 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// Mutexes are backed by std::mutex (freertos_stubs.cpp)
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
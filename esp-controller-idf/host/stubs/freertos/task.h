@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef enum
+{
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+// Sleeps the calling thread (one tick = 1 ms on the host)
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+// Tasks run on their own std::thread (freertos_stubs.cpp). Stack size,
+// priority and core are ignored. The handle is written before the task
+// starts, as on the device when the creator has the higher priority.
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+
+// Only vTaskDelete(NULL) from inside a task is supported: it ends the calling
+// task, which then reports eDeleted.
+void vTaskDelete(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
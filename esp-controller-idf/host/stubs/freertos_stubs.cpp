@@ -0,0 +1,116 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point s_start = std::chrono::steady_clock::now();
+
+namespace
+{
+struct HostTask
+{
+    std::atomic<bool> deleted{false};
+};
+
+// Thrown by vTaskDelete(NULL) to unwind the task back to its thread entry
+struct TaskDeleted
+{
+};
+
+// Threads not created through xTaskCreate (main) share one handle
+HostTask s_main_task;
+thread_local HostTask *s_current_task = &s_main_task;
+} // namespace
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    std::mutex *mutex = static_cast<std::mutex *>(semaphore);
+    if (ticks_to_wait == portMAX_DELAY)
+    {
+        mutex->lock();
+        return pdTRUE;
+    }
+    return mutex->try_lock() ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    static_cast<std::mutex *>(semaphore)->unlock();
+    return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *created_task)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+
+    // Never freed: handles stay valid for eTaskGetState after the task ends
+    HostTask *task = new HostTask();
+    if (created_task)
+        *created_task = task;
+
+    std::thread([function, param, task]() {
+        s_current_task = task;
+        try
+        {
+            function(param);
+        }
+        catch (const TaskDeleted &)
+        {
+        }
+        task->deleted = true;
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    (void)core_id;
+    return xTaskCreate(function, name, stack_depth, param, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_current_task)
+        throw TaskDeleted();
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+    if (task == NULL)
+        return eInvalid;
+    return static_cast<HostTask *>(task)->deleted ? eDeleted : eRunning;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return s_current_task;
+}
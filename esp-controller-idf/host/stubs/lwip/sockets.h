@@ -0,0 +1,10 @@
+#pragma once
+
+// lwIP's BSD socket API is the POSIX one on the host
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define closesocket(s) close(s)
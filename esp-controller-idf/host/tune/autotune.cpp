@@ -0,0 +1,496 @@
+// Searches the current loop gains, the solver's current penalty, the loop
+// periods and the outer loop's two gains against the ball simulator, on every
+// core.
+//
+// Each candidate is one ball_sim --score run over the same manoeuvres (same
+// seed), so candidates are compared on identical input. GlobalState and the
+// controller are process-wide singletons, so runs are separate processes;
+// a work-stealing pool keeps one in flight per core.
+//
+// Modes:
+//   grid    every combination of the listed values
+//   refine  random search in the box spanned by each list, re-centred on the
+//           best candidate and halved every round (log scale for gains)
+//
+// --outer-loop picks the outer loop mode every candidate runs with; for pd and
+// velocity the two outer gains are searched too (kp/kd or kv/ki, in the order
+// ball_sim and dashboard command 4 take them).
+//
+// Prints the candidates ranked by cost and writes the best to a header.
+//
+//   autotune [--mode grid|refine] [--kp LIST] [--ki LIST] [--penalty LIST]
+//            [--fast-loop LIST] [--slow-loop LIST] [--outer-loop direct|pd|velocity]
+//            [--outer-gain-1 LIST] [--outer-gain-2 LIST] [--rounds R] [--samples N]
+//            [--manoeuvres N] [--seconds S] [--seed S] [--threads T] [--nnls]
+//            [--w-settle W] [--w-overshoot W] [--w-energy W] [--w-heading W]
+//            [--top N] [--header FILE] [--sim PATH]
+//
+// LIST is comma separated, e.g. --kp 20,35,60.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "work_stealing_pool.h"
+
+extern char **environ;
+
+#ifndef BALL_SIM_PATH
+#define BALL_SIM_PATH "ball_sim"
+#endif
+
+// Tuned parameters, in the order of PARAM_NAMES
+static constexpr int PARAM_COUNT = 7;
+static const char *const PARAM_NAMES[PARAM_COUNT] = {"kp", "ki", "penalty", "fast-loop", "slow-loop",
+                                                     "outer-gain-1", "outer-gain-2"};
+static const bool PARAM_LOG_SCALE[PARAM_COUNT] = {true, true, true, false, false, true, true};
+static constexpr int FIRST_OUTER_PARAM = 5;
+
+struct Candidate
+{
+    double params[PARAM_COUNT] = {};
+
+    bool ok = false;
+    double cost = 0.0;
+    double heading_deg = 0.0;
+    double settle_s = 0.0;
+    double overshoot_deg = 0.0;
+    double energy_j = 0.0;
+    double distance_m = 0.0;
+    int stalled = 0;
+};
+
+struct Settings
+{
+    std::string sim = BALL_SIM_PATH;
+    int manoeuvres = 40;
+    double seconds = 1.0;
+    uint32_t seed = 42;
+    bool nnls = false;
+    std::string outer_loop = "direct";
+
+    // cost = w_settle * s + w_overshoot * deg / 180 + w_energy * J + w_heading * deg / 180
+    double w_settle = 1.0;
+    double w_overshoot = 0.5;
+    double w_energy = 2.0;
+    double w_heading = 1.0;
+};
+
+static std::vector<double> parseList(const char *text)
+{
+    std::vector<double> values;
+    const char *p = text;
+    while (*p)
+    {
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p)
+            return {};
+        values.push_back(v);
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+            return {};
+    }
+    return values;
+}
+
+// Runs ball_sim once and fills in the candidate's scores
+static void evaluate(const Settings &settings, Candidate &c)
+{
+    std::vector<std::string> args = {settings.sim, "--score",
+                                     "--manoeuvres", std::to_string(settings.manoeuvres),
+                                     "--seconds", std::to_string(settings.seconds),
+                                     "--seed", std::to_string(settings.seed)};
+    if (settings.nnls)
+        args.push_back("--nnls");
+    args.push_back("--outer-loop");
+    args.push_back(settings.outer_loop);
+    int param_count = settings.outer_loop == "direct" ? FIRST_OUTER_PARAM : PARAM_COUNT;
+    for (int i = 0; i < param_count; i++)
+    {
+        char value[32];
+        snprintf(value, sizeof(value), "%.9g", c.params[i]);
+        args.push_back(std::string("--") + PARAM_NAMES[i]);
+        args.push_back(value);
+    }
+
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+        return;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[1]);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    if (err != 0)
+    {
+        close(pipe_fds[0]);
+        return;
+    }
+
+    std::string output;
+    char buffer[512];
+    ssize_t n;
+    while ((n = read(pipe_fds[0], buffer, sizeof(buffer))) > 0)
+        output.append(buffer, (size_t)n);
+    close(pipe_fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return;
+
+    size_t line = output.find("score ");
+    if (line == std::string::npos)
+        return;
+    int parsed = sscanf(output.c_str() + line,
+                        "score heading_deg=%lf settle_s=%lf overshoot_deg=%lf energy_j=%lf distance_m=%lf stalled=%d",
+                        &c.heading_deg, &c.settle_s, &c.overshoot_deg, &c.energy_j, &c.distance_m, &c.stalled);
+    if (parsed != 6)
+        return;
+
+    c.cost = settings.w_settle * c.settle_s + settings.w_overshoot * c.overshoot_deg / 180.0 +
+             settings.w_energy * c.energy_j + settings.w_heading * c.heading_deg / 180.0;
+    c.ok = true;
+}
+
+static void evaluateAll(WorkStealingPool &pool, const Settings &settings, std::vector<Candidate> &candidates, size_t first)
+{
+    std::vector<WorkStealingPool::Task> tasks;
+    for (size_t i = first; i < candidates.size(); i++)
+    {
+        Candidate *c = &candidates[i];
+        tasks.push_back([&settings, c] { evaluate(settings, *c); });
+    }
+    pool.run(std::move(tasks));
+}
+
+static std::vector<Candidate> gridCandidates(const std::vector<double> lists[PARAM_COUNT])
+{
+    std::vector<Candidate> out(1);
+    for (int p = 0; p < PARAM_COUNT; p++)
+    {
+        std::vector<Candidate> next;
+        for (const Candidate &base : out)
+        {
+            for (double v : lists[p])
+            {
+                Candidate c = base;
+                c.params[p] = v;
+                next.push_back(c);
+            }
+        }
+        out.swap(next);
+    }
+    return out;
+}
+
+static const Candidate *best(const std::vector<Candidate> &candidates)
+{
+    const Candidate *winner = nullptr;
+    for (const Candidate &c : candidates)
+    {
+        if (c.ok && (winner == nullptr || c.cost < winner->cost))
+            winner = &c;
+    }
+    return winner;
+}
+
+// C++ float literal for a header, always with a decimal point or exponent
+static std::string floatLiteral(double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.6g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos)
+        literal += ".0";
+    return literal + "f";
+}
+
+static bool writeHeader(const char *path, const Candidate &c, const Settings &settings, size_t evaluated)
+{
+    FILE *out = fopen(path, "w");
+    if (out == nullptr)
+        return false;
+    fprintf(out, "#pragma once\n\n");
+    fprintf(out, "// Generated by host autotune: ball_sim, %d manoeuvres x %.2f s, seed %u%s.\n",
+            settings.manoeuvres, settings.seconds, (unsigned)settings.seed, settings.nnls ? ", NNLS" : "");
+    fprintf(out, "// Best of %zu candidates: cost %.4f (settle %.3f s, overshoot %.1f deg,\n",
+            evaluated, c.cost, c.settle_s, c.overshoot_deg);
+    fprintf(out, "// energy %.4f J, heading %.1f deg). Simulator constants are estimates:\n",
+            c.energy_j, c.heading_deg);
+    fprintf(out, "// confirm on the rig before adopting these.\n");
+    fprintf(out, "namespace tuned_params\n{\n");
+    fprintf(out, "    constexpr float CURRENT_KP = %s;\n", floatLiteral(c.params[0]).c_str());
+    fprintf(out, "    constexpr float CURRENT_KI = %s;\n", floatLiteral(c.params[1]).c_str());
+    fprintf(out, "    constexpr float CURRENT_PENALTY = %s;\n", floatLiteral(c.params[2]).c_str());
+    fprintf(out, "    constexpr float FAST_LOOP_TIME = %s; // s\n", floatLiteral(c.params[3]).c_str());
+    fprintf(out, "    constexpr float SLOW_LOOP_TIME = %s; // s\n", floatLiteral(c.params[4]).c_str());
+    if (settings.outer_loop == "pd")
+    {
+        fprintf(out, "    constexpr float OUTER_KP = %s;\n", floatLiteral(c.params[5]).c_str());
+        fprintf(out, "    constexpr float OUTER_KD = %s;\n", floatLiteral(c.params[6]).c_str());
+    }
+    else if (settings.outer_loop == "velocity")
+    {
+        fprintf(out, "    constexpr float OUTER_KV = %s;\n", floatLiteral(c.params[5]).c_str());
+        fprintf(out, "    constexpr float OUTER_KI = %s;\n", floatLiteral(c.params[6]).c_str());
+    }
+    fprintf(out, "}\n");
+    return fclose(out) == 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [--mode grid|refine] [--kp LIST] [--ki LIST] [--penalty LIST]\n"
+            "       [--fast-loop LIST] [--slow-loop LIST] [--outer-loop direct|pd|velocity]\n"
+            "       [--outer-gain-1 LIST] [--outer-gain-2 LIST] [--rounds R] [--samples N]\n"
+            "       [--manoeuvres N] [--seconds S] [--seed S] [--threads T] [--nnls]\n"
+            "       [--w-settle W] [--w-overshoot W] [--w-energy W] [--w-heading W]\n"
+            "       [--top N] [--header FILE] [--sim PATH]\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    Settings settings;
+    bool refine = false;
+    int rounds = 4;
+    int samples = 32;
+    unsigned threads = std::thread::hardware_concurrency();
+    int top = 10;
+    const char *header_path = "tuned_params.h";
+
+    // Firmware defaults (MagnetInfo, BallController, GlobalState); the outer
+    // gains are filled in below once the mode is known
+    std::vector<double> lists[PARAM_COUNT] = {
+        {20.0, 35.0, 60.0},
+        {5000.0, 15000.0, 40000.0},
+        {0.5, 1.0, 2.0, 4.0},
+        {0.00065},
+        {0.01},
+        {},
+        {},
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        bool matched = false;
+        for (int p = 0; p < PARAM_COUNT && !matched; p++)
+        {
+            if (strncmp(argv[i], "--", 2) == 0 && strcmp(argv[i] + 2, PARAM_NAMES[p]) == 0 && has_value)
+            {
+                lists[p] = parseList(argv[++i]);
+                if (lists[p].empty())
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                matched = true;
+            }
+        }
+        if (matched)
+            continue;
+
+        if (strcmp(argv[i], "--mode") == 0 && has_value)
+        {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "refine") == 0)
+                refine = true;
+            else if (strcmp(mode, "grid") != 0)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--outer-loop") == 0 && has_value)
+        {
+            settings.outer_loop = argv[++i];
+            if (settings.outer_loop != "direct" && settings.outer_loop != "pd" && settings.outer_loop != "velocity")
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && has_value)
+            rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--samples") == 0 && has_value)
+            samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--manoeuvres") == 0 && has_value)
+            settings.manoeuvres = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && has_value)
+            settings.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+            settings.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && has_value)
+            threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nnls") == 0)
+            settings.nnls = true;
+        else if (strcmp(argv[i], "--w-settle") == 0 && has_value)
+            settings.w_settle = atof(argv[++i]);
+        else if (strcmp(argv[i], "--w-overshoot") == 0 && has_value)
+            settings.w_overshoot = atof(argv[++i]);
+        else if (strcmp(argv[i], "--w-energy") == 0 && has_value)
+            settings.w_energy = atof(argv[++i]);
+        else if (strcmp(argv[i], "--w-heading") == 0 && has_value)
+            settings.w_heading = atof(argv[++i]);
+        else if (strcmp(argv[i], "--top") == 0 && has_value)
+            top = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--header") == 0 && has_value)
+            header_path = argv[++i];
+        else if (strcmp(argv[i], "--sim") == 0 && has_value)
+            settings.sim = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (settings.manoeuvres <= 0 || settings.seconds <= 0.0 || rounds <= 0 || samples <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Outer gains around the OuterLoopParams defaults; unused (one
+    // placeholder value) in direct mode
+    if (settings.outer_loop == "direct")
+    {
+        lists[FIRST_OUTER_PARAM] = {0.0};
+        lists[FIRST_OUTER_PARAM + 1] = {0.0};
+    }
+    else if (lists[FIRST_OUTER_PARAM].empty() || lists[FIRST_OUTER_PARAM + 1].empty())
+    {
+        bool pd = settings.outer_loop == "pd";
+        if (lists[FIRST_OUTER_PARAM].empty())
+            lists[FIRST_OUTER_PARAM] = pd ? std::vector<double>{1.75, 3.5, 7.0} : std::vector<double>{0.5, 1.0, 2.0};
+        if (lists[FIRST_OUTER_PARAM + 1].empty())
+            lists[FIRST_OUTER_PARAM + 1] = pd ? std::vector<double>{1.25, 2.5, 5.0} : std::vector<double>{0.15, 0.3, 0.6};
+    }
+
+    WorkStealingPool pool(threads);
+    auto wall_start = std::chrono::steady_clock::now();
+    std::vector<Candidate> candidates;
+
+    if (!refine)
+    {
+        candidates = gridCandidates(lists);
+        printf("grid: %zu candidates on %u threads\n", candidates.size(), pool.size());
+        evaluateAll(pool, settings, candidates, 0);
+    }
+    else
+    {
+        // Search box per parameter, from the extremes of its list
+        double lo[PARAM_COUNT], hi[PARAM_COUNT];
+        for (int p = 0; p < PARAM_COUNT; p++)
+        {
+            lo[p] = *std::min_element(lists[p].begin(), lists[p].end());
+            hi[p] = *std::max_element(lists[p].begin(), lists[p].end());
+            if (PARAM_LOG_SCALE[p] && lo[p] <= 0.0 && hi[p] > 0.0)
+                lo[p] = hi[p] * 1e-3;
+        }
+
+        std::mt19937 rng(settings.seed);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        for (int round = 0; round < rounds; round++)
+        {
+            size_t first = candidates.size();
+            for (int s = 0; s < samples; s++)
+            {
+                Candidate c;
+                for (int p = 0; p < PARAM_COUNT; p++)
+                {
+                    double u = unit(rng);
+                    if (lo[p] == hi[p])
+                        c.params[p] = lo[p]; // fixed, e.g. the unused outer gains in direct mode
+                    else
+                        c.params[p] = PARAM_LOG_SCALE[p] ? lo[p] * std::pow(hi[p] / lo[p], u) : lo[p] + (hi[p] - lo[p]) * u;
+                }
+                candidates.push_back(c);
+            }
+            evaluateAll(pool, settings, candidates, first);
+
+            const Candidate *winner = best(candidates);
+            if (winner == nullptr)
+                break;
+            printf("round %d: %zu candidates, best cost %.4f\n", round + 1, candidates.size(), winner->cost);
+
+            // Halve the box around the best so far, staying inside the original range
+            for (int p = 0; p < PARAM_COUNT; p++)
+            {
+                double centre = winner->params[p];
+                if (lo[p] == hi[p])
+                    continue;
+                if (PARAM_LOG_SCALE[p])
+                {
+                    double half = std::sqrt(std::sqrt(hi[p] / lo[p]));
+                    lo[p] = std::max(lo[p], centre / half);
+                    hi[p] = std::min(hi[p], centre * half);
+                }
+                else
+                {
+                    double half = 0.25 * (hi[p] - lo[p]);
+                    lo[p] = std::max(lo[p], centre - half);
+                    hi[p] = std::min(hi[p], centre + half);
+                }
+            }
+        }
+    }
+
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::vector<const Candidate *> ranked;
+    for (const Candidate &c : candidates)
+    {
+        if (c.ok)
+            ranked.push_back(&c);
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Candidate *a, const Candidate *b) { return a->cost < b->cost; });
+    size_t failed = candidates.size() - ranked.size();
+
+    printf("%zu candidates in %.1f s wall (%zu failed)\n\n", candidates.size(), wall_s, failed);
+    printf("outer loop: %s\n", settings.outer_loop.c_str());
+    printf("rank       kp        ki  penalty  fast_us  slow_ms  outer_1  outer_2     cost  settle_s  overshoot  energy_J  heading  stalled\n");
+    for (size_t r = 0; r < ranked.size() && (int)r < top; r++)
+    {
+        const Candidate &c = *ranked[r];
+        printf("%4zu %8.2f %9.1f %8.3f %8.1f %8.2f %8.3f %8.3f %8.4f %9.3f %10.1f %9.4f %8.1f %8d\n",
+               r + 1, c.params[0], c.params[1], c.params[2], c.params[3] * 1e6, c.params[4] * 1e3,
+               c.params[5], c.params[6], c.cost, c.settle_s, c.overshoot_deg, c.energy_j, c.heading_deg, c.stalled);
+    }
+
+    if (ranked.empty())
+    {
+        fprintf(stderr, "no candidate ran; is %s built?\n", settings.sim.c_str());
+        return 1;
+    }
+    if (!writeHeader(header_path, *ranked[0], settings, ranked.size()))
+    {
+        fprintf(stderr, "cannot write %s\n", header_path);
+        return 1;
+    }
+    printf("\nbest parameters written to %s\n", header_path);
+    return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, one task deque each. A worker takes its own
+// newest task first and, when its deque is empty, steals the oldest task of
+// another worker, so uneven task lengths still keep every core busy.
+//
+// run() hands out a batch round-robin and blocks until all of it is done.
+// Tasks must not throw.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threads = std::thread::hardware_concurrency())
+    {
+        if (threads == 0)
+            threads = 1;
+        for (unsigned i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    void run(std::vector<Task> tasks)
+    {
+        if (tasks.empty())
+            return;
+
+        pending = (int)tasks.size();
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            Queue &queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(tasks[i]));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            generation++;
+        }
+        wake.notify_all();
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        done.wait(lock, [this] { return pending.load() == 0; });
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popOwn(unsigned index, Task &task)
+    {
+        Queue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned thief, Task &task)
+    {
+        for (size_t k = 1; k < queues.size(); k++)
+        {
+            Queue &queue = *queues[(thief + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned index)
+    {
+        uint64_t seen_generation = 0;
+        while (true)
+        {
+            Task task;
+            if (popOwn(index, task) || steal(index, task))
+            {
+                task();
+                if (--pending == 0)
+                {
+                    std::lock_guard<std::mutex> lock(wake_mutex);
+                    done.notify_all();
+                }
+                continue;
+            }
+
+            // Out of work: sleep until the next batch (or shutdown)
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping)
+                return;
+            seen_generation = generation;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool stopping = false;
+    std::atomic<int> pending{0};
+};
@@ -1,41 +1,169 @@
 #include "calibration.h"
 #include "../core/global_state.h"
-#include "../core/peripherals.h"
+#include "../core/imu_task.h"
+#include "../hal/hal.h"
+#include "../mag_selection_control/control_algorithm.h"
 #include "../utils/utils.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+// Runs the current loop at its normal rate for `duration_s`
+static void runCurrentLoopFor(GlobalState &state, float duration_s)
+{
+    const int64_t interval_us = static_cast<int64_t>(state.fastLoopTime * 1000000.0f);
+    const int64_t end_us = hal::micros() + static_cast<int64_t>(duration_s * 1000000.0f);
+    int64_t next_us = hal::micros();
+
+    while (hal::micros() < end_us)
+    {
+        if (hal::micros() >= next_us)
+        {
+            state.currentControlLoop();
+            next_us += interval_us;
+        }
+    }
+}
+
+static Quaternion latestOrientation()
+{
+    // The control task is not running here, so pull the newest IMU sample ourselves
+    imu_update_global_state();
+    Orientation current_q = GlobalState::instance().getOrientation();
+    return Quaternion(current_q.w, current_q.x, current_q.y, current_q.z);
+}
+
+// Rotation vector (axis * angle) of a unit quaternion, shortest way round
+static Vector3 rotationVector(const Quaternion &q)
+{
+    float sign = q.w < 0.0f ? -1.0f : 1.0f;
+    Vector3 v(sign * q.x, sign * q.y, sign * q.z);
+    float s = sqrtf(v.dot(v));
+    if (s < 1e-9f)
+        return v * 2.0f;
+    return v * (2.0f * atan2f(s, sign * q.w) / s);
+}
+
 CalibrationSequence::CalibrationSequence()
-    : controller(), num_calibration_steps(0)
+    : controller(getControllerInstance()), num_calibration_steps(0)
 {
 }
 
 int CalibrationSequence::startCalibration()
 {
-    // Get the next magnet to fire for calibration
-    // For now, we'll get the orientation from global state
-    GlobalState &state = GlobalState::instance();
-    Orientation current_q = state.getOrientation();
-    Quaternion q(current_q.w, current_q.x, current_q.y, current_q.z);
+    if (num_calibration_steps >= MAX_CALIBRATION_STEPS)
+        return -1;
 
-    current_magnet_id = controller.getCalibrationMagnet(q);
+    // Pick a magnet pulling away from the directions already sampled
+    fire_q = latestOrientation();
+    current_magnet_id = controller.getCalibrationMagnet(fire_q, fired_angles, num_calibration_steps);
 
-    printf("Calibration: Firing magnet %d\n", current_magnet_id);
+    printf("Calibration step %d/%d: Firing magnet %d\n", num_calibration_steps + 1, MAX_CALIBRATION_STEPS, current_magnet_id);
 
     return current_magnet_id;
 }
 
-void CalibrationSequence::completeCalibrationStep(float joy_x, float joy_y, const Quaternion &q)
+void CalibrationSequence::pulseMagnet()
+{
+    if (current_magnet_id < 0)
+        return;
+
+    GlobalState &state = GlobalState::instance();
+    fire_q = latestOrientation();
+
+    // Solver IDs are magnet indices (0-19); GlobalState uses 1-based magnet IDs
+    state.setControl(ControlOutputs(current_magnet_id + 1, PULSE_CURRENT));
+    runCurrentLoopFor(state, PULSE_SECONDS);
+
+    // Let the transition ramp the coil back down, then make sure it is off
+    state.zeroControl();
+    runCurrentLoopFor(state, state.getTransitionTicks() * state.fastLoopTime);
+    zeroPWMs();
+}
+
+void CalibrationSequence::completeCalibrationStep(float joy_x, float joy_y)
 {
     printf("Calibration result: User input (%.2f, %.2f)\n", joy_x, joy_y);
 
-    // Finalize this calibration step with the user's joystick input
-    controller.finishCalibration(current_magnet_id, q, joy_x, joy_y);
+    if (current_magnet_id < 0 || num_calibration_steps >= MAX_CALIBRATION_STEPS)
+        return;
+
+    // Record this step against the orientation the magnet was fired at
+    recordSample(controller.calibrationSample(current_magnet_id, fire_q, joy_x, joy_y));
+}
+
+PulseResponse measurePulseResponse(int magnet_index, float current, float seconds)
+{
+    GlobalState &state = GlobalState::instance();
+    PulseResponse response;
+    Quaternion start_q = latestOrientation();
+    AngularVelocity gyro = state.getAngularVelocity();
+    response.q_start = start_q;
+
+    // The ball may still be coasting from an earlier pulse: measure its
+    // world-frame rate now so that drift can be taken out of the response
+    Vector3 rate_world = BallController::quatToMatrix(start_q).multiply(Vector3(gyro.x, gyro.y, gyro.z));
+
+    int64_t start_us = hal::micros();
+    state.setControl(ControlOutputs(magnet_index + 1, current));
+    runCurrentLoopFor(state, seconds);
+    state.zeroControl();
+    runCurrentLoopFor(state, state.getTransitionTicks() * state.fastLoopTime);
+    zeroPWMs();
+    Quaternion end_q = latestOrientation();
+    response.seconds = (hal::micros() - start_us) * 1e-6f;
+
+    // World-frame rotation over the pulse: end_q * conj(start_q)
+    Quaternion delta(end_q.w * start_q.w + end_q.x * start_q.x + end_q.y * start_q.y + end_q.z * start_q.z,
+                     -end_q.w * start_q.x + end_q.x * start_q.w - end_q.y * start_q.z + end_q.z * start_q.y,
+                     -end_q.w * start_q.y + end_q.x * start_q.z + end_q.y * start_q.w - end_q.z * start_q.x,
+                     -end_q.w * start_q.z - end_q.x * start_q.y + end_q.y * start_q.x + end_q.z * start_q.w);
+    response.rotation = rotationVector(delta) - rate_world * response.seconds;
+    return response;
+}
+
+bool CalibrationSequence::measureCalibrationStep()
+{
+    if (current_magnet_id < 0 || num_calibration_steps >= MAX_CALIBRATION_STEPS)
+        return false;
+
+    PulseResponse response = measurePulseResponse(current_magnet_id, PULSE_CURRENT, AUTO_PULSE_SECONDS);
+    fire_q = response.q_start;
+    const Vector3 &rotation = response.rotation;
+
+    // Rolling without slipping about world axis (rx, ry) moves the ball along
+    // (ry, -rx): that is the direction the magnet pulled it
+    float move_x = rotation.y / AUTO_FULL_RESPONSE_RAD;
+    float move_y = -rotation.x / AUTO_FULL_RESPONSE_RAD;
+    printf("Calibration result: measured rotation (%.3f, %.3f, %.3f) rad\n", rotation.x, rotation.y, rotation.z);
+
+    CalibrationSample sample = controller.calibrationSample(current_magnet_id, fire_q, move_x, move_y);
+    recordSample(sample);
+    return sample.weight > 0.0f;
+}
+
+void CalibrationSequence::recordSample(const CalibrationSample &sample)
+{
+    samples[num_calibration_steps] = sample;
+    fired_angles[num_calibration_steps] = samples[num_calibration_steps].theta_imu;
+    num_calibration_steps++;
+    current_magnet_id = -1;
+
+    if (num_calibration_steps < MAX_CALIBRATION_STEPS)
+        return;
 
-    printf("Calibration complete.\n");
+    // All steps done: fit and publish
+    fit = controller.finishCalibration(samples, num_calibration_steps);
+    if (!BallController::fitUsable(fit))
+    {
+        printf("Calibration failed: %d usable samples (resultant %.3f), need %d agreeing to %.2f\n", fit.samples,
+               fit.resultant, BallController::MIN_CALIBRATION_SAMPLES, BallController::MIN_CALIBRATION_RESULTANT);
+        return;
+    }
+    printf("Calibration complete: yaw offset %.1f deg, residual %.1f deg RMS over %d samples (resultant %.3f)\n",
+           fit.yaw_offset * 57.2957795f, fit.residual_rms * 57.2957795f, fit.samples, fit.resultant);
 }
 
 bool CalibrationSequence::isCalibrated() const
 {
-    return controller.isCalibrated() && num_calibration_steps >= MAX_CALIBRATION_STEPS;
+    return controller.isCalibrated() && BallController::fitUsable(fit) && num_calibration_steps >= MAX_CALIBRATION_STEPS;
 }
@@ -3,27 +3,87 @@
 #include "../control/BallController.h"
 #include "../core/global_state.h"
 
+// The ball's response to one short coil pulse
+struct PulseResponse
+{
+    Quaternion q_start; // Orientation when the pulse started
+    Vector3 rotation;   // World-frame rotation over the pulse (rad), earlier motion removed
+    float seconds = 0;  // Pulse plus ramp-down
+};
+
+// Fires magnet index `magnet_index` (0-19) at `current` for `seconds`, ramps it
+// down and measures how far the ball turned. Runs the current loop itself,
+// so the control task must not be running.
+PulseResponse measurePulseResponse(int magnet_index, float current, float seconds);
+
+// Drives the calibration steps against the shared controller
+// (getControllerInstance()), which publishes the result as a new calibration
+// snapshot for the control task.
+//
+// Each step fires a magnet whose pull is well separated from the earlier ones
+// and records where the operator saw the ball go. After the last step the yaw
+// offset is fitted to all samples at once (circular mean), so one sloppy
+// joystick push no longer sets the whole calibration.
+//
+// The automatic mode (measureCalibrationStep) replaces the operator with the
+// IMU: the ball's rotation during a short pulse gives the direction it
+// started to roll. The yaw offset then aligns the solver with the IMU's own
+// world frame rather than the operator's view, and all steps take well under
+// a second.
 class CalibrationSequence
 {
 private:
-    BallController controller;
+    BallController &controller;
     int current_magnet_id = -1;
+    Quaternion fire_q; // Orientation when the current magnet was last fired
     int num_calibration_steps = 0;
     static const int MAX_CALIBRATION_STEPS = 3; // Number of calibration points
 
+    CalibrationSample samples[MAX_CALIBRATION_STEPS];
+    float fired_angles[MAX_CALIBRATION_STEPS]; // World-frame pull heading of each fired magnet
+    YawFit fit;
+
+    // Adds the current step's sample and fits once the last step is in
+    void recordSample(const CalibrationSample &sample);
+
 public:
+    // One firing: on long enough for the ball to visibly start rolling
+    static constexpr float PULSE_CURRENT = 4.0f; // A
+    static constexpr float PULSE_SECONDS = 0.3f;
+
+    // Automatic firing: short enough that the ball barely moves
+    static constexpr float AUTO_PULSE_SECONDS = 0.12f;
+    // Ball rotation (rad) over one automatic pulse that counts as a full
+    // joystick deflection; below a tenth of it the step is ignored
+    static constexpr float AUTO_FULL_RESPONSE_RAD = 0.2f;
+
     CalibrationSequence();
 
     // Start the next calibration step - returns the magnet ID to fire
     // Returns -1 if calibration is complete
     int startCalibration();
 
-    // Call this after dashboard sends joystick input to confirm magnet direction
-    void completeCalibrationStep(float joy_x, float joy_y, const Quaternion &q);
+    // Fire the current step's magnet once (blocks for about PULSE_SECONDS).
+    // Runs the current loop itself, so the control task must not be running.
+    void pulseMagnet();
+
+    // Call this after dashboard sends joystick input to confirm magnet direction.
+    // Uses the orientation captured when the magnet was last fired.
+    void completeCalibrationStep(float joy_x, float joy_y);
 
-    // Check if all calibration steps are done
+    // Automatic alternative to pulseMagnet + completeCalibrationStep: fires
+    // the current magnet once and completes the step from the ball's measured
+    // rotation. Returns false if the ball did not respond; the step still
+    // counts, so too few responses fail the whole calibration.
+    bool measureCalibrationStep();
+
+    // Check if all calibration steps are done and their fit was published
+    // (BallController::fitUsable)
     bool isCalibrated() const;
 
+    // Fit over all steps (valid once isCalibrated())
+    const YawFit &getFit() const { return fit; }
+
     // Get current step number for progress reporting
     int getCurrentStep() const { return num_calibration_steps; }
     int getMaxSteps() const { return MAX_CALIBRATION_STEPS; }
@@ -0,0 +1,129 @@
+#include "calibration_store.h"
+#include "../control/BallController.h"
+#include "../core/global_state.h"
+#include "../hal/hal.h"
+#include "../mag_selection_control/control_algorithm.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *STORE_TAG = "CALIB_STORE";
+static const char *STORE_NAMESPACE = "calib";
+static const char *STORE_KEY = "calibration";
+static const uint32_t STORE_MAGIC = 0x4342414C; // "CBAL"
+
+struct CalibrationBlob
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(StoredCalibration) when written
+    uint32_t crc;  // CRC32 of payload
+    StoredCalibration payload;
+};
+
+static uint32_t payloadCrc(const StoredCalibration &value)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&value), sizeof(value));
+}
+
+bool loadStoredCalibration(StoredCalibration &out)
+{
+    CalibrationBlob blob;
+    if (!hal::storageLoad(STORE_NAMESPACE, STORE_KEY, &blob, sizeof(blob)))
+        return false;
+
+    if (blob.magic != STORE_MAGIC || blob.version != StoredCalibration::VERSION ||
+        blob.size != sizeof(StoredCalibration))
+    {
+        ESP_LOGW(STORE_TAG, "Ignoring stored calibration with another format (version %u)", (unsigned)blob.version);
+        return false;
+    }
+    if (blob.crc != payloadCrc(blob.payload))
+    {
+        ESP_LOGW(STORE_TAG, "Ignoring stored calibration with a bad checksum");
+        return false;
+    }
+    if (blob.payload.geometry_id != magnet_geometry::GEOMETRY_ID)
+    {
+        ESP_LOGW(STORE_TAG, "Ignoring stored calibration made for other magnet geometry");
+        return false;
+    }
+    const uint8_t report_id = hal::imuOrientationReportId();
+    if (blob.payload.imu_report_id != report_id)
+    {
+        ESP_LOGW(STORE_TAG, "Ignoring stored calibration made with IMU report 0x%02x (now 0x%02x)",
+                 (unsigned)blob.payload.imu_report_id, (unsigned)report_id);
+        return false;
+    }
+    if (report_id == hal::IMU_GAME_ROTATION_VECTOR)
+    {
+        ESP_LOGW(STORE_TAG, "Ignoring stored calibration: the game rotation vector's heading resets on every boot");
+        return false;
+    }
+
+    out = blob.payload;
+    return true;
+}
+
+bool saveStoredCalibration(const StoredCalibration &value)
+{
+    CalibrationBlob blob;
+    blob.magic = STORE_MAGIC;
+    blob.version = StoredCalibration::VERSION;
+    blob.size = sizeof(StoredCalibration);
+    blob.payload = value;
+    blob.crc = payloadCrc(blob.payload);
+
+    if (!hal::storageSave(STORE_NAMESPACE, STORE_KEY, &blob, sizeof(blob)))
+    {
+        ESP_LOGE(STORE_TAG, "Saving calibration failed");
+        return false;
+    }
+    return true;
+}
+
+void eraseStoredCalibration()
+{
+    hal::storageErase(STORE_NAMESPACE, STORE_KEY);
+}
+
+StoredCalibration captureCalibration()
+{
+    const ControllerCalibration &cal = getControllerInstance().getCalibration();
+    GlobalState &state = GlobalState::instance();
+
+    StoredCalibration value;
+    value.geometry_id = magnet_geometry::GEOMETRY_ID;
+    value.imu_report_id = hal::imuOrientationReportId();
+    value.yaw_offset = cal.yaw_offset;
+    value.yaw_residual = cal.yaw_residual;
+    value.default_kp = MagnetInfo::DEFAULT_KP;
+    value.default_ki = MagnetInfo::DEFAULT_KI;
+    for (int i = 0; i < magnet_geometry::MAGNET_COUNT; i++)
+    {
+        value.coil_gain[i] = cal.coil_gain[i];
+        // Solver indices are 0-based, GlobalState magnet IDs 1-based
+        state.getCurrentLoopGains(i + 1, value.current_kp[i], value.current_ki[i]);
+        state.getCurrentSense(i + 1, value.adc_offset[i], value.adc_gain[i]);
+    }
+    return value;
+}
+
+void applyStoredCalibration(const StoredCalibration &value)
+{
+    BallController &controller = getControllerInstance();
+    ControllerCalibration cal = controller.getCalibration();
+    cal.is_calibrated = true;
+    cal.yaw_offset = value.yaw_offset;
+    cal.yaw_residual = value.yaw_residual;
+
+    GlobalState &state = GlobalState::instance();
+    for (int i = 0; i < magnet_geometry::MAGNET_COUNT; i++)
+    {
+        cal.coil_gain[i] = value.coil_gain[i];
+        float kp = value.current_kp[i] == value.default_kp ? MagnetInfo::DEFAULT_KP : value.current_kp[i];
+        float ki = value.current_ki[i] == value.default_ki ? MagnetInfo::DEFAULT_KI : value.current_ki[i];
+        state.setCurrentLoopGains(i + 1, kp, ki);
+        state.setCurrentSense(i + 1, value.adc_offset[i], value.adc_gain[i]);
+    }
+    controller.publishCalibration(cal);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "../control/magnet_geometry.h"
+
+// Calibration and tuning kept in NVS so a reboot can skip the calibration
+// round trip with the dashboard.
+//
+// Stored as one blob in the "calib" namespace, behind a header holding a
+// magic number, the format version, the payload size and a CRC32 of the
+// payload. A blob with another version, size, CRC, geometry or IMU orientation
+// report is ignored and the board boots into STANDBY as if nothing was stored.
+// Bump VERSION whenever the payload layout changes.
+struct StoredCalibration
+{
+    static constexpr uint32_t VERSION = 5;
+
+    // magnet_geometry::GEOMETRY_ID when saved; the calibration is only valid
+    // for the magnet geometry and coil gains it was made with
+    uint32_t geometry_id = 0;
+
+    // hal::imuOrientationReportId() when saved. The yaw offset is measured
+    // against the IMU's heading, which only survives a reboot with the
+    // magnetometer-referenced rotation vector; with the game rotation vector
+    // it restarts from wherever the sensor powered up.
+    uint32_t imu_report_id = 0;
+
+    float yaw_offset = 0.0f;   // rad, see ControllerCalibration
+    float yaw_residual = 0.0f; // rad
+    float coil_gain[magnet_geometry::MAGNET_COUNT];
+
+    // Current loop PI gains, by magnet index, and the compiled-in defaults
+    // (MagnetInfo::DEFAULT_KP/KI) when saved. A gain still equal to the
+    // default it was saved with was never tuned, so applying it takes the
+    // running firmware's default instead: changing the defaults reaches
+    // boards with a stored calibration, while tuned gains are kept.
+    float current_kp[magnet_geometry::MAGNET_COUNT];
+    float current_ki[magnet_geometry::MAGNET_COUNT];
+    float default_kp = 0.0f;
+    float default_ki = 0.0f;
+
+    // Current sense correction, by magnet index (see MagnetInfo::setCurrentSense).
+    // Boot re-measures the offsets with auto-zero, so the stored ones are only
+    // the fallback for channels it rejects. The gains come from
+    // checkCurrentSense (utils/utils.h) and are 1.0 until it has been run.
+    float adc_offset[magnet_geometry::MAGNET_COUNT];
+    float adc_gain[magnet_geometry::MAGNET_COUNT];
+};
+
+// Reads the stored calibration. Returns false if there is none or it is
+// unusable (other version, bad size or CRC, other geometry, or a yaw offset
+// that does not carry over to this boot's IMU heading).
+bool loadStoredCalibration(StoredCalibration &out);
+
+// Writes the calibration and commits it. Returns false on a storage error.
+bool saveStoredCalibration(const StoredCalibration &value);
+
+// Removes the stored calibration so the next boot calibrates again
+void eraseStoredCalibration();
+
+// The live calibration: the controller's snapshot plus the current loop gains
+// and current sense correction
+StoredCalibration captureCalibration();
+
+// Publishes a stored calibration to the controller and the current loops.
+// Call only while the control task is stopped.
+void applyStoredCalibration(const StoredCalibration &value);
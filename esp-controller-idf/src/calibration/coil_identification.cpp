@@ -0,0 +1,29 @@
+#include "coil_identification.h"
+#include "calibration.h"
+#include "../control/magnet_geometry.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <cstdio>
+
+void runCoilIdentification(int rounds)
+{
+    printf("Coil identification: %d rounds of %d coils at %.1f A for %.0f ms\n",
+           rounds, magnet_geometry::MAGNET_COUNT, IDENT_PULSE_CURRENT, IDENT_PULSE_SECONDS * 1000.0f);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int index = 0; index < magnet_geometry::MAGNET_COUNT; index++)
+        {
+            PulseResponse r = measurePulseResponse(index, IDENT_PULSE_CURRENT, IDENT_PULSE_SECONDS);
+            printf("IDENT,%d,%d,%.2f,%.4f,%.5f,%.5f,%.5f,%.5f,%.5f,%.5f,%.5f\n",
+                   round, index + 1, IDENT_PULSE_CURRENT, r.seconds,
+                   r.q_start.w, r.q_start.x, r.q_start.y, r.q_start.z,
+                   r.rotation.x, r.rotation.y, r.rotation.z);
+
+            // Let the ball settle so the next pulse starts from rest
+            vTaskDelay(pdMS_TO_TICKS((int)(IDENT_SETTLE_SECONDS * 1000.0f)));
+        }
+    }
+
+    printf("Coil identification done\n");
+}
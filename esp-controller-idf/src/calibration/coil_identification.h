@@ -0,0 +1,22 @@
+#pragma once
+
+// Coil identification: fires every coil in turn, for a few rounds, and
+// prints the ball's response to each pulse on the console. Only coils in the
+// lower hemisphere pull, so repeat the run with the ball turned by hand in
+// between until every coil has been seen at several orientations.
+//
+// tools/fit_magnet_geometry.py reads the captured log and fits each coil's
+// effective direction and torque gain. One line per pulse:
+//
+//   IDENT,<round>,<magnet id>,<current A>,<seconds>,<qw>,<qx>,<qy>,<qz>,<rx>,<ry>,<rz>
+//
+// q is the orientation at the start of the pulse, r the world-frame rotation
+// over it (rad). Runs the current loop itself, so the control task must not
+// be running.
+
+constexpr int IDENT_ROUNDS = 2;
+constexpr float IDENT_PULSE_CURRENT = 4.0f; // A
+constexpr float IDENT_PULSE_SECONDS = 0.12f;
+constexpr float IDENT_SETTLE_SECONDS = 0.3f; // Between pulses
+
+void runCoilIdentification(int rounds = IDENT_ROUNDS);
@@ -0,0 +1,15 @@
+#pragma once
+
+// WiFi access point and dashboard link settings, shared by the WiFi setup in
+// core/peripherals.cpp and the UDP tasks in wifi_client.cpp
+
+#define EXAMPLE_ESP_WIFI_SSID      "ESP32_Data_Link"
+#define EXAMPLE_ESP_WIFI_PASS      "password123"
+#define PORT                        5005
+#define TRACE_PORT                  5007 // Recorded traces (hal/trace.h) are sent here
+#define PROFILE_PORT                5008 // Profiling zone dumps (utils/profile.h) are sent here
+
+// Where telemetry is sent. The host build points it at the local machine.
+#ifndef RECV_IP_ADDR
+#define RECV_IP_ADDR               "192.168.4.2"
+#endif
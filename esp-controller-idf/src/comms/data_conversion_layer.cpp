@@ -14,7 +14,7 @@ void extract_data_from_globals(ball_data_packet* out_packet) {
     std::memset(out_packet, 0, sizeof(*out_packet));
     out_packet->timestamp = static_cast<int32_t>(
         std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()
+            hal::Clock::now().time_since_epoch()
         ).count()
     );
 
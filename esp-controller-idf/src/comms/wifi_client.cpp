@@ -1,26 +1,24 @@
 #include <string.h>
-#include "esp_wifi.h"
-#include "esp_event.h"
-#include "nvs_flash.h"
 #include "lwip/sockets.h"
-#include "core/peripherals.h"
+#include "comms/comms_config.h"
 #include "core/global_state.h"
+#include "mag_selection_control/control_algorithm.h"
 #include "comms/data_conversion_layer.h"
+#include "comms/wifi_client.h"
+#include "core/trace_session.h"
+#include "hal/trace.h"
+#include "utils/profile.h"
 #include "utils/utils.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #define COMMAND_PORT 5006
 
-// Command packet structure from dashboard to ESP32
-typedef struct __attribute__((packed))
-{
-    uint8_t command_type;     // 0=set_direction, 1=calibrate, 2=emergency_stop, 3=start_running
-    float ideal_direction_x;  // X component of desired direction
-    float ideal_direction_y;  // Y component of desired direction
-    float ideal_direction_z;  // Z component of desired direction
-    uint32_t sequence_number; // For acknowledgment tracking
-} DashboardCommand;
+// Trace control command (type 6)
+#define TRACE_COMMAND 6
+
+// Profiling zone dump command (type 7)
+#define PROFILE_COMMAND 7
 
 void udp_sender_task(void *pvParameters)
 {
@@ -35,12 +33,92 @@ void udp_sender_task(void *pvParameters)
 
     while (1)
     {
-        extract_data_from_globals(&out_data);
-        sendto(sock, &out_data, sizeof(out_data), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+        {
+            PROFILE_ZONE("telemetry");
+            extract_data_from_globals(&out_data);
+            sendto(sock, &out_data, sizeof(out_data), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+        }
         vTaskDelay(pdMS_TO_TICKS(100)); // Send at 10Hz
     }
 }
 
+// ============================================================
+// TRACE DUMP (ESP32 -> dashboard)
+// ============================================================
+
+// Header of each trace chunk sent to TRACE_PORT; the payload follows
+typedef struct __attribute__((packed))
+{
+    uint32_t offset; // Byte offset of this chunk in the trace
+    uint32_t total;  // Size of the whole trace
+} TraceChunkHeader;
+
+#define TRACE_CHUNK_BYTES 1024
+
+// Sends the recorded trace to the dashboard host in numbered chunks
+static void send_trace()
+{
+    const uint8_t *data = trace::data();
+    size_t total = trace::size();
+    if (data == nullptr || total == 0)
+    {
+        serial_print("TRACE: nothing recorded\n");
+        return;
+    }
+
+    struct sockaddr_in dest_addr;
+    dest_addr.sin_addr.s_addr = inet_addr(RECV_IP_ADDR);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(TRACE_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        serial_print("ERROR: Failed to create trace socket\n");
+        return;
+    }
+
+    static uint8_t chunk[sizeof(TraceChunkHeader) + TRACE_CHUNK_BYTES];
+    for (size_t offset = 0; offset < total; offset += TRACE_CHUNK_BYTES)
+    {
+        size_t length = total - offset < TRACE_CHUNK_BYTES ? total - offset : TRACE_CHUNK_BYTES;
+        TraceChunkHeader header = {static_cast<uint32_t>(offset), static_cast<uint32_t>(total)};
+        memcpy(chunk, &header, sizeof(header));
+        memcpy(chunk + sizeof(header), data + offset, length);
+        sendto(sock, chunk, sizeof(header) + length, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+        vTaskDelay(pdMS_TO_TICKS(2)); // Pace the chunks so the WiFi buffers keep up
+    }
+    closesocket(sock);
+    serial_printf("TRACE: sent %u bytes to port %d\n", (unsigned)total, TRACE_PORT);
+}
+
+// ============================================================
+// PROFILE DUMP (ESP32 -> UART and dashboard)
+// ============================================================
+
+// Prints the profiling zones (utils/profile.h) on the serial port and sends
+// the same text in one datagram to PROFILE_PORT
+static void send_profile()
+{
+    static char text[1536];
+    size_t length = profile::format(text, sizeof(text));
+    serial_print(text);
+
+    struct sockaddr_in dest_addr;
+    dest_addr.sin_addr.s_addr = inet_addr(RECV_IP_ADDR);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(PROFILE_PORT);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        serial_print("ERROR: Failed to create profile socket\n");
+        return;
+    }
+    sendto(sock, text, length, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    closesocket(sock);
+}
+
 // ============================================================
 // COMMAND RECEIVER (Dashboard -> ESP32)
 // ============================================================
@@ -76,10 +154,11 @@ void process_dashboard_command(const DashboardCommand *cmd)
     }
     break;
 
-    case 1: // Trigger calibration
+    case 1: // Trigger calibration: x != 0 for automatic (IMU response) calibration
     {
-        serial_print("RX: Calibrate command\n");
-        state.requestCalibration();
+        bool automatic = cmd->ideal_direction_x != 0.0f;
+        serial_printf("RX: Calibrate command (%s)\n", automatic ? "automatic" : "joystick");
+        state.requestCalibration(automatic);
     }
     break;
 
@@ -98,6 +177,78 @@ void process_dashboard_command(const DashboardCommand *cmd)
     }
     break;
 
+    case 4: // Outer loop: x = mode (0 direct, 1 PD, 2 velocity), y/z = gains (kp/kd or kv/ki)
+    {
+        OuterLoopParams params = getOuterLoopParams();
+        int mode = static_cast<int>(cmd->ideal_direction_x);
+        if (mode == 1)
+        {
+            params.mode = OuterLoopMode::PD;
+            params.kp = cmd->ideal_direction_y;
+            params.kd = cmd->ideal_direction_z;
+        }
+        else if (mode == 2)
+        {
+            params.mode = OuterLoopMode::VELOCITY;
+            params.kv = cmd->ideal_direction_y;
+            params.ki = cmd->ideal_direction_z;
+        }
+        else
+        {
+            params.mode = OuterLoopMode::DIRECT;
+        }
+        setOuterLoopParams(params);
+        serial_printf("RX: Outer loop mode %d (%.3f, %.3f)\n", mode, cmd->ideal_direction_y, cmd->ideal_direction_z);
+    }
+    break;
+
+    case 5: // Coil identification (runs from STANDBY or when calibrated and waiting for start)
+    {
+        serial_print("RX: Identify coils command\n");
+        state.requestIdentification();
+    }
+    break;
+
+    case TRACE_COMMAND: // Trace: x = 1 starts recording (y = buffer KB, z != 0 adds PWM outputs), x = 0 stops and sends it
+    {
+        if (cmd->ideal_direction_x != 0.0f)
+        {
+            size_t capacity = cmd->ideal_direction_y > 0.0f ? static_cast<size_t>(cmd->ideal_direction_y) * 1024 : TRACE_DEFAULT_CAPACITY;
+            bool outputs = cmd->ideal_direction_z != 0.0f;
+            serial_printf("RX: Start trace (%u KB%s)\n", (unsigned)(capacity / 1024), outputs ? ", with outputs" : "");
+            trace_start_recording(capacity, outputs);
+        }
+        else
+        {
+            serial_print("RX: Stop trace\n");
+            trace_stop_recording();
+            send_trace();
+        }
+    }
+    break;
+
+    case 8: // Current sense check: x = magnet id, y = PWM duty 0-255, z = meter reading in A (0 only measures)
+    {
+        GlobalState::CurrentSenseCheck request;
+        request.magnetId = static_cast<int>(cmd->ideal_direction_x);
+        request.duty = static_cast<int>(cmd->ideal_direction_y);
+        request.reference_amps = cmd->ideal_direction_z;
+        serial_printf("RX: Current sense check, magnet %d at duty %d (reference %.3f A)\n",
+                      request.magnetId, request.duty, request.reference_amps);
+        state.requestCurrentSenseCheck(request);
+    }
+    break;
+
+    case PROFILE_COMMAND: // Profiling zones: dump them; x != 0 also clears them afterwards
+    {
+        bool clear = cmd->ideal_direction_x != 0.0f;
+        serial_printf("RX: Dump profile%s\n", clear ? " and reset" : "");
+        send_profile();
+        if (clear)
+            profile::reset();
+    }
+    break;
+
     default:
         serial_printf("RX: Unknown command type %d\n", cmd->command_type);
         break;
@@ -151,6 +302,10 @@ void udp_receiver_task(void *pvParameters)
 
         if (len > 0)
         {
+            // Record it for replay, unless it only reads out diagnostics
+            if (cmd.command_type != TRACE_COMMAND && cmd.command_type != PROFILE_COMMAND)
+                trace::recordCommand(&cmd, static_cast<size_t>(len));
+
             // Process the command
             process_dashboard_command(&cmd);
         }
@@ -1,5 +1,21 @@
+#pragma once
 
+#include <stdint.h>
+
+// Command packet structure from dashboard to ESP32
+typedef struct __attribute__((packed))
+{
+    uint8_t command_type;     // 0=set_direction, 1=calibrate, 2=emergency_stop, 3=start_running, 4=set_outer_loop, 5=identify_coils, 6=trace, 7=profile, 8=current_sense_check
+    float ideal_direction_x;  // X component of desired direction
+    float ideal_direction_y;  // Y component of desired direction
+    float ideal_direction_z;  // Z component of desired direction
+    uint32_t sequence_number; // For acknowledgment tracking
+} DashboardCommand;
 
 void udp_sender_task(void *pvParameters);
 
-void udp_receiver_task(void *pvParameters);
\ No newline at end of file
+void udp_receiver_task(void *pvParameters);
+
+// Acts on one dashboard command, as if it had just arrived (also used by the
+// host trace replay)
+void process_dashboard_command(const DashboardCommand *cmd);
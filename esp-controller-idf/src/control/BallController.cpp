@@ -1,43 +1,24 @@
 #include "BallController.h"
-
-BallController::BallController()
+#include "allocation_table.h"
+#include "fast_math.h"
+
+// Magnet directions and the torque LUT are compile-time tables in flash
+// (magnet_geometry.h), so constructing a controller is free.
+using magnet_geometry::FORCE_LUT;
+using magnet_geometry::LUT_SIZE;
+using magnet_geometry::MIN_ANGLE_COS;
+using magnet_geometry::UNIT_MAGNETS;
+
+// Vector3::norm/normalized, but with control_math (libm or fast_math, see fast_math.h)
+static inline float length(const Vector3 &v)
 {
-    initMagnets();
-    initLUT();
+    return control_math::sqrt(v.dot(v));
 }
 
-void BallController::initLUT()
+static inline Vector3 unitVector(const Vector3 &v)
 {
-    float max_angle = 1.570796f; // pi/2
-
-    for (int i = 0; i < LUT_SIZE; i++)
-    {
-        float angle = ((float)i / (LUT_SIZE - 1)) * max_angle;
-
-        if (angle < 0.1f)
-        {
-            torque_lut[i] = 0.0f;
-        }
-        else
-        {
-            float num = 60.0f * sinf(angle);
-            float den = 0.01f + 1.0f - cosf(angle);
-            float val = (num / den) * expf(-2.5f * angle);
-            float val_per_amp = val / 8.0f;
-            torque_lut[i] = (val_per_amp > 0.0f) ? val_per_amp : 0.0f;
-        }
-    }
-}
-
-void BallController::initMagnets()
-{
-    GlobalState &state = GlobalState::instance();
-    for (int i = 0; i < 20; i++)
-    {
-        // Keep unit-length vectors for solver stability while sourcing geometry
-        // from the global magnet configuration.
-        magnets[i] = state.getMagnetPosition(i + 1).normalized();
-    }
+    float n = length(v);
+    return (n > 0.0001f) ? (v / n) : Vector3(0, 0, 0);
 }
 
 Matrix3 BallController::quatToMatrix(const Quaternion &q)
@@ -67,85 +48,252 @@ Matrix3 BallController::quatToMatrix(const Quaternion &q)
     return mat;
 }
 
-float BallController::getTorqueFactor(float angle_rad)
+float BallController::getForceScale(float cos_angle)
 {
-    float max_angle = 1.570796f; // pi/2
-
-    if (angle_rad >= max_angle)
+    // Outside (MIN_ANGLE, pi/2) the magnet produces no useful torque
+    if (cos_angle <= 0.0f)
         return 0.0f;
-    if (angle_rad < 0.1f)
+    if (cos_angle > MIN_ANGLE_COS)
         return 0.0f;
 
-    // 1. Map the angle to a floating-point index (0 to 127)
-    float index_float = (angle_rad / max_angle) * (LUT_SIZE - 1);
+    // 1. Map cos(angle) to a floating-point index (0 to LUT_SIZE - 1)
+    float index_float = cos_angle * (LUT_SIZE - 1);
 
     // 2. Get the integer index below the target
     int idx = (int)index_float;
 
     // Safety bound
     if (idx >= LUT_SIZE - 1)
-        return torque_lut[LUT_SIZE - 1];
+        return FORCE_LUT[LUT_SIZE - 1];
 
     // 3. Linear Interpolation (mix the two closest array values)
     float fraction = index_float - idx;
-    float val1 = torque_lut[idx];
-    float val2 = torque_lut[idx + 1];
+    float val1 = FORCE_LUT[idx];
+    float val2 = FORCE_LUT[idx + 1];
 
     return val1 * (1.0f - fraction) + val2 * fraction;
 }
 
+float BallController::getTorqueFactor(float cos_angle)
+{
+    // Force scale times the projection length sin(angle)
+    float sin_sq = 1.0f - cos_angle * cos_angle;
+    if (sin_sq <= 0.0f)
+        return 0.0f;
+    return getForceScale(cos_angle) * control_math::sqrt(sin_sq);
+}
+
 // ---------------------------------------------------------
 // SOLVER CORE
 // ---------------------------------------------------------
 
-struct Candidate
-{
-    int id;
-    Vector3 vec;
-};
-
-int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetCommand output[2])
+bool BallController::prepareTarget(float joy_x, float joy_y, const Quaternion &q, const ControllerCalibration &cal, Vector3 &target_force_body, Vector3 &gravity_ball)
 {
     // 1. Apply Yaw Offset to Joystick Input
-    float target_mag = sqrtf(joy_x * joy_x + joy_y * joy_y);
-    if (target_mag < 0.001f)
-        return 0; // Deadzone
+    if (joy_x * joy_x + joy_y * joy_y < 0.001f * 0.001f)
+        return false; // Deadzone
 
-    float theta_joy = atan2f(joy_y, joy_x);
-    float theta_imu = theta_joy + yaw_offset; // Apply calibration
-
-    Vector3 desired_force_world(cosf(theta_imu) * target_mag, sinf(theta_imu) * target_mag, 0.0f);
+    // Rotating the joystick vector by yaw_offset keeps its length, so no
+    // atan2/cos/sin is needed per tick (the snapshot holds cos/sin of the offset)
+    Vector3 desired_force_world(cal.yaw_cos * joy_x - cal.yaw_sin * joy_y,
+                                cal.yaw_sin * joy_x + cal.yaw_cos * joy_y,
+                                0.0f);
 
     // 2. Coordinate Transforms
     Matrix3 R = quatToMatrix(q);
-    Vector3 target_force_body = R.multiplyTranspose(desired_force_world);
-    Vector3 gravity_ball = R.multiplyTranspose(Vector3(0, 0, -1.0f));
+    target_force_body = R.multiplyTranspose(desired_force_world);
+    gravity_ball = R.multiplyTranspose(Vector3(0, 0, -1.0f));
+    return true;
+}
 
-    // 3. Find Candidates
-    Candidate candidates[20];
+bool BallController::magnetForce(int id, const Vector3 &gravity_ball, const ControllerCalibration &cal, Vector3 &force_vec)
+{
+    // UNIT_MAGNETS[] and gravity_ball are unit vectors, so dot_g is cos(angle)
+    // and the tangential projection has length sin(angle). The LUT already
+    // divides by sin(angle), so no acos, sqrt or normalisation is needed.
+    float dot_g = UNIT_MAGNETS[id].dot(gravity_ball);
+
+    float scale = getForceScale(dot_g) * cal.coil_gain[id];
+    if (scale <= 0.00001f)
+        return false;
+
+    Vector3 proj_component = UNIT_MAGNETS[id] - (gravity_ball * dot_g);
+    force_vec = proj_component * scale;
+    return true;
+}
+
+int BallController::findCandidates(const Vector3 &gravity_ball, const ControllerCalibration &cal, Candidate candidates[20])
+{
     int num_candidates = 0;
 
     for (int i = 0; i < 20; i++)
     {
-        float dot_g = magnets[i].dot(gravity_ball);
-        float dot_clamp = fmaxf(-1.0f, fminf(1.0f, dot_g));
-        float angle = acosf(dot_clamp);
-
-        float strength = getTorqueFactor(angle);
-        if (strength <= 0.00001f)
+        if (!magnetForce(i, gravity_ball, cal, candidates[num_candidates].vec))
             continue;
 
-        Vector3 proj_component = magnets[i] - (gravity_ball * dot_g);
-        if (proj_component.norm() < 0.01f)
-            continue;
+        candidates[num_candidates].id = i;
+        num_candidates++;
+    }
+    return num_candidates;
+}
 
-        Vector3 force_dir = proj_component.normalized();
-        Vector3 force_vec = force_dir * strength;
+int BallController::gravityCell(const Vector3 &gravity_ball)
+{
+    // Octahedral map: project onto |x|+|y|+|z| = 1 and fold the lower half
+    // outwards, giving a square that covers the whole sphere.
+    float s = fabsf(gravity_ball.x) + fabsf(gravity_ball.y) + fabsf(gravity_ball.z);
+    float x = gravity_ball.x / s;
+    float y = gravity_ball.y / s;
+    if (gravity_ball.z < 0.0f)
+    {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    const int grid = allocation_table::GRID;
+    int col = (int)((x * 0.5f + 0.5f) * grid);
+    int row = (int)((y * 0.5f + 0.5f) * grid);
+    if (col < 0)
+        col = 0;
+    if (col > grid - 1)
+        col = grid - 1;
+    if (row < 0)
+        row = 0;
+    if (row > grid - 1)
+        row = grid - 1;
+    return row * grid + col;
+}
+
+int BallController::findCandidatesTable(const Vector3 &gravity_ball, const ControllerCalibration &cal, Candidate candidates[20])
+{
+    uint32_t mask = allocation_table::CELL_MASKS[gravityCell(gravity_ball)];
+    int num_candidates = 0;
+
+    // Ascending id order, like findCandidates, so ties resolve the same way
+    for (int i = 0; mask != 0; i++, mask >>= 1)
+    {
+        if (!(mask & 1u) || !magnetForce(i, gravity_ball, cal, candidates[num_candidates].vec))
+            continue;
 
         candidates[num_candidates].id = i;
-        candidates[num_candidates].vec = force_vec;
         num_candidates++;
     }
+    return num_candidates;
+}
+
+bool BallController::cacheCovers(float joy_x, float joy_y, const Quaternion &q, const ControllerCalibration &cal) const
+{
+    // A new calibration snapshot changes every force vector
+    if (!cache_valid || cache_calibration_version != cal.version)
+        return false;
+
+    // |q . q_cache| = cos(half the rotation between them)
+    float dot = q.w * cache_q.w + q.x * cache_q.x + q.y * cache_q.y + q.z * cache_q.z;
+    if (fabsf(dot) < cache_rotation_cos)
+        return false;
+
+    float dx = joy_x - cache_joy_x;
+    float dy = joy_y - cache_joy_y;
+    return (dx * dx + dy * dy) <= cache_joy_delta * cache_joy_delta;
+}
+
+// Recomputes the currents of a fixed single/pair assignment for a new target,
+// scoring it exactly like the full search. Returns false if the assignment can
+// no longer produce the target with non-negative currents.
+bool BallController::refitAssignment(const Vector3 &target_force_body, const Vector3 &gravity_ball, const ControllerCalibration &cal, const MagnetCommand assignment[2], int count, MagnetCommand output[2], float &score)
+{
+    Vector3 a;
+    if (count < 1 || !magnetForce(assignment[0].id, gravity_ball, cal, a))
+        return false;
+
+    if (count == 1)
+    {
+        float projection = a.dot(target_force_body);
+        if (projection <= 0)
+            return false;
+
+        float current = projection / a.dot(a);
+        if (current > max_current)
+            current = max_current;
+
+        score = length(target_force_body - a * current) + (current_penalty * current);
+        output[0].id = assignment[0].id;
+        output[0].current = current;
+        return true;
+    }
+
+    Vector3 b;
+    if (!magnetForce(assignment[1].id, gravity_ball, cal, b))
+        return false;
+
+    float t_len = length(target_force_body);
+    if (t_len <= 0.001f)
+        return false;
+
+    // Same (t_hat, y_hat) plane solve as the pair search
+    Vector3 t_hat = target_force_body / t_len;
+    Vector3 ref = (fabsf(t_hat.z) < 0.9f) ? Vector3(0, 0, 1) : Vector3(0, 1, 0);
+    Vector3 y_hat = unitVector(ref.cross(t_hat));
+
+    float Ax = a.dot(t_hat);
+    float Ay = a.dot(y_hat);
+    float Bx = b.dot(t_hat);
+    float By = b.dot(y_hat);
+
+    float det = (Ax * By) - (Ay * Bx);
+    if (fabsf(det) < 0.0001f)
+        return false;
+
+    float Ia = (t_len * By) / det;
+    float Ib = -(t_len * Ay) / det;
+    if (Ia < 0 || Ib < 0)
+        return false;
+    if (Ia > max_current)
+        Ia = max_current;
+    if (Ib > max_current)
+        Ib = max_current;
+
+    score = length(target_force_body - (a * Ia) - (b * Ib)) + (current_penalty * (Ia + Ib));
+    output[0].id = assignment[0].id;
+    output[0].current = Ia;
+    output[1].id = assignment[1].id;
+    output[1].current = Ib;
+    return true;
+}
+
+int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetCommand output[2])
+{
+    // One calibration snapshot for the whole solve
+    const ControllerCalibration &cal = getCalibration();
+
+    // 1-2. Joystick to body-frame target
+    Vector3 target_force_body;
+    Vector3 gravity_ball;
+    if (!prepareTarget(joy_x, joy_y, q, cal, target_force_body, gravity_ball))
+    {
+        cache_valid = false;
+        return 0;
+    }
+
+    // Incremental mode: close to the last full search, only refit its result
+    if (incremental)
+    {
+        float score;
+        if (cacheCovers(joy_x, joy_y, q, cal) &&
+            refitAssignment(target_force_body, gravity_ball, cal, cache_assignment, cache_count, output, score))
+        {
+            cache_hits++;
+            return cache_count;
+        }
+        cache_misses++;
+    }
+
+    // 3. Find Candidates (optionally only the table's shortlist for this gravity cell)
+    Candidate candidates[20];
+    int num_candidates = use_table ? findCandidatesTable(gravity_ball, cal, candidates)
+                                   : findCandidates(gravity_ball, cal, candidates);
 
     // 4. Optimization Search
     float min_score = 1e9f; // Infinity
@@ -164,7 +312,7 @@ int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetC
             current = max_current;
 
         Vector3 produced = candidates[i].vec * current;
-        float error_dist = (target_force_body - produced).norm();
+        float error_dist = length(target_force_body - produced);
         float score = error_dist + (current_penalty * current);
 
         if (score < min_score)
@@ -177,21 +325,41 @@ int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetC
     }
 
     // B. Pairs
-    float t_len = target_force_body.norm();
+    float t_len = length(target_force_body);
     if (t_len > 0.001f)
     {
         Vector3 t_hat = target_force_body / t_len;
         Vector3 ref = (fabsf(t_hat.z) < 0.9f) ? Vector3(0, 0, 1) : Vector3(0, 1, 0);
-        Vector3 y_hat = ref.cross(t_hat).normalized();
+        Vector3 y_hat = unitVector(ref.cross(t_hat));
+
+        // Project every candidate into the (t_hat, y_hat) plane once
+        float cand_x[20];
+        float cand_y[20];
+        for (int i = 0; i < num_candidates; i++)
+        {
+            cand_x[i] = candidates[i].vec.dot(t_hat);
+            cand_y[i] = candidates[i].vec.dot(y_hat);
+        }
 
+        // Pairs are still visited in (i, j) order so ties resolve exactly as
+        // in the exhaustive search; pruning only skips pairs that provably
+        // cannot become the new best.
         for (int i = 0; i < num_candidates; i++)
         {
+            float Ax = cand_x[i];
+            float Ay = cand_y[i];
+
             for (int j = i + 1; j < num_candidates; j++)
             {
-                float Ax = candidates[i].vec.dot(t_hat);
-                float Ay = candidates[i].vec.dot(y_hat);
-                float Bx = candidates[j].vec.dot(t_hat);
-                float By = candidates[j].vec.dot(y_hat);
+                float Bx = cand_x[j];
+                float By = cand_y[j];
+
+                // Both currents are non-negative only if the pair brackets the
+                // target, i.e. the two candidates lie on opposite sides of t_hat.
+                // Ia has the sign of By/det and Ib the sign of -Ay/det, so a
+                // same-side pair always needs one negative current.
+                if (prune_pairs && (Ay * By) > 0.0f)
+                    continue;
 
                 float det = (Ax * By) - (Ay * Bx);
                 if (fabsf(det) < 0.0001f)
@@ -207,8 +375,13 @@ int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetC
                     if (Ib > max_current)
                         Ib = max_current;
 
+                    // The error term is never negative, so the current penalty
+                    // alone bounds the score from below.
+                    if (prune_pairs && (current_penalty * (Ia + Ib)) >= min_score - 0.0001f)
+                        continue;
+
                     Vector3 produced = (candidates[i].vec * Ia) + (candidates[j].vec * Ib);
-                    float error_dist = (target_force_body - produced).norm();
+                    float error_dist = length(target_force_body - produced);
                     float score = error_dist + (current_penalty * (Ia + Ib));
 
                     if (score < min_score - 0.0001f)
@@ -225,61 +398,361 @@ int BallController::solve(float joy_x, float joy_y, const Quaternion &q, MagnetC
         }
     }
 
+    if (incremental)
+    {
+        // Hysteresis: keep the previous assignment unless the new one is
+        // clearly better, so near-equal pairs do not alternate every tick.
+        MagnetCommand previous[2];
+        float previous_score;
+        if (cache_valid && cache_calibration_version == cal.version && best_count > 0 &&
+            refitAssignment(target_force_body, gravity_ball, cal, cache_assignment, cache_count, previous, previous_score) &&
+            previous_score <= min_score * (1.0f + cache_hysteresis))
+        {
+            best_count = cache_count;
+            for (int k = 0; k < best_count; k++)
+                output[k] = previous[k];
+        }
+
+        cache_valid = best_count > 0;
+        cache_calibration_version = cal.version;
+        cache_q = q;
+        cache_joy_x = joy_x;
+        cache_joy_y = joy_y;
+        cache_count = best_count;
+        for (int k = 0; k < best_count; k++)
+            cache_assignment[k] = output[k];
+    }
+
     return best_count;
 }
 
+// ---------------------------------------------------------
+// K-MAGNET NNLS ALLOCATION
+// ---------------------------------------------------------
+
+// Minimises 0.5 * |sum(I_k * v_k) - target|^2 + mu * sum(I_k)
+// subject to 0 <= I_k <= max_coil_current, using coordinate descent. Each
+// coordinate update only touches the 3-vector residual, so a sweep over all
+// candidates is cheap.
+//
+// The total budget sum(I_k) <= max_current couples the coordinates, which
+// coordinate descent handles badly, so it is enforced through its Lagrange
+// multiplier instead: mu starts at nnls_penalty and is raised (bisection)
+// until the unconstrained-total solution fits the budget.
+int BallController::solveNNLS(float joy_x, float joy_y, const Quaternion &q, MagnetCommand output[MAX_ACTIVE_MAGNETS], int max_magnets)
+{
+    if (max_magnets > MAX_ACTIVE_MAGNETS)
+        max_magnets = MAX_ACTIVE_MAGNETS;
+
+    const ControllerCalibration &cal = getCalibration();
+    Vector3 target_force_body;
+    Vector3 gravity_ball;
+    if (!prepareTarget(joy_x, joy_y, q, cal, target_force_body, gravity_ball) || max_magnets <= 0)
+    {
+        for (int i = 0; i < 20; i++)
+            nnls_currents[i] = 0.0f;
+        return 0;
+    }
+
+    Candidate candidates[20];
+    int num_candidates = findCandidates(gravity_ball, cal, candidates);
+
+    // 1. Warm start from the previous tick's currents
+    float current[20];
+    float inv_len_sq[20];
+    bool active[20];
+    float max_pull = 0.0f; // largest v_k . target, the mu at which all currents reach zero
+    Vector3 residual = target_force_body * -1.0f; // A*I - t
+    for (int c = 0; c < num_candidates; c++)
+    {
+        float len_sq = candidates[c].vec.dot(candidates[c].vec);
+        inv_len_sq[c] = (len_sq > 1e-9f) ? 1.0f / len_sq : 0.0f;
+        current[c] = nnls_currents[candidates[c].id];
+        if (current[c] > max_coil_current)
+            current[c] = max_coil_current;
+        active[c] = true;
+        residual = residual + candidates[c].vec * current[c];
+
+        float pull = candidates[c].vec.dot(target_force_body);
+        if (pull > max_pull)
+            max_pull = pull;
+    }
+
+    // 2. Coordinate descent at a fixed mu until no current moves more than the tolerance
+    auto solveBox = [&](float mu) -> float
+    {
+        float sum = 0.0f;
+        for (int iter = 0; iter < nnls_max_sweeps; iter++)
+        {
+            float max_step = 0.0f;
+            for (int c = 0; c < num_candidates; c++)
+            {
+                if (!active[c])
+                    continue;
+
+                float grad = candidates[c].vec.dot(residual) + mu;
+                float updated = current[c] - grad * inv_len_sq[c];
+                if (updated > max_coil_current)
+                    updated = max_coil_current;
+                if (updated < 0.0f)
+                    updated = 0.0f;
+
+                float step = updated - current[c];
+                if (step != 0.0f)
+                {
+                    residual = residual + candidates[c].vec * step;
+                    current[c] = updated;
+                    float mag = fabsf(step);
+                    if (mag > max_step)
+                        max_step = mag;
+                }
+            }
+            if (max_step < nnls_tolerance)
+                break;
+        }
+        for (int c = 0; c < num_candidates; c++)
+            sum += current[c];
+        return sum;
+    };
+
+    // 3. Fit the total budget by raising mu (the sum is non-increasing in mu)
+    auto solveBudget = [&]() -> float
+    {
+        float mu = nnls_penalty;
+        float sum = solveBox(mu);
+        if (sum <= max_current)
+            return mu;
+
+        float lo = mu;
+        float hi = nnls_penalty + max_pull; // every current is zero at this mu
+        for (int step = 0; step < nnls_budget_steps; step++)
+        {
+            float mid = 0.5f * (lo + hi);
+            if (solveBox(mid) > max_current)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        solveBox(hi); // end on the feasible side
+        return hi;
+    };
+
+    float mu = solveBudget();
+
+    // 4. Enforce the magnet budget: drop the smallest currents and refit the rest
+    int support = 0;
+    for (int c = 0; c < num_candidates; c++)
+    {
+        if (current[c] > 0.0f)
+            support++;
+    }
+    if (support > max_magnets)
+    {
+        for (int drop = support - max_magnets; drop > 0; drop--)
+        {
+            int smallest = -1;
+            for (int c = 0; c < num_candidates; c++)
+            {
+                if (current[c] > 0.0f && (smallest < 0 || current[c] < current[smallest]))
+                    smallest = c;
+            }
+            residual = residual - candidates[smallest].vec * current[smallest];
+            current[smallest] = 0.0f;
+        }
+        for (int c = 0; c < num_candidates; c++)
+            active[c] = current[c] > 0.0f;
+
+        if (solveBox(mu) > max_current)
+            solveBudget();
+    }
+
+    // 5. Emit the result and remember it for the next warm start
+    for (int i = 0; i < 20; i++)
+        nnls_currents[i] = 0.0f;
+
+    int count = 0;
+    for (int c = 0; c < num_candidates; c++)
+    {
+        if (current[c] <= nnls_min_current)
+            continue;
+        nnls_currents[candidates[c].id] = current[c];
+        if (count < max_magnets)
+        {
+            output[count].id = candidates[c].id;
+            output[count].current = current[c];
+            count++;
+        }
+    }
+    return count;
+}
+
+float BallController::allocationError(float joy_x, float joy_y, const Quaternion &q, const MagnetCommand *commands, int count)
+{
+    const ControllerCalibration &cal = getCalibration();
+    Vector3 target_force_body;
+    Vector3 gravity_ball;
+    if (!prepareTarget(joy_x, joy_y, q, cal, target_force_body, gravity_ball))
+        return 0.0f;
+
+    Candidate candidates[20];
+    int num_candidates = findCandidates(gravity_ball, cal, candidates);
+
+    Vector3 residual = target_force_body * -1.0f;
+    for (int k = 0; k < count; k++)
+    {
+        for (int c = 0; c < num_candidates; c++)
+        {
+            if (candidates[c].id == commands[k].id)
+                residual = residual + candidates[c].vec * commands[k].current;
+        }
+    }
+    return length(residual) / length(target_force_body);
+}
+
 // ---------------------------------------------------------
 // CALIBRATION LOGIC
 // ---------------------------------------------------------
 
-int BallController::getCalibrationMagnet(const Quaternion &q)
+// Wraps an angle difference into (-pi, pi]
+static float wrapAngle(float angle)
 {
+    const float PI = 3.14159265f;
+    while (angle > PI)
+        angle -= 2.0f * PI;
+    while (angle <= -PI)
+        angle += 2.0f * PI;
+    return angle;
+}
+
+int BallController::getCalibrationMagnet(const Quaternion &q, const float *fired_angles, int num_fired)
+{
+    const ControllerCalibration &cal = getCalibration();
     Matrix3 R = quatToMatrix(q);
     Vector3 gravity_ball = R.multiplyTranspose(Vector3(0, 0, -1.0f));
 
-    int best_id = -1;
-    float max_strength = -1.0f;
+    float strength[20];
+    float max_strength = 0.0f;
+    for (int i = 0; i < 20; i++)
+    {
+        float dot_g = UNIT_MAGNETS[i].dot(gravity_ball);
+        strength[i] = getTorqueFactor(dot_g) * cal.coil_gain[i];
+        if (strength[i] > max_strength)
+            max_strength = strength[i];
+    }
 
+    // Widest separation from the directions already used, then strongest pull
+    int best_id = -1;
+    float best_separation = -1.0f;
     for (int i = 0; i < 20; i++)
     {
-        float dot_g = magnets[i].dot(gravity_ball);
-        float dot_clamp = fmaxf(-1.0f, fminf(1.0f, dot_g));
-        float angle = acosf(dot_clamp);
+        if (strength[i] <= 0.0f || strength[i] < 0.25f * max_strength)
+            continue;
+
+        float separation = 3.14159265f;
+        if (num_fired > 0)
+        {
+            float angle = calibrationForceAngle(i, q);
+            for (int k = 0; k < num_fired; k++)
+                separation = fminf(separation, fabsf(wrapAngle(angle - fired_angles[k])));
+        }
 
-        // Find the magnet that has the absolute highest pull strength
-        float strength = getTorqueFactor(angle);
-        if (strength > max_strength)
+        if (separation > best_separation + 0.01f ||
+            (separation > best_separation - 0.01f && strength[i] > strength[best_id]))
         {
-            max_strength = strength;
+            best_separation = separation;
             best_id = i;
         }
     }
     return best_id;
 }
 
-void BallController::finishCalibration(int fired_magnet_id, const Quaternion &q, float joy_x, float joy_y)
+float BallController::calibrationForceAngle(int id, const Quaternion &q)
 {
-    if (fired_magnet_id < 0 || fired_magnet_id >= 20)
-        return;
-
     Matrix3 R = quatToMatrix(q);
     Vector3 gravity_ball = R.multiplyTranspose(Vector3(0, 0, -1.0f));
 
-    // 1. Calculate the theoretical force vector of the fired magnet
-    float dot_g = magnets[fired_magnet_id].dot(gravity_ball);
-    Vector3 proj_component = magnets[fired_magnet_id] - (gravity_ball * dot_g);
-    Vector3 force_dir_body = proj_component.normalized();
+    // 1. Calculate the theoretical force vector of the magnet
+    float dot_g = UNIT_MAGNETS[id].dot(gravity_ball);
+    Vector3 proj_component = UNIT_MAGNETS[id] - (gravity_ball * dot_g);
+    Vector3 force_dir_body = unitVector(proj_component);
 
-    // Convert to IMU World Frame
+    // 2. Convert to IMU World Frame and take its heading
     Vector3 force_dir_world = R.multiply(force_dir_body);
+    return control_math::atan2(force_dir_world.y, force_dir_world.x);
+}
+
+CalibrationSample BallController::calibrationSample(int fired_magnet_id, const Quaternion &q, float joy_x, float joy_y)
+{
+    CalibrationSample sample;
+    if (fired_magnet_id < 0 || fired_magnet_id >= 20)
+        return sample; // weight 0: ignored by the fit
+
+    sample.theta_imu = calibrationForceAngle(fired_magnet_id, q);
+    sample.theta_joy = control_math::atan2(joy_y, joy_x);
+
+    // A barely deflected joystick says little about the direction
+    float deflection = control_math::sqrt(joy_x * joy_x + joy_y * joy_y);
+    sample.weight = deflection < 0.1f ? 0.0f : fminf(deflection, 1.0f);
+    return sample;
+}
+
+YawFit BallController::fitYawOffset(const CalibrationSample *samples, int count)
+{
+    YawFit fit;
+    float sum_w = 0.0f;
+    float sum_sin = 0.0f;
+    float sum_cos = 0.0f;
+    for (int k = 0; k < count; k++)
+    {
+        if (samples[k].weight <= 0.0f)
+            continue;
+        float s, c;
+        control_math::sincos(samples[k].theta_imu - samples[k].theta_joy, s, c);
+        sum_sin += samples[k].weight * s;
+        sum_cos += samples[k].weight * c;
+        sum_w += samples[k].weight;
+        fit.samples++;
+    }
+    if (fit.samples == 0)
+        return fit;
 
-    // 2. Determine IMU angle
-    float theta_imu = atan2f(force_dir_world.y, force_dir_world.x);
+    fit.yaw_offset = control_math::atan2(sum_sin, sum_cos);
+    fit.resultant = control_math::sqrt(sum_sin * sum_sin + sum_cos * sum_cos) / sum_w;
 
-    // 3. Determine User Joystick angle
-    float theta_joy = atan2f(joy_y, joy_x);
+    float sum_sq = 0.0f;
+    for (int k = 0; k < count; k++)
+    {
+        if (samples[k].weight <= 0.0f)
+            continue;
+        float error = wrapAngle(samples[k].theta_imu - samples[k].theta_joy - fit.yaw_offset);
+        sum_sq += samples[k].weight * error * error;
+    }
+    fit.residual_rms = control_math::sqrt(sum_sq / sum_w);
+    return fit;
+}
 
-    // 4. Store Offset
-    yaw_offset = theta_imu - theta_joy;
-    is_calibrated = true;
+YawFit BallController::finishCalibration(const CalibrationSample *samples, int count)
+{
+    YawFit fit = fitYawOffset(samples, count);
+    if (!fitUsable(fit))
+        return fit;
+
+    // Store Offset (the control task picks it up at its next solve)
+    ControllerCalibration next = getCalibration();
+    next.yaw_offset = fit.yaw_offset;
+    next.yaw_residual = fit.residual_rms;
+    next.is_calibrated = true;
+    publishCalibration(next);
+    return fit;
+}
+
+void BallController::publishCalibration(const ControllerCalibration &value)
+{
+    ControllerCalibration &slot = calibration_slots[next_calibration_slot];
+    slot = value;
+    slot.version = getCalibration().version + 1;
+    slot.yaw_cos = cosf(slot.yaw_offset);
+    slot.yaw_sin = sinf(slot.yaw_offset);
+    calibration.store(&slot, std::memory_order_release);
+    next_calibration_slot = (next_calibration_slot + 1) % CALIBRATION_SLOTS;
 }
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define BALL_CONTROLLER_H
 
 #include <math.h>
+#include <atomic>
+#include <stdint.h>
 #include "../core/global_state.h"
+#include "magnet_geometry.h"
 
 struct Quaternion
 {
@@ -38,40 +41,223 @@ struct MagnetCommand
     float current;
 };
 
+// Everything calibration feeds into the solver. A published snapshot is never
+// modified: calibration fills in a fresh copy and swaps the pointer (see
+// BallController::publishCalibration), so the control task reads it lock-free.
+struct ControllerCalibration
+{
+    uint32_t version = 0;     // Bumped on every publish
+    bool is_calibrated = false;
+    float yaw_offset = 0.0f;  // Joystick angle to IMU world angle (rad)
+    float yaw_cos = 1.0f;     // cos/sin of yaw_offset, filled in by publishCalibration
+    float yaw_sin = 0.0f;
+    float yaw_residual = 0.0f; // RMS residual of the fit that produced yaw_offset (rad)
+    float coil_gain[magnet_geometry::MAGNET_COUNT]; // Torque scale per coil (1 = nominal), by magnet index
+
+    // Coil gains start at the identified values (control/coil_gains.h)
+    ControllerCalibration()
+    {
+        for (int i = 0; i < magnet_geometry::MAGNET_COUNT; i++)
+            coil_gain[i] = coil_gains::GAIN[i];
+    }
+};
+
+// One calibration observation: where the model says the fired magnet pulls
+// (IMU world frame) and where the operator saw the ball go (joystick frame)
+struct CalibrationSample
+{
+    float theta_imu = 0.0f; // rad
+    float theta_joy = 0.0f; // rad
+    float weight = 0.0f;    // Confidence, 0..1 (joystick deflection)
+};
+
+// Result of fitting the yaw offset to several samples
+struct YawFit
+{
+    float yaw_offset = 0.0f;
+    float residual_rms = 0.0f; // Weighted RMS of the per-sample offset errors (rad)
+    float resultant = 0.0f;    // Mean resultant length, 1 = all samples agree
+    int samples = 0;
+};
+
 class BallController
 {
+public:
+    // Upper bound on coils the NNLS allocator may drive at once
+    static const int MAX_ACTIVE_MAGNETS = 4;
+
 private:
-    Vector3 magnets[20];
-    float max_current = 8.0f;
+    struct Candidate
+    {
+        int id;
+        Vector3 vec;
+    };
+
+    float max_current = ControlFrame::kMaxCurrent;
     float current_penalty = 2.0f;
 
-    // Calibration State
-    float yaw_offset = 0.0f;
-    bool is_calibrated = false;
+    // NNLS allocator: max_current is the total budget across all coils,
+    // max_coil_current the limit for any single coil.
+    float max_coil_current = 8.0f;
+    float nnls_penalty = 0.01f;       // Linear cost per amp (heat) in the NNLS objective
+    float nnls_tolerance = 0.0005f;   // Stop once no current moves more than this (A)
+    float nnls_min_current = 0.001f;  // Currents below this are reported as off
+    int nnls_max_sweeps = 8;
+    int nnls_budget_steps = 8;        // Bisection steps on mu when the total budget binds
+    float nnls_currents[20] = {0};    // Previous solution, by magnet index (warm start)
+
+    // Only score the magnets shortlisted for this gravity direction by the
+    // generated allocation table (control/allocation_table.h).
+    bool use_table = false;
+
+    // Skip magnet pairs that provably cannot beat the current best. Results are
+    // identical either way; turning it off gives the exhaustive reference search.
+    bool prune_pairs = true;
+
+    // Incremental mode: between ticks the ball and joystick barely move, so
+    // while both stay within these thresholds of the last full search, solve()
+    // only refits the previous assignment instead of searching again.
+    bool incremental = false;
+    float cache_rotation_rad = 0.03f;  // Max rotation since the last full search
+    float cache_rotation_cos = 0.99988750f; // cos(cache_rotation_rad / 2)
+    float cache_joy_delta = 0.05f;     // Max joystick change since the last full search
+    float cache_hysteresis = 0.05f;    // New assignment must beat the old score by this fraction
+    bool cache_valid = false;
+    Quaternion cache_q;
+    float cache_joy_x = 0.0f;
+    float cache_joy_y = 0.0f;
+    MagnetCommand cache_assignment[2];
+    int cache_count = 0;
+    std::atomic<uint32_t> cache_hits{0};
+    std::atomic<uint32_t> cache_misses{0};
+
+    uint32_t cache_calibration_version = 0; // Snapshot the cached assignment was found with
+
+    // Calibration snapshots. Readers load `calibration` once per solve and use
+    // that slot throughout; publishCalibration writes the next slot in the ring
+    // and then swaps the pointer. A slot is only rewritten after
+    // CALIBRATION_SLOTS - 1 further publishes, far longer than any solve holds
+    // on to it (calibration publishes at most a few times per second).
+    static const int CALIBRATION_SLOTS = 4;
+    ControllerCalibration calibration_slots[CALIBRATION_SLOTS];
+    int next_calibration_slot = 1; // Writer side only
+    std::atomic<const ControllerCalibration *> calibration{&calibration_slots[0]};
 
-    static const int LUT_SIZE = 128;
-    float torque_lut[LUT_SIZE];
-    void initLUT();
+    bool prepareTarget(float joy_x, float joy_y, const Quaternion &q, const ControllerCalibration &cal, Vector3 &target_force_body, Vector3 &gravity_ball);
+    int findCandidates(const Vector3 &gravity_ball, const ControllerCalibration &cal, Candidate candidates[20]);
+    bool magnetForce(int id, const Vector3 &gravity_ball, const ControllerCalibration &cal, Vector3 &force_vec);
+    int findCandidatesTable(const Vector3 &gravity_ball, const ControllerCalibration &cal, Candidate candidates[20]);
 
-    void initMagnets();
-    Matrix3 quatToMatrix(const Quaternion &q);
-    float getTorqueFactor(float angle_rad);
+    bool cacheCovers(float joy_x, float joy_y, const Quaternion &q, const ControllerCalibration &cal) const;
+    bool refitAssignment(const Vector3 &target_force_body, const Vector3 &gravity_ball, const ControllerCalibration &cal, const MagnetCommand assignment[2], int count, MagnetCommand output[2], float &score);
 
 public:
-    BallController();
+    BallController() = default;
+
+    // Geometry helpers (stateless; public for the host benchmarks)
+    static Matrix3 quatToMatrix(const Quaternion &q);
+    static float getForceScale(float cos_angle);
+    static float getTorqueFactor(float cos_angle);
 
     // 1. Regular Operation
     // Takes user joystick vector (x, y) and IMU quaternion. Returns number of active magnets.
     int solve(float joy_x, float joy_y, const Quaternion &q, MagnetCommand output[2]);
 
+    // Bounded non-negative least-squares allocation over up to max_magnets coils.
+    // Warm-starts from the previous call, so call it once per slow-loop tick.
+    int solveNNLS(float joy_x, float joy_y, const Quaternion &q, MagnetCommand output[MAX_ACTIVE_MAGNETS], int max_magnets = 3);
+    // Relative force error |sum(I_k * v_k) - target| / |target| of an allocation (for benchmarking)
+    float allocationError(float joy_x, float joy_y, const Quaternion &q, const MagnetCommand *commands, int count);
+    void setCoilCurrentLimit(float amps) { max_coil_current = amps; }
+    float getCoilCurrentLimit() const { return max_coil_current; }
+
     // 2. Calibration Phase Methods
-    // Step A: Find best magnet to fire, returns its ID.
-    int getCalibrationMagnet(const Quaternion &q);
+    // Step A: Find a magnet to fire, returns its ID. With no previous firings
+    // this is the strongest magnet; otherwise the one (among those with at
+    // least a quarter of the best strength) whose pull direction is furthest from the
+    // world-frame directions already used, so the samples are well separated.
+    int getCalibrationMagnet(const Quaternion &q, const float *fired_angles = nullptr, int num_fired = 0);
+
+    // IMU world-frame heading (rad) of the pull of magnet `id` at orientation q
+    float calibrationForceAngle(int id, const Quaternion &q);
 
     // Step B: Call this after user pushes joystick in response to the fired magnet
-    void finishCalibration(int fired_magnet_id, const Quaternion &q, float joy_x, float joy_y);
+    CalibrationSample calibrationSample(int fired_magnet_id, const Quaternion &q, float joy_x, float joy_y);
+
+    // Step C: Fit the yaw offset to all samples and, if fitUsable(), publish
+    // it as a new calibration snapshot. Returns the fit either way.
+    YawFit finishCalibration(const CalibrationSample *samples, int count);
+
+    // A fit is only published from at least MIN_CALIBRATION_SAMPLES usable
+    // samples that agree to MIN_CALIBRATION_RESULTANT (0.7 is about +-45 deg):
+    // a single sample always fits itself perfectly, so it proves nothing
+    static constexpr int MIN_CALIBRATION_SAMPLES = 2;
+    static constexpr float MIN_CALIBRATION_RESULTANT = 0.7f;
+    static bool fitUsable(const YawFit &fit)
+    {
+        return fit.samples >= MIN_CALIBRATION_SAMPLES && fit.resultant >= MIN_CALIBRATION_RESULTANT;
+    }
 
-    bool isCalibrated() const { return is_calibrated; }
+    // Weighted circular mean of (theta_imu - theta_joy): the least-squares fit
+    // of unit vectors on the circle, so it is immune to +-pi wrap-around
+    static YawFit fitYawOffset(const CalibrationSample *samples, int count);
+
+    // Current calibration snapshot; safe to call from any task. The reference
+    // stays valid for at least CALIBRATION_SLOTS - 1 publishes, so take it once
+    // per tick rather than holding on to it.
+    const ControllerCalibration &getCalibration() const { return *calibration.load(std::memory_order_acquire); }
+
+    // Replace the calibration with a copy of `value` (its version is assigned
+    // here). Single writer: only the calibration task may call this.
+    void publishCalibration(const ControllerCalibration &value);
+
+    bool isCalibrated() const { return getCalibration().is_calibrated; }
+    float getYawOffset() const { return getCalibration().yaw_offset; }
+
+    // Cost per amp in the pair search score: higher trades tracking for heat
+    void setCurrentPenalty(float value)
+    {
+        current_penalty = value;
+        invalidateCache();
+    }
+    float getCurrentPenalty() const { return current_penalty; }
+
+    void setPairPruning(bool enabled) { prune_pairs = enabled; }
+    bool getPairPruning() const { return prune_pairs; }
+
+    // Table-driven candidate shortlist in solve() (off by default)
+    void setTableLookup(bool enabled)
+    {
+        use_table = enabled;
+        invalidateCache();
+    }
+    bool getTableLookup() const { return use_table; }
+
+    // Octahedral cell of a unit gravity vector, matching tools/gen_allocation_table.py
+    static int gravityCell(const Vector3 &gravity_ball);
+
+    // Incremental solve() (off by default) and its cache statistics
+    void setIncremental(bool enabled)
+    {
+        incremental = enabled;
+        invalidateCache();
+    }
+    bool getIncremental() const { return incremental; }
+    void setCacheThresholds(float rotation_rad, float joy_delta, float hysteresis)
+    {
+        cache_rotation_rad = rotation_rad;
+        cache_rotation_cos = cosf(0.5f * rotation_rad);
+        cache_joy_delta = joy_delta;
+        cache_hysteresis = hysteresis;
+    }
+    void invalidateCache() { cache_valid = false; }
+    uint32_t getCacheHits() const { return cache_hits.load(); }
+    uint32_t getCacheMisses() const { return cache_misses.load(); }
+    void resetCacheStats()
+    {
+        cache_hits.store(0);
+        cache_misses.store(0);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "OrientationPredictor.h"
+#include "fast_math.h"
+
+Quaternion OrientationPredictor::integrate(const Quaternion &q, const AngularVelocity &angular_velocity, float dt)
+{
+    float wx = angular_velocity.x;
+    float wy = angular_velocity.y;
+    float wz = angular_velocity.z;
+
+    float rate = control_math::sqrt(wx * wx + wy * wy + wz * wz);
+    float half_angle = 0.5f * rate * dt;
+    if (half_angle < 1e-6f)
+        return q;
+
+    // Delta rotation as a unit quaternion about the gyro axis
+    float sin_half, dw;
+    control_math::sincos(half_angle, sin_half, dw);
+    float s = sin_half / rate;
+    float dx = wx * s;
+    float dy = wy * s;
+    float dz = wz * s;
+
+    // Gyro rates are in the sensor (body) frame, so the delta is applied on the right: q * dq
+    Quaternion out(
+        q.w * dw - q.x * dx - q.y * dy - q.z * dz,
+        q.w * dx + q.x * dw + q.y * dz - q.z * dy,
+        q.w * dy - q.x * dz + q.y * dw + q.z * dx,
+        q.w * dz + q.x * dy - q.y * dx + q.z * dw);
+
+    float n = control_math::sqrt(out.w * out.w + out.x * out.x + out.y * out.y + out.z * out.z);
+    if (n > 0.0001f)
+    {
+        out.w /= n;
+        out.x /= n;
+        out.y /= n;
+        out.z /= n;
+    }
+    return out;
+}
+
+Quaternion OrientationPredictor::predict(const Orientation &orientation, const AngularVelocity &angular_velocity, Clock::time_point now) const
+{
+    Quaternion q(orientation.w, orientation.x, orientation.y, orientation.z);
+    if (!enabled)
+        return q;
+
+    // 1. Age of the sample plus the time until the coils see the new setpoint
+    float age_s = std::chrono::duration<float>(now - orientation.timestamp).count();
+    float horizon = age_s + actuation_lead_s;
+
+    // 2. Clamp the horizon so a stale sample cannot run away
+    if (horizon < 0.0f)
+        horizon = 0.0f;
+    if (horizon > max_horizon_s)
+        horizon = max_horizon_s;
+
+    return integrate(q, angular_velocity, horizon);
+}
@@ -0,0 +1,50 @@
+#ifndef ORIENTATION_PREDICTOR_H
+#define ORIENTATION_PREDICTOR_H
+
+#include <chrono>
+#include "BallController.h"
+#include "../core/global_state.h"
+
+// Extrapolates the latest IMU orientation forward to the instant the coils
+// will actually be driven, using the latest gyro sample.
+//
+// The rotation vector is already several milliseconds old when computeControl
+// runs, and the setpoints it produces are held for a whole slow-loop tick.
+// Integrating the body-frame angular velocity over that gap lets the solver
+// pick magnets for where the ball will be instead of where it was.
+class OrientationPredictor
+{
+private:
+    bool enabled = true;
+
+    // Time from computeControl to the "centre" of the actuation window (s).
+    // By default half a slow-loop tick, since the setpoints are held that long.
+    float actuation_lead_s = 0.005f;
+
+    // Never extrapolate further than this (s). Protects against stale samples
+    // (e.g. the IMU dropping out) turning into wild predictions.
+    float max_horizon_s = 0.05f;
+
+public:
+    using Clock = hal::Clock;
+
+    OrientationPredictor() = default;
+
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+    void setActuationLead(float seconds) { actuation_lead_s = seconds; }
+    float getActuationLead() const { return actuation_lead_s; }
+
+    void setMaxHorizon(float seconds) { max_horizon_s = seconds; }
+    float getMaxHorizon() const { return max_horizon_s; }
+
+    // Predicts the orientation at `now + actuation_lead`. Falls back to the
+    // raw sample when prediction is disabled.
+    Quaternion predict(const Orientation &orientation, const AngularVelocity &angular_velocity, Clock::time_point now) const;
+
+    // Rotates q by a constant body-frame angular velocity (rad/s) for dt seconds.
+    static Quaternion integrate(const Quaternion &q, const AngularVelocity &angular_velocity, float dt);
+};
+
+#endif
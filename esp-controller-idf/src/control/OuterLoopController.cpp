@@ -0,0 +1,83 @@
+#include "OuterLoopController.h"
+#include "fast_math.h"
+
+void OuterLoopController::reset()
+{
+    integral_x = 0.0f;
+    integral_y = 0.0f;
+}
+
+void OuterLoopController::rollingRate(const Quaternion &q, const AngularVelocity &angular_velocity, float yaw_offset, float &rate_x, float &rate_y)
+{
+    // 1. Body-frame gyro rate to the IMU world frame (only x and y are needed)
+    float wx = angular_velocity.x;
+    float wy = angular_velocity.y;
+    float wz = angular_velocity.z;
+
+    float world_x = (1.0f - 2.0f * (q.y * q.y + q.z * q.z)) * wx + 2.0f * (q.x * q.y - q.w * q.z) * wy + 2.0f * (q.x * q.z + q.w * q.y) * wz;
+    float world_y = 2.0f * (q.x * q.y + q.w * q.z) * wx + (1.0f - 2.0f * (q.x * q.x + q.z * q.z)) * wy + 2.0f * (q.y * q.z - q.w * q.x) * wz;
+
+    // 2. Rolling on the floor moves the ball along omega x z = (wy, -wx)
+    float roll_x = world_y;
+    float roll_y = -world_x;
+
+    // 3. Into the joystick frame (solve() adds yaw_offset to joystick angles)
+    float c, s;
+    control_math::sincos(yaw_offset, s, c);
+    rate_x = c * roll_x + s * roll_y;
+    rate_y = -s * roll_x + c * roll_y;
+}
+
+void OuterLoopController::update(float joy_x, float joy_y, const Quaternion &q, const AngularVelocity &angular_velocity, float yaw_offset, float dt, float &out_x, float &out_y)
+{
+    OuterLoopParams latest;
+    if (pending.consume(latest))
+    {
+        if (latest.mode != params.mode)
+            reset();
+        params = latest;
+    }
+
+    if (params.mode == OuterLoopMode::DIRECT)
+    {
+        out_x = joy_x;
+        out_y = joy_y;
+        return;
+    }
+
+    float rate_x, rate_y;
+    rollingRate(q, angular_velocity, yaw_offset, rate_x, rate_y);
+
+    if (params.mode == OuterLoopMode::PD)
+    {
+        // Damping opposes the current rolling rate
+        out_x = params.kp * joy_x - params.kd * rate_x;
+        out_y = params.kp * joy_y - params.kd * rate_y;
+    }
+    else
+    {
+        // Velocity tracking: PI on the rolling rate error
+        float error_x = joy_x * params.max_rate - rate_x;
+        float error_y = joy_y * params.max_rate - rate_y;
+
+        integral_x += error_x * dt;
+        integral_y += error_y * dt;
+        float integral_len = control_math::sqrt(integral_x * integral_x + integral_y * integral_y);
+        if (integral_len > params.integral_limit)
+        {
+            integral_x *= params.integral_limit / integral_len;
+            integral_y *= params.integral_limit / integral_len;
+        }
+
+        out_x = params.kv * error_x + params.ki * integral_x;
+        out_y = params.kv * error_y + params.ki * integral_y;
+    }
+
+    // Clamp the magnitude, keeping the direction
+    float out_len = control_math::sqrt(out_x * out_x + out_y * out_y);
+    if (out_len > params.max_output)
+    {
+        out_x *= params.max_output / out_len;
+        out_y *= params.max_output / out_len;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef OUTER_LOOP_CONTROLLER_H
+#define OUTER_LOOP_CONTROLLER_H
+
+#include <stdint.h>
+#include "BallController.h"
+#include "../core/global_state.h"
+#include "../core/mailbox.h"
+
+// How the joystick target becomes the drive command handed to the solver
+enum class OuterLoopMode : uint8_t
+{
+    DIRECT = 0,  // Joystick straight through (pure proportional steering)
+    PD = 1,      // kp * joystick - kd * rolling rate
+    VELOCITY = 2 // Track a rolling rate of joystick * max_rate with a PI loop
+};
+
+struct OuterLoopParams
+{
+    OuterLoopMode mode = OuterLoopMode::DIRECT;
+
+    // PD mode (from autotune --outer-loop pd against ball_sim; confirm on the rig)
+    float kp = 3.5f;
+    float kd = 2.5f; // per rad/s of rolling rate
+
+    // VELOCITY mode (autotune found nothing better on a second seed)
+    float max_rate = 6.0f;        // rolling rate (rad/s) requested at full joystick
+    float kv = 1.0f;              // per rad/s of rate error
+    float ki = 0.3f;              // per rad of integrated rate error
+    float integral_limit = 2.0f;  // clamp on the integrated rate error (rad)
+
+    // Never ask the solver for more than this (joystick units)
+    float max_output = 1.5f;
+};
+
+// Outer loop between the joystick and BallController::solve.
+//
+// Works in the joystick frame: the gyro rate is rotated into the world frame
+// with the orientation, turned into a rolling rate (the ball rolls along
+// omega x z), and then rotated by -yaw_offset so it lines up with the joystick
+// axes. The output is the drive (torque) command to pass to solve().
+//
+// Parameters may be changed from another task with setParams(); the control
+// task picks them up at its next update().
+class OuterLoopController
+{
+private:
+    OuterLoopParams params;
+    LatestValueMailbox<OuterLoopParams> pending;
+
+    float integral_x = 0.0f;
+    float integral_y = 0.0f;
+
+public:
+    OuterLoopController() = default;
+
+    // Safe to call from any single task (e.g. the command receiver)
+    void setParams(const OuterLoopParams &value) { pending.publish(value); }
+    // The parameters update() is using: only read it from the control task
+    // (other tasks use getOuterLoopParams in control_algorithm.h)
+    const OuterLoopParams &getParams() const { return params; }
+
+    void reset();
+
+    // Rolling rate (rad/s) in the joystick frame from the body-frame gyro rate
+    static void rollingRate(const Quaternion &q, const AngularVelocity &angular_velocity, float yaw_offset, float &rate_x, float &rate_y);
+
+    // Returns the drive command (out_x, out_y) for solve(). dt is the time since
+    // the previous update (s).
+    void update(float joy_x, float joy_y, const Quaternion &q, const AngularVelocity &angular_velocity, float yaw_offset, float dt, float &out_x, float &out_y);
+};
+
+#endif
@@ -0,0 +1,35 @@
+// Generated by tools/gen_allocation_table.py -- do not edit by hand.
+// Re-run the generator after changing core/magnet_config.h, control/coil_gains.h or the solver model.
+//
+// 16x16 octahedral gravity grid, 1024 bytes.
+// Shortlist size: mean 8.4, max 12 magnets.
+// Matches the full search in 99.90% of sampled cases (mean regret 0.008%).
+#pragma once
+
+#include <stdint.h>
+
+namespace allocation_table
+{
+    constexpr int GRID = 16;
+
+    // Bit i set: magnet index i can be part of the optimal assignment somewhere
+    // in the cell. constexpr data is placed in .rodata, i.e. mapped flash.
+    constexpr uint32_t CELL_MASKS[GRID * GRID] = {
+        0x7801B, 0x7829B, 0x7829B, 0x78ADB, 0x38AD3, 0x30282, 0x34282, 0x30AC2, 0x30282, 0x30282, 0x30A82, 0x38AD3, 0x78ADB, 0x7829B, 0x7829B, 0x7809B,
+        0x7801B, 0x7C29B, 0x7CA9B, 0x78A93, 0xB8A83, 0xB4A82, 0xB4AC2, 0xB0AC2, 0xA4AC2, 0xA0AF2, 0xB0AF2, 0x382D3, 0x382DB, 0x782DB, 0x782DB, 0x5009B,
+        0x7C21B, 0x7C28B, 0x7CA8B, 0x7CA83, 0xF8AC1, 0xB4A82, 0xB4AC0, 0xA0AC2, 0xA4AC0, 0xA0AF2, 0xA02F2, 0x30ADA, 0x30ADB, 0x302DB, 0x7029B, 0x5009B,
+        0x58083, 0x7C283, 0xFCA83, 0xFCA81, 0xFEA00, 0xB6A00, 0xB0AC2, 0xA0AC0, 0xA0AC0, 0x80AE2, 0x903E2, 0x80BDA, 0xB02DB, 0x302DB, 0x3029F, 0x7001F,
+        0x7F003, 0x7C880, 0x3CA82, 0xBCA00, 0xBEA40, 0xBEA20, 0xA0A40, 0xA0A60, 0x80AE0, 0x80AE0, 0x903F2, 0x807F2, 0x807F2, 0x203DE, 0x203DE, 0x003DF,
+        0x7F801, 0x7C880, 0x3C880, 0x3CA00, 0xBEA80, 0xA6E60, 0xA4F60, 0x84F60, 0x84F60, 0x80AE0, 0xA07F2, 0xA0FF2, 0xA07FE, 0xA03FE, 0x203DE, 0x003FF,
+        0x7F800, 0x7E800, 0x3FA00, 0xBFA00, 0xAEE00, 0xAEF60, 0x86F20, 0x84F60, 0x84F60, 0x80560, 0xA27F2, 0xA07FE, 0xA07FE, 0x803FA, 0x803FE, 0x803FE,
+        0x5E800, 0x3F800, 0x7FA00, 0xCFE00, 0xAFE60, 0x86C20, 0x86E20, 0x82F20, 0x80E60, 0x807E0, 0x807E2, 0x807F6, 0x807FE, 0x807FE, 0x805FE, 0x805FE,
+        0x5E800, 0x6F800, 0x7F820, 0xBFC20, 0x8ED20, 0x86C20, 0x86E20, 0x82E60, 0x82760, 0x80760, 0x80764, 0x807FC, 0x807FE, 0x807FE, 0x807FE, 0x805FE,
+        0x7F801, 0x5F800, 0x4F800, 0x4FC00, 0x8FC04, 0x8FD60, 0x86E60, 0x86720, 0x86720, 0x80564, 0x8177C, 0x815FE, 0x815FE, 0x0157E, 0x005FE, 0x005FE,
+        0x7F801, 0x7F005, 0x4F000, 0x4F000, 0x4FC04, 0xC7D24, 0x8F560, 0x87560, 0x86524, 0x02534, 0x8156C, 0x8357F, 0x8157F, 0x0157E, 0x001FF, 0x001DF,
+        0x7D801, 0x7F005, 0x4F004, 0x4F400, 0x4FD01, 0xCFC2D, 0xC3524, 0xC752C, 0x4352C, 0x8352C, 0x8357C, 0x8257D, 0x8057D, 0x0111E, 0x001DF, 0x001DF,
+        0x7D009, 0x5D00D, 0x5F005, 0x5F009, 0x5FD09, 0x47C2D, 0xCB52C, 0xC350C, 0x4352C, 0x83525, 0xC357C, 0x0057D, 0x4051F, 0x0111D, 0x0001F, 0x4009F,
+        0x7801B, 0x5D01B, 0x5F00D, 0x5F105, 0x5B505, 0x47405, 0x4F50D, 0x03504, 0x03504, 0x0351D, 0x4113D, 0x4313D, 0x0311F, 0x4111F, 0x5001F, 0x5009B,
+        0x7801F, 0x5C01B, 0x5D01B, 0x4301D, 0x4350D, 0x4F50D, 0x4750C, 0x43504, 0x0351C, 0x4351D, 0x4151D, 0x4150D, 0x4910D, 0x5801F, 0x5801F, 0x5809B,
+        0x7801F, 0x5801F, 0x5901F, 0x4B11D, 0x4310D, 0x4901D, 0x4701D, 0x4710C, 0x4310C, 0x4110D, 0x4100D, 0x4B11D, 0x4B11D, 0x5801F, 0x5801F, 0x5809B,
+    };
+}
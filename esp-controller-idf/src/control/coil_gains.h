@@ -0,0 +1,12 @@
+// Generated by tools/fit_magnet_geometry.py -- do not edit by hand.
+// Torque gain of each coil relative to the solver model (1 = nominal),
+// indexed by magnet ID - 1. Nominal until a coil identification is fitted.
+#pragma once
+
+namespace coil_gains
+{
+    constexpr float GAIN[20] = {
+        1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f,
+        1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f, 1.000f,
+    };
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Fast approximations of the libm calls on the control path.
+//
+// The ESP32 FPU only has step instructions for divide and square root and
+// nothing for transcendentals, so atan2f/sinf/cosf/sqrtf are library calls. These replacements use range
+// reduction plus short polynomials (Abramowitz & Stegun 4.4.45 / 4.4.47,
+// Taylor series on [-pi/4, pi/4]) and a bit-level inverse square root seed.
+//
+// Maximum errors, measured over the full input range on the host by
+// host/bench/fast_math_bench.cpp (which fails if any bound is exceeded):
+//
+//   atan2     1.2e-5 rad     absolute
+//   sincos    4.0e-7         absolute, |angle| <= 1000 rad
+//   acos      8.0e-5 rad     absolute
+//   invSqrt   5.0e-6         relative
+//   sqrt      5.0e-6         relative (0 for x <= 0)
+//
+// The control code calls the control_math wrappers below, which pick libm or
+// these approximations at compile time: build with CONTROL_FAST_MATH=1 to
+// switch the solver, outer loop and predictor to the fast versions.
+
+#ifndef CONTROL_FAST_MATH
+#define CONTROL_FAST_MATH 0
+#endif
+
+namespace fast_math
+{
+    constexpr float PI = 3.14159265358979f;
+    constexpr float HALF_PI = 1.57079632679490f;
+
+    constexpr float ATAN2_MAX_ERROR = 1.2e-5f;
+    constexpr float SINCOS_MAX_ERROR = 4.0e-7f;
+    constexpr float ACOS_MAX_ERROR = 8.0e-5f;
+    constexpr float INV_SQRT_MAX_REL_ERROR = 5.0e-6f;
+
+    inline float atan2(float y, float x)
+    {
+        float ax = fabsf(x);
+        float ay = fabsf(y);
+        float max_xy = ax > ay ? ax : ay;
+        if (max_xy == 0.0f)
+            return 0.0f;
+
+        // atan on [0, 1] (A&S 4.4.47), then unfold the octant
+        float z = (ax > ay ? ay : ax) / max_xy;
+        float z2 = z * z;
+        float r = z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+
+        if (ay > ax)
+            r = HALF_PI - r;
+        if (x < 0.0f)
+            r = PI - r;
+        return y < 0.0f ? -r : r;
+    }
+
+    inline void sincos(float angle, float &s, float &c)
+    {
+        // angle = k * pi/2 + r with |r| <= pi/4; pi/2 is split in two parts
+        // (Cody-Waite) so the reduction stays accurate for large k
+        const float TWO_OVER_PI = 0.636619772367581f;
+        const float HALF_PI_HI = 1.5703125f; // exact in float
+        const float HALF_PI_LO = 4.83826794897e-4f;
+
+        float kf = rintf(angle * TWO_OVER_PI);
+        float r = (angle - kf * HALF_PI_HI) - kf * HALF_PI_LO;
+        int k = (int)kf;
+
+        float r2 = r * r;
+        float sin_r = r + r * r2 * (-1.0f / 6.0f + r2 * (1.0f / 120.0f + r2 * (-1.0f / 5040.0f)));
+        float cos_r = 1.0f + r2 * (-0.5f + r2 * (1.0f / 24.0f + r2 * (-1.0f / 720.0f + r2 * (1.0f / 40320.0f))));
+
+        switch (k & 3)
+        {
+        case 0:
+            s = sin_r;
+            c = cos_r;
+            break;
+        case 1:
+            s = cos_r;
+            c = -sin_r;
+            break;
+        case 2:
+            s = -sin_r;
+            c = -cos_r;
+            break;
+        default:
+            s = -cos_r;
+            c = sin_r;
+            break;
+        }
+    }
+
+    inline float invSqrt(float x)
+    {
+        // Bit-level seed (~3.4% error) refined by two Newton steps
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        bits = 0x5f375a86u - (bits >> 1);
+        float y;
+        memcpy(&y, &bits, sizeof(y));
+
+        float half_x = 0.5f * x;
+        y = y * (1.5f - half_x * y * y);
+        y = y * (1.5f - half_x * y * y);
+        return y;
+    }
+
+    inline float sqrt(float x)
+    {
+        return x > 0.0f ? x * invSqrt(x) : 0.0f;
+    }
+
+    inline float acos(float x)
+    {
+        if (x >= 1.0f)
+            return 0.0f;
+        if (x <= -1.0f)
+            return PI;
+
+        // acos on [0, 1] (A&S 4.4.45); acos(-x) = pi - acos(x)
+        float ax = fabsf(x);
+        float r = sqrt(1.0f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f + ax * -0.0187293f)));
+        return x < 0.0f ? PI - r : r;
+    }
+}
+
+// Math used by the control code: libm, or fast_math when CONTROL_FAST_MATH is set
+namespace control_math
+{
+    constexpr bool FAST = CONTROL_FAST_MATH != 0;
+
+    inline float atan2(float y, float x)
+    {
+        if constexpr (FAST)
+            return fast_math::atan2(y, x);
+        else
+            return atan2f(y, x);
+    }
+
+    inline void sincos(float angle, float &s, float &c)
+    {
+        if constexpr (FAST)
+        {
+            fast_math::sincos(angle, s, c);
+        }
+        else
+        {
+            s = sinf(angle);
+            c = cosf(angle);
+        }
+    }
+
+    inline float acos(float x)
+    {
+        if constexpr (FAST)
+            return fast_math::acos(x);
+        else
+            return acosf(x);
+    }
+
+    inline float sqrt(float x)
+    {
+        if constexpr (FAST)
+            return fast_math::sqrt(x);
+        else
+            return sqrtf(x);
+    }
+
+    inline float invSqrt(float x)
+    {
+        if constexpr (FAST)
+            return fast_math::invSqrt(x);
+        else
+            return 1.0f / sqrtf(x);
+    }
+}
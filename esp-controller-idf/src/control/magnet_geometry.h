@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <stdint.h>
+#include <tuple>
+#include "../core/magnet_config.h"
+#include "coil_gains.h"
+
+// Solver geometry and torque LUT, derived from MAGNET_CONFIG at compile time.
+//
+// Everything here is constexpr, so it is evaluated by the compiler and placed
+// in flash (.rodata): no BallController ever rebuilds it, and a bad
+// MAGNET_CONFIG edit fails the build instead of silently skewing the solver.
+namespace magnet_geometry
+{
+    // -----------------------------------------------------------------
+    // constexpr math (double precision; only used at compile time)
+    // -----------------------------------------------------------------
+    namespace cx
+    {
+        constexpr double PI = 3.14159265358979323846;
+        constexpr double LN2 = 0.69314718055994530942;
+
+        constexpr double abs(double x) { return x < 0.0 ? -x : x; }
+
+        constexpr double sqrt(double x)
+        {
+            if (x <= 0.0)
+                return 0.0;
+            double guess = x > 1.0 ? x : 1.0;
+            for (int i = 0; i < 64; i++)
+            {
+                double next = 0.5 * (guess + x / guess);
+                if (next == guess)
+                    break;
+                guess = next;
+            }
+            return guess;
+        }
+
+        constexpr double exp(double x)
+        {
+            // x = k*ln2 + r with |r| <= ln2/2, then a Taylor series for e^r
+            int k = (int)(x / LN2 + (x < 0.0 ? -0.5 : 0.5));
+            double r = x - k * LN2;
+            double term = 1.0;
+            double sum = 1.0;
+            for (int n = 1; n < 24; n++)
+            {
+                term *= r / n;
+                sum += term;
+            }
+            while (k > 0)
+            {
+                sum *= 2.0;
+                k--;
+            }
+            while (k < 0)
+            {
+                sum *= 0.5;
+                k++;
+            }
+            return sum;
+        }
+
+        constexpr double atan(double x)
+        {
+            if (x < 0.0)
+                return -atan(-x);
+            if (x > 1.0)
+                return 0.5 * PI - atan(1.0 / x);
+
+            // Halve the argument twice (atan(x) = 2 atan(x / (1 + sqrt(1 + x^2))))
+            // so the series below converges quickly
+            for (int i = 0; i < 2; i++)
+                x = x / (1.0 + sqrt(1.0 + x * x));
+
+            double x2 = x * x;
+            double term = x;
+            double sum = x;
+            for (int n = 1; n < 30; n++)
+            {
+                term *= -x2;
+                sum += term / (2 * n + 1);
+            }
+            return 4.0 * sum;
+        }
+
+        constexpr double acos(double c)
+        {
+            if (c >= 1.0)
+                return 0.0;
+            if (c <= -1.0)
+                return PI;
+            return 2.0 * atan(sqrt((1.0 - c) / (1.0 + c)));
+        }
+    }
+
+    // -----------------------------------------------------------------
+    // Magnet directions
+    // -----------------------------------------------------------------
+    constexpr int MAGNET_COUNT = 20;
+
+    // Unit direction of each magnet, indexed by magnet ID - 1
+    constexpr std::array<Vector3, MAGNET_COUNT> makeUnitMagnets()
+    {
+        std::array<Vector3, MAGNET_COUNT> out{};
+        for (const auto &entry : MAGNET_CONFIG)
+        {
+            const Vector3 &p = std::get<1>(entry);
+            double n = cx::sqrt((double)p.x * p.x + (double)p.y * p.y + (double)p.z * p.z);
+            out[std::get<0>(entry) - 1] = Vector3((float)(p.x / n), (float)(p.y / n), (float)(p.z / n));
+        }
+        return out;
+    }
+
+    inline constexpr std::array<Vector3, MAGNET_COUNT> UNIT_MAGNETS = makeUnitMagnets();
+
+    constexpr bool idsCoverAllMagnets()
+    {
+        bool seen[MAGNET_COUNT] = {};
+        for (const auto &entry : MAGNET_CONFIG)
+        {
+            int id = std::get<0>(entry);
+            if (id < 1 || id > MAGNET_COUNT || seen[id - 1])
+                return false;
+            seen[id - 1] = true;
+        }
+        return true;
+    }
+
+    constexpr bool allUnitLength()
+    {
+        for (const Vector3 &m : UNIT_MAGNETS)
+        {
+            double len_sq = (double)m.x * m.x + (double)m.y * m.y + (double)m.z * m.z;
+            if (cx::abs(len_sq - 1.0) > 1e-5)
+                return false;
+        }
+        return true;
+    }
+
+    // Two magnets closer than ~1 degree are almost certainly a copy-paste error
+    constexpr bool noDuplicateDirections()
+    {
+        for (int i = 0; i < MAGNET_COUNT; i++)
+        {
+            for (int j = i + 1; j < MAGNET_COUNT; j++)
+            {
+                const Vector3 &a = UNIT_MAGNETS[i];
+                const Vector3 &b = UNIT_MAGNETS[j];
+                if ((double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z > 0.9998)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(idsCoverAllMagnets(), "MAGNET_CONFIG must list magnet IDs 1..20 exactly once");
+    static_assert(allUnitLength(), "Magnet directions must be unit length");
+    static_assert(noDuplicateDirections(), "Two MAGNET_CONFIG entries point in the same direction");
+
+    // -----------------------------------------------------------------
+    // Torque LUT
+    // -----------------------------------------------------------------
+    // Indexed directly by cos(angle) = magnet.dot(gravity), so the solver never
+    // needs acosf. Each entry is the torque per amp divided by sin(angle):
+    // multiplying the (unnormalised) tangential projection of the magnet,
+    // whose length is sin(angle), by it gives the force vector directly.
+    constexpr int LUT_SIZE = 1024;
+    constexpr float MIN_ANGLE_RAD = 0.1f;
+    constexpr float MIN_ANGLE_COS = 0.995004165f; // cos(MIN_ANGLE_RAD)
+
+    constexpr std::array<float, LUT_SIZE> makeForceLut()
+    {
+        std::array<float, LUT_SIZE> out{};
+        for (int i = 0; i < LUT_SIZE; i++)
+        {
+            double cos_angle = (double)i / (LUT_SIZE - 1);
+            double angle = cx::acos(cos_angle);
+            double sin_angle = cx::sqrt(1.0 - cos_angle * cos_angle);
+
+            if (angle < MIN_ANGLE_RAD || sin_angle < 0.0001)
+            {
+                out[i] = 0.0f;
+                continue;
+            }
+
+            double num = 60.0 * sin_angle;
+            double den = 0.01 + 1.0 - cos_angle;
+            double val_per_amp = (num / den) * cx::exp(-2.5 * angle) / 8.0;
+            out[i] = (val_per_amp > 0.0) ? (float)(val_per_amp / sin_angle) : 0.0f;
+        }
+        return out;
+    }
+
+    inline constexpr std::array<float, LUT_SIZE> FORCE_LUT = makeForceLut();
+
+    // -----------------------------------------------------------------
+    // Geometry fingerprint
+    // -----------------------------------------------------------------
+    // FNV-1a over the magnet positions and coil gains. A stored calibration
+    // records it, so a calibration fitted against other geometry is not reused.
+    constexpr uint32_t fnv1a(uint32_t hash, float value)
+    {
+        uint32_t bits = std::bit_cast<uint32_t>(value);
+        for (int i = 0; i < 4; i++)
+        {
+            hash ^= (bits >> (8 * i)) & 0xFFu;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    constexpr uint32_t makeGeometryId()
+    {
+        uint32_t hash = 2166136261u;
+        for (const auto &entry : MAGNET_CONFIG)
+        {
+            const Vector3 &p = std::get<1>(entry);
+            hash = fnv1a(fnv1a(fnv1a(hash, p.x), p.y), p.z);
+        }
+        for (float gain : coil_gains::GAIN)
+            hash = fnv1a(hash, gain);
+        return hash;
+    }
+
+    inline constexpr uint32_t GEOMETRY_ID = makeGeometryId();
+}
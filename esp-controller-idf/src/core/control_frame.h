@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+// Setpoints produced by one slow-loop tick. Fixed capacity, so filling and
+// handing it to the fast loop never allocates. Magnets not listed are off.
+struct ControlFrame
+{
+    static constexpr int kCapacity = 20; // every magnet
+    // Current budget (A): BallController::max_current, the limit per coil for
+    // the single/pair search and the total across coils for NNLS
+    static constexpr float kMaxCurrent = 8.0f;
+    // Most a frame's setpoints may sum to, enforced by the transition
+    // scheduler: a pair from the pair search can drive both coils at
+    // kMaxCurrent. Solver frames never exceed it; only frames built by hand
+    // (dashboard, bench scripts) with more coils are scaled down.
+    static constexpr float kMaxFrameCurrent = 2.0f * kMaxCurrent;
+
+    int magnetIds[kCapacity];
+    float currents[kCapacity];
+    int count = 0;
+    uint32_t generation = 0; // stamped by GlobalState when the frame is applied
+
+    void clear() { count = 0; }
+
+    // Returns the slot of magnetId, or -1 if it is not in the frame
+    int find(int magnetId) const
+    {
+        for (int k = 0; k < count; k++)
+        {
+            if (magnetIds[k] == magnetId)
+                return k;
+        }
+        return -1;
+    }
+
+    // Sets (or adds) the setpoint for magnetId. Returns false if the frame is full.
+    bool set(int magnetId, float current)
+    {
+        int k = find(magnetId);
+        if (k < 0)
+        {
+            if (count >= kCapacity)
+                return false;
+            k = count++;
+            magnetIds[k] = magnetId;
+        }
+        currents[k] = current;
+        return true;
+    }
+
+    void remove(int magnetId)
+    {
+        int k = find(magnetId);
+        if (k < 0)
+            return;
+        count--;
+        magnetIds[k] = magnetIds[count];
+        currents[k] = currents[count];
+    }
+};
@@ -1,8 +1,9 @@
 #include "global_state.h"
 #include "magnet_config.h"
 
+#include "utils/profile.h"
 #include "utils/utils.h"
-#include <esp_timer.h>
+#include "hal/trace.h"
 #include <freertos/mpu_wrappers.h>
 
 #include "freertos/FreeRTOS.h"
@@ -182,6 +183,13 @@ void GlobalState::setControl(const ControlOutputs &value)
         throw std::out_of_range("Magnet ID not found: " + std::to_string(value.magnetId));
     }
     it->second.setControlValue(value);
+
+    // Keep the frame the fast loop drives in step with single-magnet updates
+    if (value.current_value != 0.0f)
+        activeFrame.set(value.magnetId, value.current_value);
+    else
+        activeFrame.remove(value.magnetId);
+    activeFrame.generation = ++frameGeneration;
 }
 
 void GlobalState::setControl(const std::vector<ControlOutputs> &values)
@@ -194,10 +202,35 @@ void GlobalState::setControl(const std::vector<ControlOutputs> &values)
 
 void GlobalState::zeroControl()
 {
+    trace::recordZeroControl();
     for (auto &pair : magnetList.magnets)
     {
         pair.second.zeroControl();
     }
+    activeFrame.clear();
+    activeFrame.generation = ++frameGeneration;
+}
+
+void GlobalState::applyControlFrame(const ControlFrame &frame)
+{
+    // 1. Zero the magnets that dropped out of the frame
+    for (int k = 0; k < activeFrame.count; k++)
+    {
+        int magnetId = activeFrame.magnetIds[k];
+        if (frame.find(magnetId) < 0)
+        {
+            magnetList.getMagnetById(magnetId).zeroControl();
+        }
+    }
+
+    // 2. Record the new setpoints
+    for (int k = 0; k < frame.count; k++)
+    {
+        magnetList.getMagnetById(frame.magnetIds[k]).setControlValue(ControlOutputs(frame.magnetIds[k], frame.currents[k]));
+    }
+
+    activeFrame = frame;
+    activeFrame.generation = ++frameGeneration;
 }
 
 // ============= Offset methods =============
@@ -289,47 +322,49 @@ CurrentInfo GlobalState::getLatestCurrentValues(int magnetId) const
 
 std::vector<CurrentInfo> GlobalState::currentControlLoop()
 {
-    int64_t loop_start = esp_timer_get_time();
+    int64_t loop_start = hal::micros();
+    trace::recordFastTick();
 
-    std::vector<ControlOutputs> latestControls = getLatestControl();
-    std::vector<int> mag_ids;
-    std::vector<int> magnets_to_zero = mag_ids;
+    // Pick up a new frame in one step; a magnet switch crossfades over less
+    // than one slow tick, so it completes before the next frame arrives
+    if (activeFrame.generation != transitions.current().generation)
+    {
+        transitions.start(activeFrame, static_cast<int>(slowLoopTime / fastLoopTime) - 1);
+    }
 
-    for (const auto &control : latestControls)
+    // Zero the coils that have ramped fully out of the frame
+    const ControlFrame &setpoints = transitions.step();
+    for (int k = 0; k < runningFrame.count; k++)
     {
-        if (control.current_value != 0.0f)
+        int magnetId = runningFrame.magnetIds[k];
+        int slot = setpoints.find(magnetId);
+        if (slot < 0 || setpoints.currents[slot] == 0.0f)
         {
-            mag_ids.push_back(control.magnetId);
-            isMagnetRunning.insert(control.magnetId);
-        }
-        else
-        {
-            if (isMagnetRunning.count(control.magnetId) > 0)
-            {
-                magnets_to_zero.push_back(control.magnetId);
-                isMagnetRunning.erase(control.magnetId);
-            }
+            setPWMOutputs({magnetId}, {0});
         }
     }
-
-    setPWMOutputs(magnets_to_zero, std::vector<int>(magnets_to_zero.size(), 0));
-
-    currentControlledMagnetIds = mag_ids;
+    runningFrame = setpoints;
 
     std::vector<CurrentInfo> currentInfos;
 
     // Method 2 to make our controller happier (do things 1 by 1)
-    for (size_t i = 0; i < mag_ids.size(); ++i)
+    for (int k = 0; k < runningFrame.count; ++k)
     {
+        if (runningFrame.currents[k] == 0.0f)
+            continue;
 
-        int magnetId = mag_ids[i];
+        int magnetId = runningFrame.magnetIds[k];
         std::vector<float> currentValues = retreveCurrentValueFromADC({magnetId});
         float currentValue = currentValues[0]; // Assuming single value per magnet
         CurrentInfo currentInfo(magnetId, currentValue);
         currentInfos.push_back(currentInfo);
         magnetList.getMagnetById(magnetId).setCurrentValue(currentInfo);
 
-        int newPWMSignal = magnetList.getMagnetById(magnetId).getNextCurrentValuePI();
+        int newPWMSignal;
+        {
+            PROFILE_ZONE("pi");
+            newPWMSignal = magnetList.getMagnetById(magnetId).getNextCurrentValuePI(runningFrame.currents[k]);
+        }
         setPWMOutputs({magnetId}, {newPWMSignal});
     }
 
@@ -354,8 +389,9 @@ std::vector<CurrentInfo> GlobalState::currentControlLoop()
 
     // setPWMOutputs(mag_ids, newPWMSignals);
 
-    int64_t loop_end = esp_timer_get_time();
+    int64_t loop_end = hal::micros();
     int64_t total_time = (loop_end - loop_start);
+    fastLoopTiming.record(total_time);
 
     return currentInfos;
 }
@@ -377,6 +413,46 @@ Vector3 GlobalState::getMagnetPosition(int magnetId) const
     return magnetList.getMagnetById(magnetId).position;
 }
 
+void GlobalState::setFastLoopTime(float seconds)
+{
+    fastLoopTime = seconds;
+    for (int magnetId = 1; magnetId <= 20; magnetId++)
+    {
+        magnetList.getMagnetById(magnetId).dt = seconds;
+    }
+}
+
+void GlobalState::getCurrentLoopGains(int magnetId, float &kp, float &ki) const
+{
+    const MagnetInfo &magnet = magnetList.getMagnetById(magnetId);
+    kp = magnet.kp;
+    ki = magnet.ki;
+}
+
+void GlobalState::setCurrentLoopGains(int magnetId, float kp, float ki)
+{
+    MagnetInfo &magnet = magnetList.getMagnetById(magnetId);
+    magnet.kp = kp;
+    magnet.ki = ki;
+}
+
+void GlobalState::getCurrentSense(int magnetId, float &offset_counts, float &gain) const
+{
+    const MagnetInfo &magnet = magnetList.getMagnetById(magnetId);
+    offset_counts = magnet.currentSenseOffset;
+    gain = magnet.currentSenseGain;
+}
+
+void GlobalState::setCurrentSense(int magnetId, float offset_counts, float gain)
+{
+    magnetList.getMagnetById(magnetId).setCurrentSense(offset_counts, gain);
+}
+
+float GlobalState::currentFromADC(int magnetId, uint16_t raw) const
+{
+    return magnetList.getMagnetById(magnetId).currentFromADC(raw);
+}
+
 // ============= Ideal Direction methods =============
 
 Vector3 GlobalState::getIdealDirection() const
@@ -442,18 +518,32 @@ bool GlobalState::getCalibrationRequested() const
     return requested;
 }
 
-void GlobalState::requestCalibration()
+void GlobalState::requestCalibration(bool automatic)
 {
     if (stateMutex == NULL)
     {
         calibrationRequested = true;
+        calibrationAutomatic = automatic;
         return;
     }
     xSemaphoreTake(stateMutex, portMAX_DELAY);
     calibrationRequested = true;
+    calibrationAutomatic = automatic;
     xSemaphoreGive(stateMutex);
 }
 
+bool GlobalState::getCalibrationAutomatic() const
+{
+    if (stateMutex == NULL)
+    {
+        return calibrationAutomatic;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    bool automatic = calibrationAutomatic;
+    xSemaphoreGive(stateMutex);
+    return automatic;
+}
+
 void GlobalState::clearCalibrationRequest()
 {
     if (stateMutex == NULL)
@@ -502,6 +592,82 @@ void GlobalState::clearStartRequest()
     xSemaphoreGive(stateMutex);
 }
 
+bool GlobalState::getIdentificationRequested() const
+{
+    if (stateMutex == NULL)
+    {
+        return identificationRequested;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    bool requested = identificationRequested;
+    xSemaphoreGive(stateMutex);
+    return requested;
+}
+
+void GlobalState::requestIdentification()
+{
+    if (stateMutex == NULL)
+    {
+        identificationRequested = true;
+        return;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    identificationRequested = true;
+    xSemaphoreGive(stateMutex);
+}
+
+void GlobalState::clearIdentificationRequest()
+{
+    if (stateMutex == NULL)
+    {
+        identificationRequested = false;
+        return;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    identificationRequested = false;
+    xSemaphoreGive(stateMutex);
+}
+
+bool GlobalState::getCurrentSenseCheckRequested(CurrentSenseCheck &request) const
+{
+    if (stateMutex == NULL)
+    {
+        request = currentSenseCheck;
+        return currentSenseCheckRequested;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    bool requested = currentSenseCheckRequested;
+    request = currentSenseCheck;
+    xSemaphoreGive(stateMutex);
+    return requested;
+}
+
+void GlobalState::requestCurrentSenseCheck(const CurrentSenseCheck &request)
+{
+    if (stateMutex == NULL)
+    {
+        currentSenseCheck = request;
+        currentSenseCheckRequested = true;
+        return;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    currentSenseCheck = request;
+    currentSenseCheckRequested = true;
+    xSemaphoreGive(stateMutex);
+}
+
+void GlobalState::clearCurrentSenseCheckRequest()
+{
+    if (stateMutex == NULL)
+    {
+        currentSenseCheckRequested = false;
+        return;
+    }
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    currentSenseCheckRequested = false;
+    xSemaphoreGive(stateMutex);
+}
+
 // ============= Calibration Input methods =============
 
 bool GlobalState::getCalibrationInputAvailable() const
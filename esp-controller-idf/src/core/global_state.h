@@ -9,6 +9,10 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <cmath>
+#include "../hal/clock.h"
+#include "../utils/timing_stats.h"
+#include "control_frame.h"
+#include "transition_scheduler.h"
 
 struct Orientation
 {
@@ -16,8 +20,9 @@ struct Orientation
     float x;
     float y;
     float z;
+    hal::Clock::time_point timestamp; // when the sample was read from the IMU
 
-    Orientation(float w, float x, float y, float z) : w(w), x(x), y(y), z(z) {}
+    Orientation(float w, float x, float y, float z) : w(w), x(x), y(y), z(z), timestamp(hal::Clock::now()) {}
 };
 
 struct AngularVelocity
@@ -25,18 +30,19 @@ struct AngularVelocity
     float x;
     float y;
     float z;
+    hal::Clock::time_point timestamp; // when the sample was read from the IMU
 
-    AngularVelocity(float x, float y, float z) : x(x), y(y), z(z) {}
+    AngularVelocity(float x, float y, float z) : x(x), y(y), z(z), timestamp(hal::Clock::now()) {}
 };
 
 struct ControlOutputs
 {
     int magnetId;
     float current_value;
-    std::chrono::steady_clock::time_point timestamp;
+    hal::Clock::time_point timestamp;
 
     ControlOutputs() = delete;
-    ControlOutputs(int magnetId, float current_value) : magnetId(magnetId), current_value(current_value), timestamp(std::chrono::steady_clock::now()) {}
+    ControlOutputs(int magnetId, float current_value) : magnetId(magnetId), current_value(current_value), timestamp(hal::Clock::now()) {}
     static ControlOutputs zero(int magnetId)
     {
         return ControlOutputs(magnetId, 0.0f);
@@ -47,9 +53,9 @@ struct CurrentInfo
 {
     int magnetId;
     float current;
-    std::chrono::steady_clock::time_point timestamp;
+    hal::Clock::time_point timestamp;
 
-    CurrentInfo(int magnetId, float current) : magnetId(magnetId), current(current), timestamp(std::chrono::steady_clock::now()) {}
+    CurrentInfo(int magnetId, float current) : magnetId(magnetId), current(current), timestamp(hal::Clock::now()) {}
 };
 
 struct Vector3
@@ -113,9 +119,24 @@ public:
     const int id;
     const Vector3 position;
 
-    const float kp = 35.0f;
-    const float ki = 15000.0f;
-    const float dt; // 300 microseconds
+    static constexpr float DEFAULT_KP = 35.0f;
+    static constexpr float DEFAULT_KI = 15000.0f;
+
+    // Current loop gains; only change them while the current loop is stopped
+    float kp = DEFAULT_KP;
+    float ki = DEFAULT_KI;
+    float dt; // PI integration step: the fast loop period (s)
+
+    // Current sense: 3.3 V over 4095 counts, x50 amplifier, 5 mOhm shunt
+    static constexpr float NOMINAL_AMPS_PER_COUNT = 3.3f / 4095.0f / 50.0f / 0.005f;
+
+    // Per-channel correction on top of the nominal scale (see setCurrentSense)
+    float currentSenseOffset = 0.0f; // ADC counts at zero current
+    float currentSenseGain = 1.0f;
+
+    // setCurrentSense folds the above into current = raw * adcScale + adcBias
+    float adcScale = NOMINAL_AMPS_PER_COUNT;
+    float adcBias = 0.0f;
 
     const ADCAddress adcAddress;
     const PWMAddress pwmAddress;
@@ -195,6 +216,20 @@ public:
         return subset;
     }
 
+    // Only change while the current loop is stopped
+    void setCurrentSense(float offset_counts, float gain)
+    {
+        currentSenseOffset = offset_counts;
+        currentSenseGain = gain;
+        adcScale = gain * NOMINAL_AMPS_PER_COUNT;
+        adcBias = -offset_counts * adcScale;
+    }
+
+    float currentFromADC(uint16_t raw) const
+    {
+        return raw * adcScale + adcBias;
+    }
+
     void setCurrentValue(const CurrentInfo &value)
     {
         xSemaphoreTake(currentHistoryMutex, portMAX_DELAY);
@@ -220,7 +255,13 @@ public:
 
     float getNextCurrentValuePI()
     {
-        float error = controlHistory.back().current_value - activeCurrentHistory.back().current;
+        return getNextCurrentValuePI(controlHistory.back().current_value);
+    }
+
+    // PI step towards an explicit setpoint (used while a transition is ramping)
+    float getNextCurrentValuePI(float setpoint)
+    {
+        float error = setpoint - activeCurrentHistory.back().current;
         float new_i = ki * error * dt;
 
         // Anti-windup: prevent integral from growing too large
@@ -298,7 +339,7 @@ public:
     {
         CONNECTION,  // Establishing WiFi connection
         STANDBY,     // Waiting for start command
-        CALIBRATION, // Running calibration
+        CALIBRATION, // Running calibration, or calibrated and waiting for start
         RUNNING,     // Normal operation
         TESTING      // Testing mode
     };
@@ -310,6 +351,14 @@ public:
     float fastLoopTime = 0.000650f; // 650 microseconds
     float slowLoopTime = 0.01f;     // 10 milliseconds
 
+    // Changes the fast loop period together with every current loop's
+    // integration step (set only while the control task is stopped)
+    void setFastLoopTime(float seconds);
+
+    // Control timing (IMU read timing is tracked separately by the IMU task)
+    TimingStats fastLoopTiming; // one currentControlLoop() call
+    TimingStats slowLoopTiming; // IMU hand-off + computeControl + setControl
+
     // functions get values about the orientation
     Orientation getOrientation() const;
     void setOrientation(const Orientation &value);
@@ -330,8 +379,20 @@ public:
     ControlOutputs getLatestControl(int magnetId) const;
     void setControl(const ControlOutputs &value);
     void setControl(const std::vector<ControlOutputs> &values);
+    // setControl, zeroControl and applyControlFrame write the frame the fast
+    // loop reads without a lock: call them from the control task, or while no
+    // control task is running (wait for it to exit first).
     void zeroControl();
 
+    // Replaces all setpoints at once. Magnets that were in the previous frame
+    // but not in this one are set to zero.
+    void applyControlFrame(const ControlFrame &frame);
+    const ControlFrame &getControlFrame() const { return activeFrame; }
+
+    // Crossfade between frames over this many fast-loop ticks (0 = switch at once)
+    void setTransitionTicks(int ticks) { transitions.setRampTicks(ticks); }
+    int getTransitionTicks() const { return transitions.getRampTicks(); }
+
     // functions for getting and setting the offset
     Orientation getOffset() const;
     void setOffset(const Orientation &value);
@@ -349,6 +410,15 @@ public:
     ADCAddress getADCAddress(int magnetId) const;
     Vector3 getMagnetPosition(int magnetId) const;
 
+    // Current loop PI gains per magnet (set only while the control task is stopped)
+    void getCurrentLoopGains(int magnetId, float &kp, float &ki) const;
+    void setCurrentLoopGains(int magnetId, float kp, float ki);
+
+    // Per-channel current sense correction (set only while the control task is stopped)
+    void getCurrentSense(int magnetId, float &offset_counts, float &gain) const;
+    void setCurrentSense(int magnetId, float offset_counts, float gain);
+    float currentFromADC(int magnetId, uint16_t raw) const;
+
     // getters and setters for the ideal direction
     Vector3 getIdealDirection() const;
     void setIdealDirection(const Vector3 &value);
@@ -362,13 +432,32 @@ public:
 
     // WiFi command flags
     bool getCalibrationRequested() const;
-    void requestCalibration();
+    void requestCalibration(bool automatic = false);
     void clearCalibrationRequest();
+    // Whether the last request asked for automatic (IMU response) calibration
+    bool getCalibrationAutomatic() const;
 
     bool getStartRequested() const;
     void requestStart();
     void clearStartRequest();
 
+    // Coil identification run (see calibration/coil_identification.h)
+    bool getIdentificationRequested() const;
+    void requestIdentification();
+    void clearIdentificationRequest();
+
+    // Current sense gain check against an external meter (see
+    // checkCurrentSense in utils/utils.h)
+    struct CurrentSenseCheck
+    {
+        int magnetId = 0;
+        int duty = 0;               // PWM duty 0-255, held open loop
+        float reference_amps = 0.0f; // meter reading; 0 only measures
+    };
+    bool getCurrentSenseCheckRequested(CurrentSenseCheck &request) const;
+    void requestCurrentSenseCheck(const CurrentSenseCheck &request);
+    void clearCurrentSenseCheckRequest();
+
     // Calibration input (joystick direction from dashboard during calibration)
     bool getCalibrationInputAvailable() const;
     Vector3 getCalibrationInput() const;
@@ -385,8 +474,14 @@ private:
     std::vector<Orientation> orientationHistory;
     std::vector<AngularVelocity> angularVelocityHistory;
     Vector3 idealDirection;
-    std::vector<int> currentControlledMagnetIds;
-    std::set<int> isMagnetRunning = {};
+
+    // Setpoints published by the slow loop, and the setpoints the fast loop is
+    // currently driving. The fast loop picks up a new generation in one step
+    // and crossfades to it through the transition scheduler.
+    ControlFrame activeFrame;
+    ControlFrame runningFrame;
+    uint32_t frameGeneration = 0;
+    TransitionScheduler transitions;
 
     // Timing instrumentation
 
@@ -397,7 +492,11 @@ private:
     mutable SemaphoreHandle_t stateMutex;
     SystemState systemState = SystemState::CONNECTION;
     bool calibrationRequested = false;
+    bool calibrationAutomatic = false;
     bool startRequested = false;
+    bool identificationRequested = false;
+    bool currentSenseCheckRequested = false;
+    CurrentSenseCheck currentSenseCheck;
 
     // Calibration input from dashboard
     Orientation localAxisOffset = Orientation(0, 0, 0.7071, 0.7071);
@@ -0,0 +1,125 @@
+#include "imu_task.h"
+#include "mailbox.h"
+#include "../hal/hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace {
+// Report interval of the fastest profile (400 Hz). The task sleeps in whole
+// ticks when the sensor has nothing pending, so a tick must be well inside it
+// (sdkconfig.defaults sets a 1 kHz tick; the IDF default of 100 Hz is 10 ms).
+constexpr uint32_t FASTEST_IMU_INTERVAL_US = 2500;
+constexpr uint32_t TICK_US = 1000000 / configTICK_RATE_HZ;
+static_assert(TICK_US * 2 <= FASTEST_IMU_INTERVAL_US,
+              "FreeRTOS tick too coarse for the 400 Hz IMU profile, set CONFIG_FREERTOS_HZ=1000");
+
+// Ticks to sleep on an empty poll: a quarter of the report interval, so a
+// report waits at most that long, and at least one tick to let core 0 run
+TickType_t idle_wait_ticks()
+{
+    const uint32_t ticks = hal::imuOrientationIntervalUs() / 4 / TICK_US;
+    return ticks > 0 ? static_cast<TickType_t>(ticks) : 1;
+}
+
+LatestValueMailbox<IMUSample> s_imu_mailbox;
+TimingStats s_imu_read_timing;
+
+// Producer side only: the newest state, updated field by field as reports arrive
+IMUSample s_poll_sample;
+
+// Last sample times handed to GlobalState (consumer side only)
+hal::Clock::time_point s_last_orientation_time{};
+hal::Clock::time_point s_last_gyro_time{};
+}
+
+bool imu_poll_once()
+{
+    IMUSample &sample = s_poll_sample;
+
+    int64_t read_start = hal::micros();
+    IMUData data = hal::imuPoll();
+    s_imu_read_timing.record(hal::micros() - read_start);
+
+    bool updated = false;
+    if (!data.orientation.empty())
+    {
+        const Orientation &o = data.orientation.back();
+        sample.w = o.w;
+        sample.x = o.x;
+        sample.y = o.y;
+        sample.z = o.z;
+        sample.orientation_time = o.timestamp;
+        sample.has_orientation = true;
+        updated = true;
+    }
+    if (!data.angular_velocity.empty())
+    {
+        const AngularVelocity &av = data.angular_velocity.back();
+        sample.gx = av.x;
+        sample.gy = av.y;
+        sample.gz = av.z;
+        sample.gyro_time = av.timestamp;
+        sample.has_gyro = true;
+        updated = true;
+    }
+
+    if (updated)
+    {
+        sample.sequence++;
+        s_imu_mailbox.publish(sample);
+    }
+    return updated;
+}
+
+void imu_task(void *param)
+{
+    (void)param;
+
+    // The report profile is set by hal::init() before the task starts
+    const TickType_t idle_wait = idle_wait_ticks();
+    while (true)
+    {
+        if (!imu_poll_once())
+        {
+            // Nothing pending on the sensor, let the other core-0 tasks run
+            vTaskDelay(idle_wait);
+        }
+    }
+}
+
+bool imu_consume_latest(IMUSample &out)
+{
+    return s_imu_mailbox.consume(out);
+}
+
+bool imu_update_global_state()
+{
+    IMUSample sample;
+    if (!s_imu_mailbox.consume(sample))
+    {
+        return false;
+    }
+
+    GlobalState &state = GlobalState::instance();
+    if (sample.has_gyro && sample.gyro_time != s_last_gyro_time)
+    {
+        AngularVelocity angular_velocity(sample.gx, sample.gy, sample.gz);
+        angular_velocity.timestamp = sample.gyro_time;
+        state.setAngularVelocity(angular_velocity);
+        s_last_gyro_time = sample.gyro_time;
+    }
+    if (sample.has_orientation && sample.orientation_time != s_last_orientation_time)
+    {
+        Orientation orientation(sample.w, sample.x, sample.y, sample.z);
+        orientation.timestamp = sample.orientation_time;
+        state.setOrientation(orientation);
+        s_last_orientation_time = sample.orientation_time;
+    }
+    return true;
+}
+
+TimingStats &imu_read_timing()
+{
+    return s_imu_read_timing;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "global_state.h"
+#include "../utils/timing_stats.h"
+
+// Newest IMU state as published by the acquisition task. Orientation and gyro
+// arrive in separate reports, so each carries its own read time.
+struct IMUSample
+{
+    float w = 1.0f, x = 0.0f, y = 0.0f, z = 0.0f; // orientation quaternion
+    float gx = 0.0f, gy = 0.0f, gz = 0.0f;        // angular velocity, body frame (rad/s)
+    hal::Clock::time_point orientation_time{};
+    hal::Clock::time_point gyro_time{};
+    bool has_orientation = false;
+    bool has_gyro = false;
+    uint32_t sequence = 0; // incremented on every publish
+};
+
+// FreeRTOS task that owns the IMU: polls hal::imuPoll() and publishes the
+// newest sample to a lock-free mailbox. Pin it to core 0 so slow I2C reads
+// never stall the current loop on core 1.
+void imu_task(void *param);
+
+// One iteration of imu_task: polls the IMU once and publishes anything new.
+// Returns false if nothing was pending. For callers that schedule the IMU
+// themselves (the host simulator); never run it alongside imu_task.
+bool imu_poll_once();
+
+// Non-blocking read of the newest sample. Returns false if nothing new has
+// been published since the last call. Single consumer only.
+bool imu_consume_latest(IMUSample &out);
+
+// Consumes the mailbox and appends any new orientation / gyro sample to the
+// GlobalState histories. Must only be called from one task at a time (the
+// control task while running, the state machine while calibrating).
+bool imu_update_global_state();
+
+// Duration of each hal::imuPoll() call made by the IMU task.
+TimingStats &imu_read_timing();
@@ -1,6 +1,21 @@
 #pragma once
 #include "global_state.h"
 
+// Positions in mm. Only the direction of each entry reaches the solver.
+//
+// IDs 6 and 10 sit at a radius of ~43 mm instead of the ~119 mm shell, which
+// looks like a dropped digit. They keep their original values until
+// tools/fit_magnet_geometry.py --write replaces them from a coil
+// identification log; the likely corrections are only candidates:
+//  - ID 6: x = 111.94 makes it the antipode of ID 16 (54 deg from the entry).
+//  - ID 10: z = 111.17 would put it 1.2 deg from ID 20, so the correction
+//    also needs the sign flipped: (-2.5, -42.46, -111.17) mirrors ID 1, and
+//    the antipode of ID 11, (1.25, -40.44, -111.94), is 2 deg from that.
+//    Either is 84 deg from the entry.
+//
+// ID 19 is provisional: it duplicated ID 17 (-67.93, -67.45, -70.73), which
+// magnet_geometry rejects, and now takes the one cube vertex no entry had,
+// (-, +, -). That is an unconfirmed guess; the fit should supply the real one.
 constexpr std::array<std::tuple<int, Vector3, ADCAddress, PWMAddress>, 20> MAGNET_CONFIG{
     {
         {1, {2.5f, 42.46f, -111.17f}, {GPIO_NUM_27, 0}, {0x40, 0}},
@@ -8,11 +23,11 @@ constexpr std::array<std::tuple<int, Vector3, ADCAddress, PWMAddress>, 20> MAGNE
         {3, {44.48f, 110.39f, -1.25f}, {GPIO_NUM_27, 2}, {0x40, 2}},
         {4, {67.93f, 67.45f, -70.72f}, {GPIO_NUM_27, 3}, {0x40, 3}},
         {5, {110.39f, -1.25f, -44.48f}, {GPIO_NUM_27, 4}, {0x40, 4}},
-        {6, {11.94f, -1.25f, 40.44f}, {GPIO_NUM_27, 5}, {0x40, 5}},
+        {6, {11.94f, -1.25f, 40.44f}, {GPIO_NUM_27, 5}, {0x40, 5}}, // off the shell, see above
         {7, {67.93f, -67.45f, 70.73f}, {GPIO_NUM_27, 6}, {0x40, 6}},
         {8, {40.44f, -111.94f, -1.25f}, {GPIO_NUM_27, 7}, {0x40, 7}},
         {9, {67.93f, 67.45f, 70.73f}, {GPIO_NUM_32, 0}, {0x40, 8}},
-        {10, {-2.5f, -42.46f, 11.17f}, {GPIO_NUM_32, 1}, {0x40, 9}},
+        {10, {-2.5f, -42.46f, 11.17f}, {GPIO_NUM_32, 1}, {0x40, 9}}, // off the shell, see above
         {11, {-1.25f, 40.44f, 111.94f}, {GPIO_NUM_32, 2}, {0x41, 0}},
         {12, {-67.93f, -67.45f, 70.73f}, {GPIO_NUM_32, 3}, {0x41, 1}},
         {13, {-40.44f, 111.94f, 1.25f}, {GPIO_NUM_32, 4}, {0x41, 2}},
@@ -21,7 +36,7 @@ constexpr std::array<std::tuple<int, Vector3, ADCAddress, PWMAddress>, 20> MAGNE
         {16, {-111.94f, 1.25f, -40.44f}, {GPIO_NUM_32, 7}, {0x41, 5}},
         {17, {-67.93f, -67.45f, -70.73f}, {GPIO_NUM_33, 0}, {0x41, 6}},
         {18, {-40.44f, -111.94f, -1.25f}, {GPIO_NUM_33, 1}, {0x41, 7}},
-        {19, {-67.93f, -67.45f, -70.73f}, {GPIO_NUM_33, 2}, {0x41, 8}},
+        {19, {-67.93f, 67.45f, -70.73f}, {GPIO_NUM_33, 2}, {0x41, 8}}, // provisional, see above
         {20, {-1.25f, -40.44f, 111.94f}, {GPIO_NUM_33, 3}, {0x41, 9}},
     }
 };
\ No newline at end of file
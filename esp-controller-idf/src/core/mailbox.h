@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Single-producer / single-consumer "latest value" mailbox (triple buffer).
+//
+// The producer always has a private back buffer to write into and the consumer
+// always has a private front buffer to read from; the third buffer sits in the
+// middle and is swapped atomically. Neither side ever blocks or retries, and a
+// slow consumer simply skips stale values.
+template <typename T>
+class LatestValueMailbox
+{
+private:
+    static constexpr uint8_t kIndexMask = 0x03;
+    static constexpr uint8_t kFreshFlag = 0x04;
+
+    T buffers[3] = {};
+    std::atomic<uint8_t> middle{1}; // index of the shared buffer | kFreshFlag when unread
+    uint8_t back = 0;               // owned by the producer
+    uint8_t front = 2;              // owned by the consumer
+
+public:
+    // Producer side: copy the value in and make it the newest available.
+    void publish(const T &value)
+    {
+        buffers[back] = value;
+        const uint8_t previous = middle.exchange(back | kFreshFlag, std::memory_order_acq_rel);
+        back = previous & kIndexMask;
+    }
+
+    // Consumer side: returns false (and leaves `out` untouched) if nothing new
+    // has been published since the last successful consume.
+    bool consume(T &out)
+    {
+        if ((middle.load(std::memory_order_acquire) & kFreshFlag) == 0)
+        {
+            return false;
+        }
+        const uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & kIndexMask;
+        out = buffers[front];
+        return true;
+    }
+};
@@ -68,6 +68,34 @@ static constexpr uint8_t SENSOR_REPORTID_ROTATION_VECTOR = 0x05;
 static constexpr uint8_t SENSOR_REPORTID_GYROSCOPE = 0x02;
 static constexpr uint8_t SENSOR_REPORTID_ACCELEROMETER = 0x01;
 static constexpr uint8_t SENSOR_REPORTID_MAGNETIC_FIELD = 0x03;
+static constexpr uint8_t SENSOR_REPORTID_GAME_ROTATION_VECTOR = 0x08;
+
+// Report profile table (indexed by IMUReportProfile). The first entry of each
+// profile must be the orientation report; its interval drives the slow loop.
+static constexpr size_t MAX_PROFILE_REPORTS = 4;
+struct IMUReportProfileEntry {
+    const char* name;
+    size_t report_count;
+    IMUReportConfig reports[MAX_PROFILE_REPORTS];
+};
+
+static const IMUReportProfileEntry s_imu_report_profiles[] = {
+    {"rotation vector + gyro @ 100Hz", 2, {
+        {SENSOR_REPORTID_ROTATION_VECTOR, 10000},
+        {SENSOR_REPORTID_GYROSCOPE, 10000},
+    }},
+    {"game rotation vector + gyro @ 200Hz", 2, {
+        {SENSOR_REPORTID_GAME_ROTATION_VECTOR, 5000},
+        {SENSOR_REPORTID_GYROSCOPE, 5000},
+    }},
+    {"game rotation vector + gyro @ 400Hz", 2, {
+        {SENSOR_REPORTID_GAME_ROTATION_VECTOR, 2500},
+        {SENSOR_REPORTID_GYROSCOPE, 2500},
+    }},
+};
+
+static uint32_t s_imu_orientation_interval_us = 0;
+static uint8_t s_imu_orientation_report_id = 0;
 
 static void log_stack_watermark(const char* tag) {
     const UBaseType_t watermark_words = uxTaskGetStackHighWaterMark(nullptr);
@@ -365,153 +393,34 @@ static esp_err_t bno08x_send_packet(uint8_t channel, const uint8_t* data, size_t
 static uint8_t s_assembly_buffer[MAX_ASSEMBLY_LEN];
 static uint16_t s_assembly_cursor = 0;
 
-Orientation parse_rotation_vector(const uint8_t* data) {
-    // RV Q-point = 14
-    auto q_to_f = [](int16_t raw, int q) { return static_cast<float>(raw) * std::pow(2.0f, -q); };
-
-    int16_t i_raw = static_cast<int16_t>(data[4] | (data[5] << 8));
-    int16_t j_raw = static_cast<int16_t>(data[6] | (data[7] << 8));
-    int16_t k_raw = static_cast<int16_t>(data[8] | (data[9] << 8));
-    int16_t r_raw = static_cast<int16_t>(data[10] | (data[11] << 8));
-
-    float i = q_to_f(i_raw, 14);
-    float j = q_to_f(j_raw, 14);
-    float k = q_to_f(k_raw, 14);
-    float r = q_to_f(r_raw, 14);
-    return Orientation(r, i, j, k);
-
-
-
-}
-
-void parse_accelerometer(const uint8_t* data) {
-    // do nothing
-}
-
-AngularVelocity parse_gyroscope(const uint8_t* data) {
-    // Gyro Q-point = 8
-    auto q_to_f = [](int16_t raw, int q) { return static_cast<float>(raw) * std::pow(2.0f, -q); };
-
-    int16_t x_raw = static_cast<int16_t>(data[4] | (data[5] << 8));
-    int16_t y_raw = static_cast<int16_t>(data[6] | (data[7] << 8));
-    int16_t z_raw = static_cast<int16_t>(data[8] | (data[9] << 8));
-
-    float x = q_to_f(x_raw, 8);
-    float y = q_to_f(y_raw, 8);
-    float z = q_to_f(z_raw, 8);
-
-
-    return AngularVelocity(x, y, z);
-
-
-}
-
-static IMUData rxAssemble(const uint8_t* packet, uint16_t len) {
-    IMUData empty_data = {};
-    if (len < SHTP_HEADER_SIZE) return empty_data;
-
-    // Byte 0-1: Length (LSB first)
-    // IMPORTANT: Just take the 15 bits. Ignore the 16th bit for now.
-    uint16_t packet_len = (packet[0] | (packet[1] << 8)) & 0x7FFF;
-    uint8_t channel = packet[2];
-    uint8_t seq = packet[3];
-
-    
-
-    // DEBUG: If you see len=276, you are reading the Advertisement.
-    // In most cases, one I2C read = One complete SHTP packet.
-    
-    // Skip the 4-byte header to get to the data
-    const uint8_t* payload = &packet[SHTP_HEADER_SIZE];
-    uint16_t payload_len = packet_len - SHTP_HEADER_SIZE;
-
-    if (channel == 3) {
-        uint16_t i = 0;
-        return process_channel_3(&payload[i], payload_len - i);
-        
-    } else if (channel == 0) {
-        // This is the advertisement (276 bytes). 
-        // You can ignore this for now unless you want to parse Q-points dynamically.
-        ESP_LOGI(TAG, "Ch 0: Advertisement received (len %d)", packet_len);
-    }
-
-    return empty_data;
-}
-
 void imu_purge_buffer() {
     // nothing as of right now
 }
 
-IMUData process_channel_3(const uint8_t* payload, uint16_t payload_len) {
-    IMUData imu_data;
-    uint16_t i = 0;
-
-    while (i < payload_len) {
-        uint8_t report_id = payload[i];
-        
-
-        switch (report_id) {
-            case 0xFB: // Base Timestamp Reference
-                // Total length: 5 bytes (ID + 4 bytes of 32-bit timestamp)
-                i += 5; 
-                break;
-
-            case 0xF2: // Base Timestamp (used in some firmware versions)
-                i += 5;
-                break;
-
-            case 0x05: // Rotation Vector
-
-                imu_data.orientation.push_back(parse_rotation_vector(&payload[i]));
-                i += 14; 
-                break;
-
-            case 0x01: // Accelerometer
-                i += 10;
-                break;
-
-            case 0x02: // Gyroscope
-                imu_data.angular_velocity.push_back(parse_gyroscope(&payload[i])); // Gyro has same data format as Accel, just different scaling
-                i += 10;
-            break;
-
-            case 0x03: // Magnetometer
-                i += 10;
-            break;
-
-            default:
-                // CRITICAL: If we hit an unknown ID, we don't know the length.
-                // We must abort parsing this packet to avoid reading garbage.
-                ESP_LOGW("IMU", "Unknown Report ID: 0x%02x at index %d", report_id, i);
-                return imu_data; 
-        }
-    }
-    return imu_data;
-}
-
-IMUData shtp_service() {
+uint16_t shtp_read_packet(uint8_t* packet, size_t capacity) {
     uint8_t header[SHTP_HEADER_SIZE];
-    static uint8_t packet_scratchpad[MAX_PACKET_LEN];
-    IMUData empty_data = {};
 
     // 1. Read the 4-byte header to see how much data is waiting
     esp_err_t err = i2c_master_receive(s_imu_device, header, SHTP_HEADER_SIZE, 50);
-    if (err != ESP_OK) return empty_data;
+    if (err != ESP_OK) return 0;
 
     // Mask the length (ignore Bit 15 here)
     uint16_t packet_len = (header[0] | (header[1] << 8)) & 0x7FFF;
 
-    if (packet_len < SHTP_HEADER_SIZE || packet_len > MAX_PACKET_LEN) {
-        return empty_data;
+    if (packet_len < SHTP_HEADER_SIZE || packet_len > capacity) {
+        return 0;
     }
 
     // 2. Perform a full read of the entire packet (header + payload)
     // The FSM30X requires the full length to be read to clear its internal buffer.
-    err = i2c_master_receive(s_imu_device, packet_scratchpad, packet_len, 100);
-    if (err == ESP_OK) {
-        return rxAssemble(packet_scratchpad, packet_len);
-    }
-    return empty_data;
+    err = i2c_master_receive(s_imu_device, packet, packet_len, 100);
+    return err == ESP_OK ? packet_len : 0;
+}
+
+IMUData shtp_service() {
+    static uint8_t packet_scratchpad[MAX_PACKET_LEN];
+    uint16_t packet_len = shtp_read_packet(packet_scratchpad, sizeof(packet_scratchpad));
+    return shtp_parse_packet(packet_scratchpad, packet_len);
 }
 
 
@@ -540,10 +449,37 @@ esp_err_t imu_send_packet(i2c_master_dev_handle_t dev, uint8_t channel, uint8_t*
     return i2c_master_transmit(dev, tx_buffer, packet_len, 100);
 }
 
+/**
+ * Builds and sends a Set Feature command (0xFD) for one report.
+ * Batch interval is always 0 so reports are delivered in real time.
+ */
+static esp_err_t imu_set_feature(i2c_master_dev_handle_t dev, const IMUReportConfig& report) {
+    uint8_t feat_cmd[17] = {0};
+
+    feat_cmd[0] = 0xFD; // Set Feature Command
+    feat_cmd[1] = report.report_id;
+    // 5-8: Report Interval
+    feat_cmd[5] = (report.interval_us & 0xFF);
+    feat_cmd[6] = ((report.interval_us >> 8) & 0xFF);
+    feat_cmd[7] = ((report.interval_us >> 16) & 0xFF);
+    feat_cmd[8] = ((report.interval_us >> 24) & 0xFF);
+    // 9-12: Batch Interval (MUST BE 0 for real-time), left zeroed
+
+    return imu_send_packet(dev, 2, feat_cmd, sizeof(feat_cmd));
+}
+
+uint32_t imu_orientation_interval_us() {
+    return s_imu_orientation_interval_us;
+}
+
+uint8_t imu_orientation_report_id() {
+    return s_imu_orientation_report_id;
+}
+
 /**
  * The "Right" Setup Flow
  */
-void init_imu() {
+void init_imu(IMUReportProfile profile) {
     ESP_LOGI(TAG, "Starting IMU Hardware Reset...");
 
     gpio_set_direction(GPIO_NUM_25, GPIO_MODE_OUTPUT);
@@ -594,54 +530,19 @@ void init_imu() {
         vTaskDelay(pdMS_TO_TICKS(10));
     }
 
-    // 4. ENABLE ROTATION VECTOR
-    // We use Batch Interval = 0 for immediate real-time updates.
-    ESP_LOGI(TAG, "Configuring Rotation Vector @ 100Hz...");
-    uint32_t interval_us = 10000; // 100Hz
-    uint8_t feat_cmd[17] = {0};
-    
-    feat_cmd[0] = 0xFD; // Set Feature Command
-    feat_cmd[1] = 0x05; // Rotation Vector ID
-    // 5-8: Report Interval
-    feat_cmd[5] = (interval_us & 0xFF);
-    feat_cmd[6] = ((interval_us >> 8) & 0xFF);
-    feat_cmd[7] = ((interval_us >> 16) & 0xFF);
-    feat_cmd[8] = ((interval_us >> 24) & 0xFF);
-    // 9-12: Batch Interval (MUST BE 0 for real-time)
-    feat_cmd[9] = 0; 
-    feat_cmd[10] = 0;
-    feat_cmd[11] = 0;
-    feat_cmd[12] = 0;
-
-    err = imu_send_packet(s_imu_device, 2, feat_cmd, 17);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send Feature Command");
-        return;
-    }
-    vTaskDelay(pdMS_TO_TICKS(1)); // Short delay to ensure the sensor processes the command
-
-    // ENABLE GYRO
-    uint8_t feat_cmd_gyro[17] = {0};
-    feat_cmd_gyro[0] = 0xFD; // Set Feature Command
-    feat_cmd_gyro[1] = 0x02; // Gyroscope ID
-    // 5-8: Report Interval
-    feat_cmd_gyro[5] = (interval_us & 0xFF);
-    feat_cmd_gyro[6] = ((interval_us >> 8) & 0xFF);
-    feat_cmd_gyro[7] = ((interval_us >> 16) & 0xFF);
-    feat_cmd_gyro[8] = ((interval_us >> 24) & 0xFF);
-    // 9-12: Batch Interval (MUST BE 0 for real-time)
-    feat_cmd_gyro[9] = 0; 
-    feat_cmd_gyro[10] = 0;
-    feat_cmd_gyro[11] = 0;
-    feat_cmd_gyro[12] = 0;
-
-    err = imu_send_packet(s_imu_device, 2, feat_cmd_gyro, 17);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send Gyro Feature Command");
-        return;
+    // 4. ENABLE THE REPORTS OF THE SELECTED PROFILE
+    const IMUReportProfileEntry& entry = s_imu_report_profiles[static_cast<size_t>(profile)];
+    ESP_LOGI(TAG, "Configuring IMU profile: %s", entry.name);
+    for (size_t i = 0; i < entry.report_count; i++) {
+        err = imu_set_feature(s_imu_device, entry.reports[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send Feature Command for report 0x%02x", entry.reports[i].report_id);
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1)); // Short delay to ensure the sensor processes the command
     }
-
-    vTaskDelay(pdMS_TO_TICKS(1)); // Short delay to ensure the sensor processes the command
+    s_imu_orientation_interval_us = entry.reports[0].interval_us;
+    s_imu_orientation_report_id = entry.reports[0].report_id;
 
     // 5. FINAL WAIT
     // Give the fusion engine a moment to stabilize
@@ -723,6 +624,6 @@ void init_peripherals(int adc_clock_speed_hz, int uart_baud_rate) {
     init_comms();
 
     serial_init(uart_baud_rate);
-    init_imu();
+    init_imu(IMU_REPORT_PROFILE);
     
 }
\ No newline at end of file
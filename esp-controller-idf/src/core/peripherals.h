@@ -5,11 +5,9 @@
 #include <driver/gpio.h>
 #include <vector>
 #include "global_state.h"
-
-#define EXAMPLE_ESP_WIFI_SSID      "ESP32_Data_Link"
-#define EXAMPLE_ESP_WIFI_PASS      "password123"
-#define PORT                        5005
-#define RECV_IP_ADDR               "192.168.4.2"
+#include "../comms/comms_config.h"
+#include "../hal/hal.h"
+#include "shtp_parser.h"
 
 static const char *TAG = "WIFI_DATA_LINK";
 
@@ -24,20 +22,40 @@ static gpio_num_t I2C_SDA_PIN = GPIO_NUM_21;
 static gpio_num_t I2C_SCL_PIN = GPIO_NUM_22;
 static int I2C_CLOCK_HZ = 400000;
 
-#define SHTP_HEADER_SIZE 4
 #define MAX_PACKET_LEN 512
 #define MAX_ASSEMBLY_LEN 1024
 
 
 static const int PWM_OUTPUT_BOUNDS[2] = {0, 255};
 
+// BNO08x report profiles. Each profile is a row in the table in peripherals.cpp
+// listing which reports get enabled and at what interval. The game rotation
+// vector ignores the magnetometer, so it is not disturbed by our own coils and
+// can run up to 400 Hz.
+enum class IMUReportProfile {
+    ROTATION_VECTOR_100HZ,      // Rotation vector + gyro @ 100 Hz (original setup)
+    GAME_ROTATION_VECTOR_200HZ, // Game rotation vector + gyro @ 200 Hz
+    GAME_ROTATION_VECTOR_400HZ, // Game rotation vector + gyro @ 400 Hz
+};
+
+#define IMU_REPORT_PROFILE IMUReportProfile::ROTATION_VECTOR_100HZ
 
+struct IMUReportConfig {
+    uint8_t report_id;    // SH-2 sensor report ID
+    uint32_t interval_us; // Requested report interval
+};
 
 void init_adc(int clock_speed_hz, gpio_num_t chip_select_pin);
 
 void init_pwm_driver();
 
-void init_imu();
+void init_imu(IMUReportProfile profile = IMU_REPORT_PROFILE);
+
+// Orientation report interval of the profile passed to init_imu (0 before init)
+uint32_t imu_orientation_interval_us();
+
+// Report ID of that profile's orientation report (0 before init)
+uint8_t imu_orientation_report_id();
 
 void init_comms();
 
@@ -57,14 +75,9 @@ void pca9685_set_pwm(int driver_i2c_address, int channel, int value_0_255);
 
 void imu_purge_buffer();
 
-struct IMUData {
-    std::vector<AngularVelocity> angular_velocity;
-    std::vector<Orientation> orientation;
-};
-
+// Reads one SHTP packet (header included) from the IMU into `packet`.
+// Returns its length, or 0 if nothing was pending or it does not fit.
+uint16_t shtp_read_packet(uint8_t* packet, size_t capacity);
 
+// shtp_read_packet followed by shtp_parse_packet
 IMUData shtp_service();
-Orientation parse_rotation_vector(const uint8_t* data);
-void parse_accelerometer(const uint8_t* data);
-AngularVelocity parse_gyroscope(const uint8_t* data);
-IMUData process_channel_3(const uint8_t* payload, uint16_t payload_len);
@@ -0,0 +1,131 @@
+#include "shtp_parser.h"
+
+#include <cmath>
+#include "esp_log.h"
+
+static const char *SHTP_TAG = "IMU";
+
+Orientation parse_rotation_vector(const uint8_t* data) {
+    // RV Q-point = 14
+    auto q_to_f = [](int16_t raw, int q) { return static_cast<float>(raw) * std::pow(2.0f, -q); };
+
+    int16_t i_raw = static_cast<int16_t>(data[4] | (data[5] << 8));
+    int16_t j_raw = static_cast<int16_t>(data[6] | (data[7] << 8));
+    int16_t k_raw = static_cast<int16_t>(data[8] | (data[9] << 8));
+    int16_t r_raw = static_cast<int16_t>(data[10] | (data[11] << 8));
+
+    float i = q_to_f(i_raw, 14);
+    float j = q_to_f(j_raw, 14);
+    float k = q_to_f(k_raw, 14);
+    float r = q_to_f(r_raw, 14);
+    return Orientation(r, i, j, k);
+}
+
+Orientation parse_game_rotation_vector(const uint8_t* data) {
+    // Same layout and Q-point as the rotation vector, minus the accuracy field
+    return parse_rotation_vector(data);
+}
+
+void parse_accelerometer(const uint8_t* data) {
+    // do nothing
+}
+
+AngularVelocity parse_gyroscope(const uint8_t* data) {
+    // Calibrated gyro Q-point = 9 (rad/s). The orientation predictor integrates
+    // these rates, so the scale has to be right.
+    auto q_to_f = [](int16_t raw, int q) { return static_cast<float>(raw) * std::pow(2.0f, -q); };
+
+    int16_t x_raw = static_cast<int16_t>(data[4] | (data[5] << 8));
+    int16_t y_raw = static_cast<int16_t>(data[6] | (data[7] << 8));
+    int16_t z_raw = static_cast<int16_t>(data[8] | (data[9] << 8));
+
+    float x = q_to_f(x_raw, 9);
+    float y = q_to_f(y_raw, 9);
+    float z = q_to_f(z_raw, 9);
+
+    return AngularVelocity(x, y, z);
+}
+
+IMUData shtp_parse_packet(const uint8_t* packet, uint16_t len) {
+    IMUData empty_data = {};
+    if (len < SHTP_HEADER_SIZE) return empty_data;
+
+    // Byte 0-1: Length (LSB first)
+    // IMPORTANT: Just take the 15 bits. Ignore the 16th bit for now.
+    uint16_t packet_len = (packet[0] | (packet[1] << 8)) & 0x7FFF;
+    if (packet_len < SHTP_HEADER_SIZE || packet_len > len) return empty_data;
+    uint8_t channel = packet[2];
+
+    
+
+    // DEBUG: If you see len=276, you are reading the Advertisement.
+    // In most cases, one I2C read = One complete SHTP packet.
+    
+    // Skip the 4-byte header to get to the data
+    const uint8_t* payload = &packet[SHTP_HEADER_SIZE];
+    uint16_t payload_len = packet_len - SHTP_HEADER_SIZE;
+
+    if (channel == 3) {
+        uint16_t i = 0;
+        return process_channel_3(&payload[i], payload_len - i);
+        
+    } else if (channel == 0) {
+        // This is the advertisement (276 bytes). 
+        // You can ignore this for now unless you want to parse Q-points dynamically.
+        ESP_LOGI(SHTP_TAG, "Ch 0: Advertisement received (len %d)", packet_len);
+    }
+
+    return empty_data;
+}
+
+IMUData process_channel_3(const uint8_t* payload, uint16_t payload_len) {
+    IMUData imu_data;
+    uint16_t i = 0;
+
+    while (i < payload_len) {
+        uint8_t report_id = payload[i];
+        
+
+        switch (report_id) {
+            case 0xFB: // Base Timestamp Reference
+                // Total length: 5 bytes (ID + 4 bytes of 32-bit timestamp)
+                i += 5; 
+                break;
+
+            case 0xF2: // Base Timestamp (used in some firmware versions)
+                i += 5;
+                break;
+
+            case 0x05: // Rotation Vector
+
+                imu_data.orientation.push_back(parse_rotation_vector(&payload[i]));
+                i += 14; 
+                break;
+
+            case 0x08: // Game Rotation Vector (no accuracy estimate)
+                imu_data.orientation.push_back(parse_game_rotation_vector(&payload[i]));
+                i += 12;
+                break;
+
+            case 0x01: // Accelerometer
+                i += 10;
+                break;
+
+            case 0x02: // Gyroscope
+                imu_data.angular_velocity.push_back(parse_gyroscope(&payload[i])); // Gyro has same data format as Accel, just different scaling
+                i += 10;
+            break;
+
+            case 0x03: // Magnetometer
+                i += 10;
+            break;
+
+            default:
+                // CRITICAL: If we hit an unknown ID, we don't know the length.
+                // We must abort parsing this packet to avoid reading garbage.
+                ESP_LOGW("IMU", "Unknown Report ID: 0x%02x at index %d", report_id, i);
+                return imu_data; 
+        }
+    }
+    return imu_data;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include "../hal/hal.h"
+
+// Decoding of BNO08x SHTP packets into IMUData. Pure functions with no driver
+// dependency, so the host can replay recorded packets (see hal/trace.h)
+// through exactly the code the firmware runs.
+
+#define SHTP_HEADER_SIZE 4
+
+// Decodes one whole SHTP packet, header included. Sensor reports on channel 3
+// become samples; anything else (or a malformed packet) gives empty vectors.
+IMUData shtp_parse_packet(const uint8_t* packet, uint16_t len);
+
+IMUData process_channel_3(const uint8_t* payload, uint16_t payload_len);
+Orientation parse_rotation_vector(const uint8_t* data);
+Orientation parse_game_rotation_vector(const uint8_t* data);
+void parse_accelerometer(const uint8_t* data);
+AngularVelocity parse_gyroscope(const uint8_t* data);
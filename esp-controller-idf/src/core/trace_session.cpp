@@ -0,0 +1,66 @@
+#include "trace_session.h"
+#include "global_state.h"
+#include "../hal/trace.h"
+#include "../mag_selection_control/control_algorithm.h"
+#include "esp_log.h"
+
+static const char *TRACE_TAG = "TRACE";
+
+TraceConfig trace_capture_config()
+{
+    GlobalState &state = GlobalState::instance();
+    BallController &controller = getControllerInstance();
+
+    TraceConfig config;
+    config.calibration = captureCalibration();
+    config.is_calibrated = controller.isCalibrated() ? 1 : 0;
+    config.allocation_mode = static_cast<uint8_t>(getAllocationMode());
+    config.current_penalty = controller.getCurrentPenalty();
+    config.fast_loop_time = state.fastLoopTime;
+    config.slow_loop_time = state.slowLoopTime;
+    config.imu_interval_us = hal::imuOrientationIntervalUs();
+    config.outer_loop = getOuterLoopParams();
+    config.transition_ticks = state.getTransitionTicks();
+    return config;
+}
+
+void trace_apply_config(const TraceConfig &config)
+{
+    GlobalState &state = GlobalState::instance();
+    BallController &controller = getControllerInstance();
+
+    applyStoredCalibration(config.calibration);
+    if (!config.is_calibrated)
+    {
+        ControllerCalibration cal = controller.getCalibration();
+        cal.is_calibrated = false;
+        controller.publishCalibration(cal);
+    }
+    setAllocationMode(static_cast<AllocationMode>(config.allocation_mode));
+    controller.setCurrentPenalty(config.current_penalty);
+    state.setFastLoopTime(config.fast_loop_time);
+    state.slowLoopTime = config.slow_loop_time;
+    getOrientationPredictor().setActuationLead(0.5f * config.slow_loop_time);
+    setOuterLoopParams(config.outer_loop);
+    state.setTransitionTicks(config.transition_ticks);
+}
+
+bool trace_start_recording(size_t capacity, bool record_outputs)
+{
+    TraceConfig config = trace_capture_config();
+    if (!trace::start(capacity, record_outputs, &config, sizeof(config)))
+    {
+        ESP_LOGE(TRACE_TAG, "Cannot start recording (%u bytes)", (unsigned)capacity);
+        return false;
+    }
+    ESP_LOGI(TRACE_TAG, "Recording into %u bytes%s", (unsigned)capacity, record_outputs ? " with PWM outputs" : "");
+    return true;
+}
+
+void trace_stop_recording()
+{
+    trace::stop();
+    trace::Reader reader(trace::data(), trace::size());
+    bool truncated = (reader.flags() & trace::FLAG_TRUNCATED) != 0;
+    ESP_LOGI(TRACE_TAG, "Recorded %u bytes%s", (unsigned)trace::size(), truncated ? " (buffer filled up)" : "");
+}
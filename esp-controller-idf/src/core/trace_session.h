@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../calibration/calibration_store.h"
+#include "../control/OuterLoopController.h"
+
+// Starts and stops a trace recording (hal/trace.h) with a snapshot of the
+// controller settings in its Config event, so a replay starts from the same
+// configuration as the recording.
+//
+// Outputs only match the recording from the first tick if the recording
+// started before the control loop (e.g. before "start running"): the PI
+// integrators and the transition scheduler are not part of the snapshot.
+struct TraceConfig
+{
+    static constexpr uint32_t VERSION = 4;
+    uint32_t version = VERSION;
+
+    StoredCalibration calibration;
+    uint8_t is_calibrated = 0;
+    uint8_t allocation_mode = 0;     // AllocationMode
+    float current_penalty = 0.0f;    // BallController::setCurrentPenalty
+    float fast_loop_time = 0.0f;     // s
+    float slow_loop_time = 0.0f;     // s
+    uint32_t imu_interval_us = 0;
+    OuterLoopParams outer_loop;
+    int32_t transition_ticks = 0;    // GlobalState::setTransitionTicks
+};
+
+// Default recording buffer: a few seconds of running at 1.5 kHz
+constexpr size_t TRACE_DEFAULT_CAPACITY = 96 * 1024;
+
+// Snapshots the settings and starts recording into a `capacity` byte buffer.
+// With `record_outputs` every PWM write is recorded too, so a replay can be
+// checked against what the board actually did. Returns false if a recording
+// is already running or the buffer cannot be allocated.
+bool trace_start_recording(size_t capacity, bool record_outputs);
+
+// Stops recording; the trace stays available through trace::data()/size()
+void trace_stop_recording();
+
+// Settings of the running controller, as stored in the Config event
+TraceConfig trace_capture_config();
+
+// Applies the settings of a Config event. Call only while the control task
+// is stopped.
+void trace_apply_config(const TraceConfig &config);
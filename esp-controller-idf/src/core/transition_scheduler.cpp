@@ -0,0 +1,75 @@
+#include "transition_scheduler.h"
+
+namespace
+{
+bool sameMagnets(const ControlFrame &a, const ControlFrame &b)
+{
+    if (a.count != b.count)
+        return false;
+    for (int k = 0; k < a.count; k++)
+    {
+        if (b.find(a.magnetIds[k]) < 0)
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+void TransitionScheduler::start(const ControlFrame &frame, int max_ticks)
+{
+    bool switched = !sameMagnets(frame, target);
+    target = frame;
+    if (!switched)
+        return;
+
+    from = output;
+    tick = 0;
+    active_ticks = (ramp_ticks < max_ticks) ? ramp_ticks : max_ticks;
+    if (active_ticks < 0)
+        active_ticks = 0;
+}
+
+const ControlFrame &TransitionScheduler::step()
+{
+    if (tick >= active_ticks)
+    {
+        // Settled (or ramping disabled): drive the target as-is
+        tick = active_ticks;
+        output = target;
+    }
+    else
+    {
+        tick++;
+        float alpha = (float)tick / active_ticks;
+
+        // 1. Incoming and continuing magnets: blend from their old setpoint
+        output.clear();
+        for (int k = 0; k < target.count; k++)
+        {
+            int slot = from.find(target.magnetIds[k]);
+            float start = (slot >= 0) ? from.currents[slot] : 0.0f;
+            output.set(target.magnetIds[k], start + (target.currents[k] - start) * alpha);
+        }
+
+        // 2. Outgoing magnets: ramp down to zero
+        for (int k = 0; k < from.count; k++)
+        {
+            if (target.find(from.magnetIds[k]) < 0 && alpha < 1.0f)
+                output.set(from.magnetIds[k], from.currents[k] * (1.0f - alpha));
+        }
+    }
+    output.generation = target.generation;
+
+    // 3. Total budget (only binds if a frame was built over it)
+    float sum = 0.0f;
+    for (int k = 0; k < output.count; k++)
+        sum += output.currents[k];
+    if (sum > total_budget && sum > 0.0f)
+    {
+        float scale = total_budget / sum;
+        for (int k = 0; k < output.count; k++)
+            output.currents[k] *= scale;
+    }
+
+    return output;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "control_frame.h"
+
+// Crossfades the fast loop's setpoints from one ControlFrame to the next.
+//
+// When the solver switches magnets, stepping straight to the new frame drops
+// the outgoing coil to zero at once while the incoming coil is still rising
+// through its PI loop, which shows up as a torque dip. Instead, every magnet
+// in either frame can be interpolated linearly over `ramp_ticks` fast-loop
+// ticks. Only a change in the set of magnets starts a ramp: a frame that just
+// updates the currents of the same magnets retargets the ramp in progress (or
+// is driven as-is), so a new frame every slow tick never restarts it.
+//
+// The ramp is capped below one slow tick by the caller (start's max_ticks), so
+// it always completes before the next frame can switch magnets again.
+//
+// The blend of two frames never exceeds the larger of their totals, so the
+// budget only rescales frames that were built over it (see
+// ControlFrame::kMaxFrameCurrent); solver frames pass through unchanged.
+//
+// Off by default: in ball_sim (--transition-ticks) the crossfade lowered
+// NNLS ripple but raised heading error and settling time with every
+// allocator, and made the default pair search worse on all three.
+class TransitionScheduler
+{
+private:
+    int ramp_ticks = 0;                                  // fast-loop ticks per magnet switch (0 = step immediately)
+    float total_budget = ControlFrame::kMaxFrameCurrent; // max sum of setpoints (A)
+    int active_ticks = 0;                                // length of the ramp in progress
+
+    ControlFrame from;   // setpoints when the transition started
+    ControlFrame target; // frame being ramped towards
+    ControlFrame output; // setpoints for the current tick
+    int tick = 0;
+
+public:
+    TransitionScheduler() = default;
+
+    void setRampTicks(int ticks) { ramp_ticks = (ticks < 0) ? 0 : ticks; }
+    int getRampTicks() const { return ramp_ticks; }
+
+    void setTotalBudget(float amps) { total_budget = amps; }
+    float getTotalBudget() const { return total_budget; }
+
+    // Take `frame` as the new target. If its magnets differ from the current
+    // target's, ramp from the current output over min(ramp_ticks, max_ticks)
+    // ticks; otherwise keep the ramp in progress, now heading for `frame`.
+    void start(const ControlFrame &frame, int max_ticks);
+
+    // Advance one fast-loop tick and return the setpoints to drive now.
+    // Magnets that have ramped fully out are no longer listed.
+    const ControlFrame &step();
+
+    const ControlFrame &current() const { return output; }
+    bool inTransition() const { return tick < active_ticks; }
+};
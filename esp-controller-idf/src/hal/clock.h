@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+namespace hal
+{
+// Microseconds since boot on the board's monotonic timer (esp_timer on the
+// ESP32). The POSIX backend may run it from simulated time instead.
+int64_t micros();
+
+// std::chrono clock on top of micros(). Sample timestamps use it instead of
+// steady_clock so the whole controller follows whichever time the backend
+// provides.
+struct Clock
+{
+    using duration = std::chrono::microseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<Clock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept { return time_point(duration(micros())); }
+};
+} // namespace hal
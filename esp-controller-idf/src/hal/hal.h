@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "clock.h"
+#include "../core/global_state.h"
+
+// Hardware abstraction for everything above the drivers: GlobalState, the
+// controller, calibration, the state machine and comms only reach the board
+// through these calls.
+//
+// Two backends implement it: hal_esp.cpp (ESP-IDF drivers, built into the
+// firmware) and host/hal/hal_posix.cpp (Linux, for running the controller as
+// a native executable). Mutexes and tasks keep using the FreeRTOS API, which
+// host/stubs maps onto std::mutex and std::thread.
+
+// Samples read from the IMU since the last poll, oldest first
+struct IMUData
+{
+    std::vector<AngularVelocity> angular_velocity;
+    std::vector<Orientation> orientation;
+};
+
+namespace hal
+{
+// Brings up the ADCs, PWM drivers, IMU, serial port and WiFi
+void init(int adc_clock_speed_hz, int uart_baud_rate);
+
+// Raw 12-bit reading of one current sense channel
+uint16_t adcRead(const ADCAddress &address);
+
+// Sets one coil's PWM duty, 0..255
+void pwmWrite(const PWMAddress &address, int duty_0_255);
+
+// Reads whatever the IMU has pending. Returns empty vectors if nothing is.
+IMUData imuPoll();
+
+// Orientation report interval the IMU was set up with (0 before init)
+uint32_t imuOrientationIntervalUs();
+
+// SH-2 report ID of the orientation report the IMU was set up with (0 before
+// init). The rotation vector's heading follows the magnetometer; the game
+// rotation vector's heading starts wherever the sensor powered up.
+constexpr uint8_t IMU_ROTATION_VECTOR = 0x05;
+constexpr uint8_t IMU_GAME_ROTATION_VECTOR = 0x08;
+uint8_t imuOrientationReportId();
+
+// Writes raw bytes to the serial console
+void serialWrite(const char *data, size_t length);
+
+// Small non-volatile key/value storage, grouped in namespaces (NVS on the
+// ESP32). load returns true only if a value of exactly `size` bytes is stored
+// under `key`; save returns false on a storage error.
+bool storageLoad(const char *space, const char *key, void *data, size_t size);
+bool storageSave(const char *space, const char *key, const void *data, size_t size);
+void storageErase(const char *space, const char *key);
+
+// Starts the over-the-air firmware update server
+void startUpdateServer();
+} // namespace hal
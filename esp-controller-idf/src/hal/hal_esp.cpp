@@ -0,0 +1,122 @@
+// ESP-IDF backend of the HAL: thin wrappers over the drivers in
+// core/peripherals.cpp, esp_timer, the UART and NVS. ADC samples, IMU packets
+// and PWM writes pass through the trace recorder (trace.h).
+
+#include "hal.h"
+#include "trace.h"
+#include "../core/peripherals.h"
+#include "../ota/ota_update.h"
+
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *HAL_TAG = "HAL";
+
+namespace hal
+{
+void init(int adc_clock_speed_hz, int uart_baud_rate)
+{
+    init_peripherals(adc_clock_speed_hz, uart_baud_rate);
+}
+
+uint16_t adcRead(const ADCAddress &address)
+{
+    uint16_t value = adc1283_read(address.adc_gpio_address, address.channel);
+    trace::recordAdc(address, value);
+    return value;
+}
+
+void pwmWrite(const PWMAddress &address, int duty_0_255)
+{
+    trace::recordPwm(address, duty_0_255);
+    pca9685_set_pwm(address.driver_i2c_address, address.channel, duty_0_255);
+}
+
+IMUData imuPoll()
+{
+    // One poller at a time (the IMU task), as with shtp_service's buffer
+    static uint8_t packet[MAX_PACKET_LEN];
+    uint16_t length = shtp_read_packet(packet, sizeof(packet));
+    if (length == 0)
+        return IMUData();
+
+    trace::recordShtpPacket(packet, length);
+    return shtp_parse_packet(packet, length);
+}
+
+uint32_t imuOrientationIntervalUs()
+{
+    return imu_orientation_interval_us();
+}
+
+uint8_t imuOrientationReportId()
+{
+    return imu_orientation_report_id();
+}
+
+int64_t micros()
+{
+    return esp_timer_get_time();
+}
+
+void serialWrite(const char *data, size_t length)
+{
+    uart_write_bytes(UART_NUM_0, data, length);
+}
+
+bool storageLoad(const char *space, const char *key, void *data, size_t size)
+{
+    nvs_handle_t handle;
+    if (nvs_open(space, NVS_READONLY, &handle) != ESP_OK)
+        return false; // Namespace is created on the first save
+
+    size_t length = size;
+    esp_err_t err = nvs_get_blob(handle, key, data, &length);
+    nvs_close(handle);
+
+    if (err != ESP_OK)
+    {
+        if (err != ESP_ERR_NVS_NOT_FOUND)
+            ESP_LOGW(HAL_TAG, "Reading %s/%s failed: %s", space, key, esp_err_to_name(err));
+        return false;
+    }
+    return length == size;
+}
+
+bool storageSave(const char *space, const char *key, const void *data, size_t size)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(space, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, key, data, size);
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(HAL_TAG, "Writing %s/%s failed: %s", space, key, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void storageErase(const char *space, const char *key)
+{
+    nvs_handle_t handle;
+    if (nvs_open(space, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    if (nvs_erase_key(handle, key) == ESP_OK)
+        nvs_commit(handle);
+    nvs_close(handle);
+}
+
+void startUpdateServer()
+{
+    startOtaUpdateTask();
+}
+} // namespace hal
@@ -0,0 +1,294 @@
+#include "trace.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace trace
+{
+namespace
+{
+// Largest event header: type byte plus two 10-byte varints (time, length)
+constexpr size_t MAX_EVENT_OVERHEAD = 1 + 10 + 10;
+
+std::atomic<bool> s_recording{false};
+bool s_record_outputs = false;
+
+SemaphoreHandle_t s_mutex = nullptr;
+uint8_t *s_buffer = nullptr;
+size_t s_capacity = 0;
+size_t s_length = 0;
+int64_t s_last_time_us = 0;
+
+size_t putVarint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+void putU16(uint8_t *out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+// Appends one event; on overflow marks the trace truncated and stops. Call
+// with s_mutex held.
+void append(EventType type, const uint8_t *fixed, size_t fixed_length, const void *bytes, size_t length, bool with_length)
+{
+    if (!s_recording.load(std::memory_order_relaxed))
+        return;
+
+    if (s_length + MAX_EVENT_OVERHEAD + fixed_length + length > s_capacity)
+    {
+        putU16(s_buffer + 6, FLAG_TRUNCATED | (s_record_outputs ? FLAG_OUTPUTS : 0));
+        s_recording.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    int64_t now_us = hal::micros();
+    uint64_t delta_us = now_us > s_last_time_us ? static_cast<uint64_t>(now_us - s_last_time_us) : 0;
+    s_last_time_us += static_cast<int64_t>(delta_us);
+
+    uint8_t *out = s_buffer + s_length;
+    size_t n = 0;
+    out[n++] = static_cast<uint8_t>(type);
+    n += putVarint(out + n, delta_us);
+    if (fixed_length > 0)
+    {
+        memcpy(out + n, fixed, fixed_length);
+        n += fixed_length;
+    }
+    if (with_length)
+    {
+        n += putVarint(out + n, length);
+        memcpy(out + n, bytes, length);
+        n += length;
+    }
+    s_length += n;
+}
+
+void record(EventType type, const uint8_t *fixed, size_t fixed_length, const void *bytes = nullptr, size_t length = 0, bool with_length = false)
+{
+    if (!s_recording.load(std::memory_order_relaxed))
+        return;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    append(type, fixed, fixed_length, bytes, length, with_length);
+    xSemaphoreGive(s_mutex);
+}
+} // namespace
+
+bool start(size_t capacity, bool record_outputs, const void *config, size_t config_size)
+{
+    if (s_mutex == nullptr)
+        s_mutex = xSemaphoreCreateMutex();
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool started = false;
+    if (!s_recording.load())
+    {
+        std::free(s_buffer);
+        s_length = 0;
+        s_capacity = capacity;
+        s_buffer = static_cast<uint8_t *>(std::malloc(capacity));
+        if (s_buffer != nullptr && capacity >= HEADER_SIZE + MAX_EVENT_OVERHEAD + config_size)
+        {
+            s_record_outputs = record_outputs;
+            s_last_time_us = hal::micros();
+
+            memcpy(s_buffer, "BTRC", 4);
+            putU16(s_buffer + 4, VERSION);
+            putU16(s_buffer + 6, record_outputs ? FLAG_OUTPUTS : 0);
+            for (int i = 0; i < 8; i++)
+                s_buffer[8 + i] = static_cast<uint8_t>(static_cast<uint64_t>(s_last_time_us) >> (8 * i));
+            s_length = HEADER_SIZE;
+
+            s_recording.store(true);
+            append(EventType::Config, nullptr, 0, config, config_size, true);
+            started = true;
+        }
+        else
+        {
+            std::free(s_buffer);
+            s_buffer = nullptr;
+            s_capacity = 0;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+    return started;
+}
+
+void stop()
+{
+    if (s_mutex == nullptr)
+        return;
+    // Taking the mutex waits out any event being written
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_recording.store(false);
+    xSemaphoreGive(s_mutex);
+}
+
+bool recording()
+{
+    return s_recording.load(std::memory_order_relaxed);
+}
+
+const uint8_t *data()
+{
+    return s_buffer;
+}
+
+size_t size()
+{
+    return s_length;
+}
+
+void release()
+{
+    stop();
+    std::free(s_buffer);
+    s_buffer = nullptr;
+    s_capacity = 0;
+    s_length = 0;
+}
+
+void recordFastTick()
+{
+    record(EventType::FastTick, nullptr, 0);
+}
+
+void recordSlowTick()
+{
+    record(EventType::SlowTick, nullptr, 0);
+}
+
+void recordZeroControl()
+{
+    record(EventType::ZeroControl, nullptr, 0);
+}
+
+void recordAdc(const ADCAddress &address, uint16_t value)
+{
+    if (!s_recording.load(std::memory_order_relaxed))
+        return;
+    uint8_t fixed[4] = {static_cast<uint8_t>(address.adc_gpio_address), static_cast<uint8_t>(address.channel),
+                        static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)};
+    record(EventType::Adc, fixed, sizeof(fixed));
+}
+
+void recordPwm(const PWMAddress &address, int duty_0_255)
+{
+    if (!s_recording.load(std::memory_order_relaxed) || !s_record_outputs)
+        return;
+    int duty = duty_0_255 < 0 ? 0 : (duty_0_255 > 255 ? 255 : duty_0_255);
+    uint8_t fixed[3] = {static_cast<uint8_t>(address.driver_i2c_address), static_cast<uint8_t>(address.channel),
+                        static_cast<uint8_t>(duty)};
+    record(EventType::Pwm, fixed, sizeof(fixed));
+}
+
+void recordShtpPacket(const uint8_t *packet, size_t length)
+{
+    record(EventType::ShtpPacket, nullptr, 0, packet, length, true);
+}
+
+void recordCommand(const void *command, size_t length)
+{
+    record(EventType::Command, nullptr, 0, command, length, true);
+}
+
+Reader::Reader(const uint8_t *data, size_t size) : data(data), size(size)
+{
+    if (size < HEADER_SIZE || memcmp(data, "BTRC", 4) != 0)
+        return;
+    if ((data[4] | (data[5] << 8)) != VERSION)
+        return;
+    header_flags = static_cast<uint16_t>(data[6] | (data[7] << 8));
+    uint64_t start_us = 0;
+    for (int i = 0; i < 8; i++)
+        start_us |= static_cast<uint64_t>(data[8 + i]) << (8 * i);
+    time_us = static_cast<int64_t>(start_us);
+    header_ok = true;
+}
+
+bool Reader::readVarint(uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (cursor >= size)
+            return false;
+        uint8_t byte = data[cursor++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool Reader::next(Event &event)
+{
+    if (!header_ok || malformed || cursor >= size)
+        return false;
+
+    uint8_t type = data[cursor++];
+    uint64_t delta_us;
+    if (!readVarint(delta_us))
+    {
+        malformed = true;
+        return false;
+    }
+    time_us += static_cast<int64_t>(delta_us);
+
+    size_t length = 0;
+    switch (static_cast<EventType>(type))
+    {
+    case EventType::FastTick:
+    case EventType::SlowTick:
+    case EventType::ZeroControl:
+        break;
+    case EventType::Adc:
+        length = 4;
+        break;
+    case EventType::Pwm:
+        length = 3;
+        break;
+    case EventType::Config:
+    case EventType::ShtpPacket:
+    case EventType::Command:
+    {
+        uint64_t value;
+        if (!readVarint(value) || value > size)
+        {
+            malformed = true;
+            return false;
+        }
+        length = static_cast<size_t>(value);
+        break;
+    }
+    default:
+        malformed = true;
+        return false;
+    }
+
+    if (length > size - cursor)
+    {
+        malformed = true;
+        return false;
+    }
+    event.type = static_cast<EventType>(type);
+    event.time_us = time_us;
+    event.payload = data + cursor;
+    event.length = length;
+    cursor += length;
+    return true;
+}
+} // namespace trace
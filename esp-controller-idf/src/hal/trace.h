@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+// Record/replay of everything the control loops read from the outside world.
+//
+// While recording, the HAL and the loops append timestamped events to a RAM
+// buffer: every ADC sample, every raw SHTP packet from the IMU, every
+// dashboard command, a marker per fast and slow loop tick and, optionally,
+// every PWM write. host/replay feeds a trace back through the unmodified
+// firmware code on the recorded clock, so two builds can be compared on
+// bit-identical input.
+//
+// Format, little endian:
+//   header  "BTRC", u16 version, u16 flags, i64 hal::micros() at start
+//   event   u8 type, varint microseconds since the previous event, payload
+// Payloads:
+//   Adc                  u8 chip select GPIO, u8 channel, u16 raw value
+//   Pwm                  u8 driver I2C address, u8 channel, u8 duty
+//   Config, ShtpPacket,
+//   Command              varint length, bytes
+//   FastTick, SlowTick,
+//   ZeroControl          none
+// Varints are unsigned LEB128. The first event is always Config (opaque
+// here; core/trace_session.h defines it).
+namespace trace
+{
+constexpr uint16_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+
+enum class EventType : uint8_t
+{
+    Config = 1,
+    FastTick = 2,    // GlobalState::currentControlLoop starts
+    SlowTick = 3,    // the control task takes the IMU sample and runs the solver
+    Adc = 4,
+    Pwm = 5,
+    ShtpPacket = 6,
+    Command = 7,     // a DashboardCommand as received
+    ZeroControl = 8, // GlobalState::zeroControl (stop, recalibration)
+};
+
+// Header flags
+constexpr uint16_t FLAG_OUTPUTS = 1u << 0;   // Pwm events were recorded
+constexpr uint16_t FLAG_TRUNCATED = 1u << 1; // the buffer filled up; recording stopped early
+
+// Allocates `capacity` bytes and starts recording with a Config event holding
+// `config`. Returns false if already recording or the allocation fails.
+// Drops any previous trace.
+bool start(size_t capacity, bool record_outputs, const void *config, size_t config_size);
+
+// Stops recording. The trace stays in memory until release() or the next start().
+void stop();
+
+bool recording();
+const uint8_t *data();
+size_t size();
+void release();
+
+// Hooks for the HAL and the control loops: no-ops unless recording, safe from
+// any task.
+void recordFastTick();
+void recordSlowTick();
+void recordZeroControl();
+void recordAdc(const ADCAddress &address, uint16_t value);
+void recordPwm(const PWMAddress &address, int duty_0_255);
+void recordShtpPacket(const uint8_t *packet, size_t length);
+void recordCommand(const void *command, size_t length);
+
+struct Event
+{
+    EventType type;
+    int64_t time_us;          // on the recording's hal::micros() clock
+    const uint8_t *payload;   // points into the trace
+    size_t length;
+};
+
+// Walks the events of a trace held in memory
+class Reader
+{
+public:
+    Reader(const uint8_t *data, size_t size);
+
+    // False if the header is missing or from another version
+    bool valid() const { return header_ok; }
+    uint16_t flags() const { return header_flags; }
+
+    // Next event. Returns false at the end, or at a malformed event (failed()).
+    bool next(Event &event);
+    bool failed() const { return malformed; }
+
+private:
+    bool readVarint(uint64_t &value);
+
+    const uint8_t *data;
+    size_t size;
+    size_t cursor = HEADER_SIZE;
+    int64_t time_us = 0;
+    uint16_t header_flags = 0;
+    bool header_ok = false;
+    bool malformed = false;
+};
+} // namespace trace
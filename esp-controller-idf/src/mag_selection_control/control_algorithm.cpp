@@ -1,47 +1,126 @@
 #include "control_algorithm.h"
 
-// Singleton instance of the BallController
-static BallController *g_controller = nullptr;
+#include "utils/profile.h"
+
+// Gyro-based extrapolation of the orientation to the actuation instant
+static OrientationPredictor g_predictor;
+
+// Current allocator used by computeControl
+static AllocationMode g_allocation_mode = AllocationMode::PAIR_SEARCH;
+
+void setAllocationMode(AllocationMode mode)
+{
+    g_allocation_mode = mode;
+}
+
+AllocationMode getAllocationMode()
+{
+    return g_allocation_mode;
+}
+
+// Outer loop turning the joystick target plus gyro rate into the solver's drive command
+static OuterLoopController g_outer_loop;
+static hal::Clock::time_point g_last_control_time;
+
+// Last parameters handed to the outer loop, kept on the setter's side so
+// changes can be built on them without reading the control task's copy
+static OuterLoopParams g_requested_outer_loop;
+
+OuterLoopController &getOuterLoopController()
+{
+    return g_outer_loop;
+}
+
+void setOuterLoopParams(const OuterLoopParams &params)
+{
+    g_requested_outer_loop = params;
+    g_outer_loop.setParams(params);
+}
+
+OuterLoopParams getOuterLoopParams()
+{
+    return g_requested_outer_loop;
+}
+
+OrientationPredictor &getOrientationPredictor()
+{
+    return g_predictor;
+}
+
+void setOrientationPredictionEnabled(bool enabled)
+{
+    g_predictor.setEnabled(enabled);
+}
 
 BallController &getControllerInstance()
 {
-    if (g_controller == nullptr)
-    {
-        g_controller = new BallController();
-    }
-    return *g_controller;
+    // The one controller: calibration publishes into it and computeControl
+    // solves with it
+    static BallController controller;
+    return controller;
 }
 
+static_assert(BallController::MAX_ACTIVE_MAGNETS <= ControlFrame::kCapacity, "ControlFrame must hold every solver output");
+
 // Compute control outputs using BallController solver
-// Takes orientation and target direction, returns control for one magnet
-// TODO: Update to return vector for dual magnet operation
-std::vector<ControlOutputs> computeControl(const std::vector<Orientation> orientation_history, const std::vector<AngularVelocity> angular_velocity_history, const Vector3 targetDirection)
+// Takes orientation and target direction, fills the frame with up to
+// MAX_ACTIVE_MAGNETS setpoints
+void computeControl(const std::vector<Orientation> &orientation_history, const std::vector<AngularVelocity> &angular_velocity_history, const Vector3 &targetDirection, ControlFrame &frame)
 {
-    
+    frame.clear();
 
     // Use the most recent orientation
     if (orientation_history.empty())
     {
-        return {};
+        return;
     }
 
     const Orientation &latest_orient = orientation_history.back();
     Quaternion q(latest_orient.w, latest_orient.x, latest_orient.y, latest_orient.z);
 
+    // Extrapolate to when the coils will actually be driven
+    if (!angular_velocity_history.empty())
+    {
+        q = g_predictor.predict(latest_orient, angular_velocity_history.back(), hal::Clock::now());
+    }
+
     // Get the ball controller instance
     BallController &controller = getControllerInstance();
 
-    // Prepare output array for up to 2 magnets
-    MagnetCommand outputs[2];
-    int num_magnets = controller.solve(targetDirection.x, targetDirection.y, q, outputs);
+    // Outer loop: combine the target with the measured rolling rate
+    float drive_x = targetDirection.x;
+    float drive_y = targetDirection.y;
+    if (!angular_velocity_history.empty())
+    {
+        hal::Clock::time_point now = hal::Clock::now();
+        float dt = std::chrono::duration<float>(now - g_last_control_time).count();
+        g_last_control_time = now;
+        if (dt < 0.0f || dt > 0.05f)
+        {
+            // First tick or after a pause (a stop, a reset): don't integrate
+            // the gap, and drop what was integrated before it
+            dt = 0.0f;
+            g_outer_loop.reset();
+        }
 
-    // Return the first magnet command
-    // TODO: Update GlobalState and statemachine to handle multiple magnet outputs
-    std::vector<ControlOutputs> controlOutputs;  
-    for (auto& output: outputs)
+        g_outer_loop.update(targetDirection.x, targetDirection.y, q, angular_velocity_history.back(),
+                            controller.getYawOffset(), dt, drive_x, drive_y);
+    }
+
+    // Prepare output array (pair search uses at most the first 2 entries)
+    MagnetCommand outputs[BallController::MAX_ACTIVE_MAGNETS];
+    int num_magnets;
     {
-        controlOutputs.push_back(ControlOutputs(outputs[0].id, outputs[0].current));
+        PROFILE_ZONE("solve");
+        if (g_allocation_mode == AllocationMode::NNLS)
+            num_magnets = controller.solveNNLS(drive_x, drive_y, q, outputs);
+        else
+            num_magnets = controller.solve(drive_x, drive_y, q, outputs);
     }
 
-    return {};
+    // Solver IDs are magnet indices (0-19); GlobalState uses 1-based magnet IDs
+    for (int k = 0; k < num_magnets; k++)
+    {
+        frame.set(outputs[k].id + 1, outputs[k].current);
+    }
 }
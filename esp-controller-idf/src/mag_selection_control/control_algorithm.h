@@ -2,11 +2,34 @@
 
 #include "../core/global_state.h"
 #include "../control/BallController.h"
+#include "../control/OrientationPredictor.h"
+#include "../control/OuterLoopController.h"
 #include <vector>
 
-// Compute control outputs for a single magnet
-// Returns a ControlOutputs with current command, or zero if no magnet should fire
-std::vector<ControlOutputs> computeControl(const std::vector<Orientation> orientation_history, const std::vector<AngularVelocity> angular_velocity_history, const Vector3 targetDirection);
+// Compute the magnet setpoints for one slow-loop tick into `frame` (1-based
+// magnet IDs). Never allocates; an empty frame means every magnet is off.
+void computeControl(const std::vector<Orientation> &orientation_history, const std::vector<AngularVelocity> &angular_velocity_history, const Vector3 &targetDirection, ControlFrame &frame);
 
-// Internal helper to get singleton BallController instance
+// The singleton BallController shared by calibration and computeControl
 BallController &getControllerInstance();
+
+// How computeControl turns the target force into coil currents
+enum class AllocationMode
+{
+    PAIR_SEARCH, // Exhaustive single/pair search (BallController::solve)
+    NNLS         // Bounded k-magnet least squares (BallController::solveNNLS)
+};
+void setAllocationMode(AllocationMode mode);
+AllocationMode getAllocationMode();
+
+// Gyro-based orientation prediction used by computeControl (enabled by default)
+OrientationPredictor &getOrientationPredictor();
+void setOrientationPredictionEnabled(bool enabled);
+
+// Outer loop between the joystick target and the solver (DIRECT by default).
+// setOuterLoopParams hands new parameters to the control task, which applies
+// them at its next update; getOuterLoopParams returns the last ones handed
+// over, pending or not. Call both from one task (the command receiver).
+OuterLoopController &getOuterLoopController();
+void setOuterLoopParams(const OuterLoopParams &params);
+OuterLoopParams getOuterLoopParams();
@@ -1,16 +1,18 @@
 #include "bench_test.h"
 
-#include <core/peripherals.h>
+#include <hal/hal.h>
 
 // in test 1 we will sweep through turning each magnet on one by one for 1 second each.
 #include "core/global_state.h"
 #include "utils/utils.h"
+#include "control/OrientationPredictor.h"
+#include "control/BallController.h"
+#include "control/fast_math.h"
 
-#include "esp_timer.h"
+#include "esp_cpu.h"
 
 #include <cstdint>
 #include <string>
-#include <esp_rom_sys.h>
 #include <cmath>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -26,11 +28,11 @@ void run_control_loop_for_seconds(GlobalState& instance, float duration_s) {
         return;
     }
 
-    const int64_t end_us = esp_timer_get_time() + static_cast<int64_t>(duration_s * 1000000.0f);
-    int64_t next_us = esp_timer_get_time();
+    const int64_t end_us = hal::micros() + static_cast<int64_t>(duration_s * 1000000.0f);
+    int64_t next_us = hal::micros();
     
-    while (esp_timer_get_time() < end_us) {
-        int64_t now_us = esp_timer_get_time();
+    while (hal::micros() < end_us) {
+        int64_t now_us = hal::micros();
         if (now_us >= next_us) {
             instance.currentControlLoop();
             next_us += interval_us;
@@ -46,7 +48,7 @@ void test_adc_isolated() {
         std::vector<uint16_t> values;
         for (gpio_num_t num : {GPIO_NUM_27, GPIO_NUM_32, GPIO_NUM_33}) {
             for (int channel = 0; channel < 8; ++channel) {
-                uint16_t value = adc1283_read(num, channel);
+                uint16_t value = hal::adcRead(ADCAddress(num, channel));
 
                 values.push_back(value);
             }
@@ -116,7 +118,7 @@ void test_1() {
 
     for (int magnetId = 1; magnetId <= 20; ++magnetId) {
         PWMAddress add = instance.getPWMAddress(magnetId); // Pre-cache addresses to avoid timing issues in the loop
-        pca9685_set_pwm(add.driver_i2c_address, add.channel, 0); // Ensure all magnets start at 0
+        hal::pwmWrite(add, 0); // Ensure all magnets start at 0
     }
 
 
@@ -339,9 +341,9 @@ void test_5() {
             instance.setControl(ControlOutputs(magnet_ids[i], random_value));
         }
 
-        int64_t start_us = esp_timer_get_time();
+        int64_t start_us = hal::micros();
         run_control_loop_for_seconds(instance, interval_s);
-        int64_t end_us = esp_timer_get_time();
+        int64_t end_us = hal::micros();
 
         float avg_us = static_cast<float>(end_us - start_us) / static_cast<float>(iterations);
 
@@ -359,18 +361,36 @@ void test_5() {
 // ...existing code...
 
 void test_imu() {
-    printf("\nStarting IMU test\n");
+    printf("\nStarting IMU test (configured orientation interval: %u us)\n",
+           static_cast<unsigned>(hal::imuOrientationIntervalUs()));
+
+    int orientation_count = 0;
+    int gyro_count = 0;
+    int64_t window_start_us = hal::micros();
 
     while (true) {
-        vTaskDelay(pdMS_TO_TICKS(10)); // 100 Hz
-        // Poll IMU once per cycle (10 ms)
+        vTaskDelay(pdMS_TO_TICKS(1)); // Poll faster than the fastest profile (400 Hz)
         IMUData data = readIMU(); // Ensure we process incoming IMU data
 
 
         std::vector<Orientation> orientations = data.orientation;
         std::vector<AngularVelocity> angularVelocity = data.angular_velocity;
-        for (auto& orientation: orientations) {
-            printf("Orientation: w=%.3f x=%.3f y=%.3f z=%.3f\n", orientation.w, orientation.x, orientation.y, orientation.z);
+        orientation_count += orientations.size();
+        gyro_count += angularVelocity.size();
+
+        // Report the achieved report rates once per second
+        int64_t now_us = hal::micros();
+        if (now_us - window_start_us >= 1000000) {
+            float window_s = (now_us - window_start_us) / 1000000.0f;
+            printf("IMU rates: orientation %.1f Hz, gyro %.1f Hz\n",
+                   orientation_count / window_s, gyro_count / window_s);
+            if (!orientations.empty()) {
+                const Orientation& orientation = orientations.back();
+                printf("Orientation: w=%.3f x=%.3f y=%.3f z=%.3f\n", orientation.w, orientation.x, orientation.y, orientation.z);
+            }
+            orientation_count = 0;
+            gyro_count = 0;
+            window_start_us = now_us;
         }
         // printf("Angular Velocity: x=%.3f y=%.3f z=%.3f\n", instance.getAngularVelocity().x, instance.getAngularVelocity().y, instance.getAngularVelocity().z);
 
@@ -380,3 +400,242 @@ void test_imu() {
 
 // ...existing code...
 
+
+// Records an IMU trace while the ball is moved by hand, then replays it through
+// the OrientationPredictor and compares the prediction error against simply
+// holding the last sample (what computeControl did before prediction existed).
+namespace {
+float quaternion_angle_between(const Quaternion &a, const Quaternion &b) {
+    float d = fabsf(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+    if (d > 1.0f) d = 1.0f;
+    return 2.0f * acosf(d);
+}
+} // namespace
+
+void test_orientation_prediction() {
+    printf("\nStarting orientation prediction test: move the ball around for 10 s\n");
+
+    const int kMaxSamples = 1000;
+    std::vector<Orientation> orientations;
+    std::vector<AngularVelocity> rates;
+    orientations.reserve(kMaxSamples);
+    rates.reserve(kMaxSamples);
+
+    AngularVelocity latest_rate(0.0f, 0.0f, 0.0f);
+    bool have_rate = false;
+    const int64_t end_us = hal::micros() + 10 * 1000000;
+
+    while (hal::micros() < end_us && static_cast<int>(orientations.size()) < kMaxSamples) {
+        IMUData data = readIMU();
+        for (auto &rate : data.angular_velocity) {
+            latest_rate = rate;
+            have_rate = true;
+        }
+        // Pair every orientation sample with the newest gyro sample seen so far
+        for (auto &orientation : data.orientation) {
+            if (!have_rate) continue;
+            orientations.push_back(orientation);
+            rates.push_back(latest_rate);
+        }
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+
+    printf("Recorded %d samples\n", static_cast<int>(orientations.size()));
+
+    // Evaluate for lookaheads of 1..3 samples (~10..30 ms at 100 Hz)
+    for (int lookahead = 1; lookahead <= 3; ++lookahead) {
+        float hold_sum = 0.0f, hold_max = 0.0f;
+        float pred_sum = 0.0f, pred_max = 0.0f;
+        int count = 0;
+
+        for (size_t k = 0; k + lookahead < orientations.size(); ++k) {
+            const Orientation &now = orientations[k];
+            const Orientation &future = orientations[k + lookahead];
+            float dt = std::chrono::duration<float>(future.timestamp - now.timestamp).count();
+
+            Quaternion q_now(now.w, now.x, now.y, now.z);
+            Quaternion q_future(future.w, future.x, future.y, future.z);
+            Quaternion q_pred = OrientationPredictor::integrate(q_now, rates[k], dt);
+
+            float hold_err = quaternion_angle_between(q_now, q_future);
+            float pred_err = quaternion_angle_between(q_pred, q_future);
+            hold_sum += hold_err;
+            pred_sum += pred_err;
+            if (hold_err > hold_max) hold_max = hold_err;
+            if (pred_err > pred_max) pred_max = pred_err;
+            count++;
+        }
+
+        if (count == 0) continue;
+        const float rad_to_deg = 57.29578f;
+        printf("Lookahead %d samples | hold: mean %.3f deg max %.3f deg | predicted: mean %.3f deg max %.3f deg\n",
+               lookahead,
+               hold_sum / count * rad_to_deg, hold_max * rad_to_deg,
+               pred_sum / count * rad_to_deg, pred_max * rad_to_deg);
+    }
+}
+
+
+void test_solver_nnls() {
+    printf("\nStarting NNLS allocation comparison\n");
+
+    BallController pair_solver;
+    BallController nnls_solver;
+
+    // Slowly tumbling ball with a sweeping joystick, so the warm start is exercised
+    // the same way the slow loop would exercise it.
+    const int kTicks = 2000;
+    const float kDt = 0.01f;
+    const float kScale = 20.0f; // push the target far enough that the current limits bind
+    AngularVelocity w(0.8f, -0.5f, 0.3f);
+    Quaternion q;
+
+    float pair_error = 0.0f, nnls_error = 0.0f;
+    float pair_current = 0.0f, nnls_current = 0.0f;
+    uint32_t pair_cycles = 0, nnls_cycles = 0;
+    int three_plus = 0;
+
+    for (int i = 0; i < kTicks; ++i) {
+        q = OrientationPredictor::integrate(q, w, kDt);
+        float angle = i * kDt * 0.7f;
+        float joy_x = kScale * cosf(angle);
+        float joy_y = kScale * sinf(angle);
+
+        MagnetCommand a[BallController::MAX_ACTIVE_MAGNETS] = {};
+        MagnetCommand b[BallController::MAX_ACTIVE_MAGNETS] = {};
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        int count_a = pair_solver.solve(joy_x, joy_y, q, a);
+        pair_cycles += esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        int count_b = nnls_solver.solveNNLS(joy_x, joy_y, q, b);
+        nnls_cycles += esp_cpu_get_cycle_count() - start;
+
+        pair_error += pair_solver.allocationError(joy_x, joy_y, q, a, count_a);
+        nnls_error += nnls_solver.allocationError(joy_x, joy_y, q, b, count_b);
+        for (int k = 0; k < count_a; ++k) pair_current += a[k].current;
+        for (int k = 0; k < count_b; ++k) nnls_current += b[k].current;
+        if (count_b >= 3) three_plus++;
+    }
+
+    printf("Pair search: avg rel error %.3f, avg total %.2f A, avg %u cycles\n",
+           pair_error / kTicks, pair_current / kTicks, static_cast<unsigned>(pair_cycles / kTicks));
+    printf("NNLS (k<=3): avg rel error %.3f, avg total %.2f A, avg %u cycles, %d/%d ticks on 3+ coils\n",
+           nnls_error / kTicks, nnls_current / kTicks, static_cast<unsigned>(nnls_cycles / kTicks),
+           three_plus, kTicks);
+}
+
+void test_solver_incremental() {
+    printf("\nStarting incremental solver comparison\n");
+
+    BallController full;
+    BallController incremental;
+    incremental.setIncremental(true);
+
+    // 100 Hz ticks of a tumbling ball with a slowly sweeping joystick
+    const int kTicks = 3000;
+    const float kDt = 0.01f;
+    AngularVelocity w(0.6f, -0.4f, 0.2f);
+    Quaternion q;
+
+    float full_error = 0.0f, incremental_error = 0.0f;
+    uint32_t full_cycles = 0, incremental_cycles = 0;
+    int full_switches = 0, incremental_switches = 0;
+    int full_prev[2] = {-1, -1}, incremental_prev[2] = {-1, -1};
+
+    for (int i = 0; i < kTicks; ++i) {
+        q = OrientationPredictor::integrate(q, w, kDt);
+        float angle = i * kDt * 0.5f;
+        float joy_x = cosf(angle);
+        float joy_y = sinf(angle);
+
+        MagnetCommand a[2] = {};
+        MagnetCommand b[2] = {};
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        int count_a = full.solve(joy_x, joy_y, q, a);
+        full_cycles += esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        int count_b = incremental.solve(joy_x, joy_y, q, b);
+        incremental_cycles += esp_cpu_get_cycle_count() - start;
+
+        full_error += full.allocationError(joy_x, joy_y, q, a, count_a);
+        incremental_error += incremental.allocationError(joy_x, joy_y, q, b, count_b);
+
+        int ids_a[2] = {count_a > 0 ? a[0].id : -1, count_a > 1 ? a[1].id : -1};
+        int ids_b[2] = {count_b > 0 ? b[0].id : -1, count_b > 1 ? b[1].id : -1};
+        if (ids_a[0] != full_prev[0] || ids_a[1] != full_prev[1]) full_switches++;
+        if (ids_b[0] != incremental_prev[0] || ids_b[1] != incremental_prev[1]) incremental_switches++;
+        full_prev[0] = ids_a[0]; full_prev[1] = ids_a[1];
+        incremental_prev[0] = ids_b[0]; incremental_prev[1] = ids_b[1];
+    }
+
+    printf("Full search: avg rel error %.4f, %d assignment switches, avg %u cycles\n",
+           full_error / kTicks, full_switches, static_cast<unsigned>(full_cycles / kTicks));
+    printf("Incremental: avg rel error %.4f, %d assignment switches, avg %u cycles, hits=%u misses=%u\n",
+           incremental_error / kTicks, incremental_switches, static_cast<unsigned>(incremental_cycles / kTicks),
+           static_cast<unsigned>(incremental.getCacheHits()), static_cast<unsigned>(incremental.getCacheMisses()));
+}
+
+// Times libm against control/fast_math.h on the device. The host bench
+// (host/bench/fast_math_bench.cpp) checks the error bounds, but its timings
+// say little about the ESP32, whose FPU has no sqrt or trig support.
+void test_fast_math() {
+    printf("\nStarting fast math comparison\n");
+
+    const int kIterations = 2000;
+    srand(1357);
+
+    uint32_t libm_cycles[3] = {0, 0, 0};
+    uint32_t fast_cycles[3] = {0, 0, 0};
+    float max_error[3] = {0.0f, 0.0f, 0.0f};
+    volatile float sink = 0.0f;
+
+    for (int i = 0; i < kIterations; ++i) {
+        float x = (rand() % 2001 - 1000) / 100.0f;
+        float y = (rand() % 2001 - 1000) / 100.0f;
+        float angle = (rand() % 2001 - 1000) / 100.0f;
+        float value = (rand() % 10000 + 1) / 100.0f;
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        float exact_atan2 = atan2f(y, x);
+        libm_cycles[0] += esp_cpu_get_cycle_count() - start;
+        start = esp_cpu_get_cycle_count();
+        float fast_atan2 = fast_math::atan2(y, x);
+        fast_cycles[0] += esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        float exact_s = sinf(angle);
+        float exact_c = cosf(angle);
+        libm_cycles[1] += esp_cpu_get_cycle_count() - start;
+        float fast_s, fast_c;
+        start = esp_cpu_get_cycle_count();
+        fast_math::sincos(angle, fast_s, fast_c);
+        fast_cycles[1] += esp_cpu_get_cycle_count() - start;
+
+        start = esp_cpu_get_cycle_count();
+        float exact_sqrt = sqrtf(value);
+        libm_cycles[2] += esp_cpu_get_cycle_count() - start;
+        start = esp_cpu_get_cycle_count();
+        float fast_sqrt = fast_math::sqrt(value);
+        fast_cycles[2] += esp_cpu_get_cycle_count() - start;
+
+        max_error[0] = fmaxf(max_error[0], fabsf(fast_atan2 - exact_atan2));
+        max_error[1] = fmaxf(max_error[1], fmaxf(fabsf(fast_s - exact_s), fabsf(fast_c - exact_c)));
+        max_error[2] = fmaxf(max_error[2], fabsf(fast_sqrt - exact_sqrt) / exact_sqrt);
+        sink = fast_atan2 + fast_s + fast_c + fast_sqrt;
+    }
+    (void)sink;
+
+    const char *names[3] = {"atan2", "sincos", "sqrt"};
+    for (int k = 0; k < 3; ++k) {
+        printf("%-7s libm avg %u cycles, fast avg %u cycles (%.2fx), max error %.2e\n",
+               names[k],
+               static_cast<unsigned>(libm_cycles[k] / kIterations),
+               static_cast<unsigned>(fast_cycles[k] / kIterations),
+               fast_cycles[k] > 0 ? static_cast<float>(libm_cycles[k]) / fast_cycles[k] : 0.0f,
+               max_error[k]);
+    }
+}
@@ -13,3 +13,7 @@ void test_stress_20ms();
 void test_quad_magnet_stress();
 void test_5();
 void test_imu();
+void test_orientation_prediction();
+void test_solver_nnls();
+void test_solver_incremental();
+void test_fast_math();
@@ -1,12 +1,16 @@
 #include <iostream>
-#include "core/peripherals.h"
 #include "core/global_state.h"
 #include "mag_selection_control/control_algorithm.h"
 #include "calibration/calibration.h"
-#include <esp_timer.h>
+#include "calibration/calibration_store.h"
+#include "calibration/coil_identification.h"
+#include "core/imu_task.h"
+#include <hal/hal.h>
+#include <hal/trace.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <comms/wifi_client.h>
 #include <scripts/bench_test.h>
-#include <ota/ota_update.h>
 #include <utils/utils.h>
 #include <cstdlib>
 #include <stdexcept>
@@ -19,9 +23,11 @@ class State;
 class ConnectionState;
 class StandbyState;
 class CalibrateState;
+class ReadyState;
 class RunningState;
 class TestingState;
 void core1LoopTaskTest(void *param);
+void core1LoopTask(void *param);
 
 // ---------------------------------------------------------
 // 1. Base State Interface
@@ -83,6 +89,23 @@ private:
     CalibrateState() = default;
 };
 
+// Calibrated and waiting for the start command (reached from calibration or
+// straight from boot when a stored calibration is valid)
+class ReadyState : public State
+{
+public:
+    static ReadyState &getInstance()
+    {
+        static ReadyState instance;
+        return instance;
+    }
+
+    State *execute() override;
+
+private:
+    ReadyState() = default;
+};
+
 class RunningState : public State
 {
 public:
@@ -121,8 +144,40 @@ private:
 static TaskHandle_t s_udp_sender_handle = NULL;
 static TaskHandle_t s_udp_receiver_handle = NULL;
 static TaskHandle_t s_control_loop_handle = NULL;
+static TaskHandle_t s_imu_task_handle = NULL;
 static bool s_ota_server_started = false;
 
+static void ensure_imu_task()
+{
+    if (s_imu_task_handle == NULL)
+    {
+        // Core 0 so I2C reads from the IMU never stall the current loop on core 1
+        xTaskCreatePinnedToCore(imu_task, "imu", 4096, NULL, 5, &s_imu_task_handle, 0);
+        printf("Started IMU acquisition task on core 0\n");
+    }
+}
+
+static void print_loop_timing()
+{
+    GlobalState &state = GlobalState::instance();
+    TimingStats &imu = imu_read_timing();
+    printf("[TIMING] imu_read n=%u avg=%.0fus max=%uus | fast_loop n=%u avg=%.0fus max=%uus | slow_loop n=%u avg=%.0fus max=%uus\n",
+           static_cast<unsigned>(imu.count.load()), imu.averageUs(), static_cast<unsigned>(imu.max_us.load()),
+           static_cast<unsigned>(state.fastLoopTiming.count.load()), state.fastLoopTiming.averageUs(), static_cast<unsigned>(state.fastLoopTiming.max_us.load()),
+           static_cast<unsigned>(state.slowLoopTiming.count.load()), state.slowLoopTiming.averageUs(), static_cast<unsigned>(state.slowLoopTiming.max_us.load()));
+    imu.reset();
+    state.fastLoopTiming.reset();
+    state.slowLoopTiming.reset();
+
+    BallController &controller = getControllerInstance();
+    if (controller.getIncremental())
+    {
+        printf("[TIMING] solver cache hits=%u misses=%u\n",
+               static_cast<unsigned>(controller.getCacheHits()), static_cast<unsigned>(controller.getCacheMisses()));
+        controller.resetCacheStats();
+    }
+}
+
 static void ensure_udp_sender()
 {
     if (s_udp_sender_handle == NULL)
@@ -154,7 +209,7 @@ static void ensure_single_control_loop_task()
     }
 
     const BaseType_t create_result = xTaskCreatePinnedToCore(
-        core1LoopTaskTest,
+        core1LoopTask,
         "Core1",
         4096,
         NULL,
@@ -170,19 +225,76 @@ static void ensure_single_control_loop_task()
     printf("Started Core 1 control loop task\n");
 }
 
+// Coils may only be driven from here once a stopping control task has exited
+static void wait_for_control_task_exit()
+{
+    while (s_control_loop_handle != NULL)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+// Runs a requested coil identification in place; the caller's state resumes after
+static void run_identification_if_requested()
+{
+    GlobalState &state = GlobalState::instance();
+    if (!state.getIdentificationRequested())
+        return;
+    state.clearIdentificationRequest();
+
+    wait_for_control_task_exit();
+    runCoilIdentification();
+}
+
+// Runs a requested current sense check in place. A gain it corrects is saved
+// with the stored calibration right away when the board is calibrated, and
+// otherwise with the next calibration.
+static void run_current_sense_check_if_requested()
+{
+    GlobalState &state = GlobalState::instance();
+    GlobalState::CurrentSenseCheck request;
+    if (!state.getCurrentSenseCheckRequested(request))
+        return;
+    state.clearCurrentSenseCheckRequest();
+
+    wait_for_control_task_exit();
+    float offset_before, gain_before;
+    state.getCurrentSense(request.magnetId, offset_before, gain_before);
+    checkCurrentSense(request.magnetId, request.duty, request.reference_amps);
+
+    float offset, gain;
+    state.getCurrentSense(request.magnetId, offset, gain);
+    if (gain != gain_before && getControllerInstance().isCalibrated() && saveStoredCalibration(captureCalibration()))
+    {
+        printf("Current sense gain saved\n");
+    }
+}
+
 State *ConnectionState::execute()
 {
     printf("=== ConnectionState: Starting WiFi connection ===\n");
-    init_peripherals(I2C_CLOCK_HZ, SERIAL_BAUD_RATE);
+    hal::init(I2C_CLOCK_HZ, SERIAL_BAUD_RATE);
 
-    // WiFi is initialized in init_peripherals and started with AP mode
+    // WiFi is initialized in hal::init and started with AP mode
     // Wait for WiFi to stabilize
     vTaskDelay(pdMS_TO_TICKS(2000));
 
     printf("WiFi connection established, moving to StandbyState\n");
     GlobalState &state = GlobalState::instance();
+
+    // Run the slow loop at the IMU orientation rate so every new sample is used once
+    const uint32_t imu_interval_us = hal::imuOrientationIntervalUs();
+    if (imu_interval_us > 0)
+    {
+        state.slowLoopTime = imu_interval_us / 1000000.0f;
+        getOrientationPredictor().setActuationLead(0.5f * state.slowLoopTime);
+        printf("Slow loop period set to %.2f ms from IMU profile\n", state.slowLoopTime * 1000.0f);
+    }
     state.setSystemState(GlobalState::SystemState::STANDBY);
 
+    // IMU acquisition runs for the lifetime of the firmware
+    ensure_imu_task();
+
     // Start comms tasks early so the dashboard can detect the connection
     ensure_udp_sender();
     ensure_udp_receiver();
@@ -190,10 +302,29 @@ State *ConnectionState::execute()
     // Start OTA HTTP server so firmware can be flashed via WiFi
     if (!s_ota_server_started)
     {
-        startOtaUpdateTask();
+        hal::startUpdateServer();
         s_ota_server_started = true;
     }
 
+    // A valid stored calibration skips the calibration round trip
+    StoredCalibration stored;
+    bool restored = loadStoredCalibration(stored);
+    if (restored)
+    {
+        applyStoredCalibration(stored);
+    }
+
+    // Nothing has driven the coils yet: take each channel's zero-current reading.
+    // This replaces the restored offsets; they only remain for channels whose
+    // reading auto-zero rejects. Restored gains stay as they are.
+    printf("Current sense auto-zero: %d/20 channels\n", autoZeroCurrentSense());
+
+    if (restored)
+    {
+        printf("Restored stored calibration (yaw offset %.1f deg), moving to ReadyState\n", stored.yaw_offset * 57.2957795f);
+        return &ReadyState::getInstance();
+    }
+
     return &StandbyState::getInstance();
 }
 
@@ -210,6 +341,8 @@ State *StandbyState::execute()
     // Wait for calibration request from dashboard
     while (!state.getCalibrationRequested())
     {
+        run_identification_if_requested();
+        run_current_sense_check_if_requested();
         vTaskDelay(pdMS_TO_TICKS(100)); // Check every 100ms
     }
 
@@ -232,35 +365,87 @@ State *CalibrateState::execute()
     ensure_udp_sender();
     ensure_udp_receiver();
 
-    // Get the next magnet to fire
-    int magnet_id = calibration.startCalibration();
+    // Calibration drives the coils itself: wait for a stopping control task to exit
+    wait_for_control_task_exit();
+
+    // Coils are idle: refresh the current sense zero before firing anything
+    autoZeroCurrentSense();
 
-    // TODO: Apply magnet current to fire the selected magnet
-    // For now, just a placeholder
-    printf("Firing magnet %d for calibration\n", magnet_id);
+    int magnet_id;
+    if (global.getCalibrationAutomatic())
+    {
+        // One short pulse per magnet, direction taken from the IMU
+        while ((magnet_id = calibration.startCalibration()) >= 0)
+        {
+            if (!calibration.measureCalibrationStep())
+                printf("Calibration: no response to magnet %d\n", magnet_id);
+        }
+    }
 
-    // Wait for user input from dashboard (set_direction command)
-    global.clearCalibrationInput();
-    while (!global.getCalibrationInputAvailable())
+    // One step per magnet: pulse it until the operator reports the direction
+    while ((magnet_id = calibration.startCalibration()) >= 0)
     {
-        vTaskDelay(pdMS_TO_TICKS(50)); // Wait for input
+        global.clearCalibrationInput();
+        while (!global.getCalibrationInputAvailable())
+        {
+            calibration.pulseMagnet();
+
+            // Give the operator a moment to answer before firing again
+            for (int i = 0; i < 20 && !global.getCalibrationInputAvailable(); i++)
+            {
+                vTaskDelay(pdMS_TO_TICKS(50));
+            }
+        }
+
+        // Get user input for this magnet
+        Vector3 user_input = global.getCalibrationInput();
+        global.clearCalibrationInput();
+
+        // Complete this calibration step
+        calibration.completeCalibrationStep(user_input.x, user_input.y);
     }
 
-    // Get user input and current orientation
-    Vector3 user_input = global.getCalibrationInput();
-    global.clearCalibrationInput();
+    if (!calibration.isCalibrated())
+    {
+        // Nothing was published: an earlier calibration (if any) still stands
+        if (getControllerInstance().isCalibrated())
+        {
+            printf("Calibration failed, keeping the previous calibration\n");
+            return &ReadyState::getInstance();
+        }
+        printf("Calibration failed, back to StandbyState\n");
+        return &StandbyState::getInstance();
+    }
 
-    Orientation current_q = global.getOrientation();
-    Quaternion q(current_q.w, current_q.x, current_q.y, current_q.z);
+    if (saveStoredCalibration(captureCalibration()))
+    {
+        printf("Calibration saved\n");
+    }
 
-    // Complete this calibration step
-    calibration.completeCalibrationStep(user_input.x, user_input.y, q);
+    return &ReadyState::getInstance();
+}
 
-    printf("Calibration finished, waiting for start command...\n");
+State *ReadyState::execute()
+{
+    printf("=== ReadyState: Waiting for start command ===\n");
+    GlobalState &global = GlobalState::instance();
+    // Reported as CALIBRATION: the dashboard offers Start in that state
+    global.setSystemState(GlobalState::SystemState::CALIBRATION);
+
+    ensure_udp_sender();
+    ensure_udp_receiver();
 
     // Wait for start command to move to running state
     while (!global.getStartRequested())
     {
+        if (global.getCalibrationRequested())
+        {
+            global.clearCalibrationRequest();
+            printf("Recalibration requested, moving to CalibrateState\n");
+            return &CalibrateState::getInstance();
+        }
+        run_identification_if_requested();
+        run_current_sense_check_if_requested();
         vTaskDelay(pdMS_TO_TICKS(100));
     }
 
@@ -304,11 +489,11 @@ void core1LoopTaskTest(void *param)
         const int64_t slow_loop_time_us = 3 * 1000000.0f; // instance.slowLoopTime * 1000000.0f;
         const int64_t fast_loop_time_us = instance.fastLoopTime * 1000000.0f;
 
-        const int64_t end_us = esp_timer_get_time() + slow_loop_time_us;
-        int64_t fast_loop_end_us = esp_timer_get_time() + fast_loop_time_us;
+        const int64_t end_us = hal::micros() + slow_loop_time_us;
+        int64_t fast_loop_end_us = hal::micros() + fast_loop_time_us;
         int i = 0;
 
-        while (esp_timer_get_time() < end_us)
+        while (hal::micros() < end_us)
         {
             i += 1;
             if (i % 10 == 0) {
@@ -316,11 +501,11 @@ void core1LoopTaskTest(void *param)
                     break;
                 }
             }
-            fast_loop_end_us = esp_timer_get_time() + fast_loop_time_us;
+            fast_loop_end_us = hal::micros() + fast_loop_time_us;
 
             std::vector<CurrentInfo> currentInfo = instance.currentControlLoop();
 
-            if (esp_timer_get_time() < fast_loop_end_us)
+            if (hal::micros() < fast_loop_end_us)
             {
                 vTaskDelay(pdMS_TO_TICKS(0.0001f)); // slight smoothing of operation here
             }
@@ -344,6 +529,7 @@ void core1LoopTask(void *param)
 {
     // This is the task that runs on Core 1 for the 10ms control loop
     GlobalState &instance = GlobalState::instance();
+    ControlFrame control_frame;
 
     while (true)
     {
@@ -351,40 +537,32 @@ void core1LoopTask(void *param)
             // Reset the kill flag for the next run
             break; // Exit the loop to end the task
         }
-        // check IMU and get value
-        IMUData imu_data = readIMU();
-
-        for (const auto &angular_velocity : imu_data.angular_velocity)
-        {
-            instance.setAngularVelocity(angular_velocity);
-        }
+        int64_t slow_loop_start = hal::micros();
+        trace::recordSlowTick();
 
-        for (const auto &orientation : imu_data.orientation)
-        {
-            instance.setOrientation(orientation);
-        }
+        // Take the newest IMU sample from the acquisition task (never blocks)
+        imu_update_global_state();
 
-        // compute control outputs
-        std::vector<ControlOutputs> control_outputs = computeControl(instance.getOrientationHistory(10), instance.getAngularVelocityHistory(10), instance.getIdealDirection());
-        for (auto& output: control_outputs) {
-            instance.setControl(control_outputs);
-        }
+        // compute control outputs and hand them to the fast loop in one step
+        computeControl(instance.getOrientationHistory(10), instance.getAngularVelocityHistory(10), instance.getIdealDirection(), control_frame);
+        instance.applyControlFrame(control_frame);
+        instance.slowLoopTiming.record(hal::micros() - slow_loop_start);
 
         const int64_t interval_us = static_cast<int64_t>(instance.fastLoopTime * 1000000.0f);
 
         const int64_t slow_loop_time_us = instance.slowLoopTime * 1000000.0f;
         const int64_t fast_loop_time_us = instance.fastLoopTime * 1000000.0f;
 
-        const int64_t end_us = esp_timer_get_time() + slow_loop_time_us;
-        int64_t fast_loop_end_us = esp_timer_get_time() + fast_loop_time_us;
+        const int64_t end_us = hal::micros() + slow_loop_time_us;
+        int64_t fast_loop_end_us = hal::micros() + fast_loop_time_us;
 
-        while (esp_timer_get_time() < end_us)
+        while (hal::micros() < end_us)
         {
-            fast_loop_end_us = esp_timer_get_time() + fast_loop_time_us;
+            fast_loop_end_us = hal::micros() + fast_loop_time_us;
 
             instance.currentControlLoop();
 
-            if (esp_timer_get_time() < fast_loop_end_us)
+            if (hal::micros() < fast_loop_end_us)
             {
                 vTaskDelay(pdMS_TO_TICKS(0.0001f)); // slight smoothing of operation here
             }
@@ -394,7 +572,10 @@ void core1LoopTask(void *param)
 
     instance.set_kill(false); // Reset kill flag for next run
 
-    // TODO: implement cleanup logic here (e.g. set all PWM outputs to 0)
+    if (s_control_loop_handle == xTaskGetCurrentTaskHandle())
+    {
+        s_control_loop_handle = NULL;
+    }
 
     vTaskDelete(NULL); // Clean up the task
 }
@@ -413,14 +594,27 @@ State *RunningState::execute()
     ensure_udp_receiver();
 
     // Main loop - check for calibration requests or stop
+    int timing_report_ticks = 0;
     while (true)
     {
-        // Check if stop requested (kill flag)
-        if (state.isKilled())
+        // Report IMU and control timing every 5 s
+        if (++timing_report_ticks >= 50)
+        {
+            timing_report_ticks = 0;
+            print_loop_timing();
+        }
+
+        // Check if stop requested (kill flag). The control task clears the
+        // flag as it exits, so a task that has already gone counts as well.
+        if (state.isKilled() || s_control_loop_handle == NULL)
         {
             printf("Stop requested, stopping control loop\n");
+
+            // The control task writes the frame every tick: zero it only once
+            // the task has exited
+            wait_for_control_task_exit();
             state.zeroControl();
-            
+
             return &StandbyState::getInstance();
         }
 
@@ -429,10 +623,12 @@ State *RunningState::execute()
         {
             state.clearCalibrationRequest();
             printf("Recalibration requested, stopping control loop\n");
-            state.zeroControl();
 
-            // Kill the control task to pause operation
+            // Kill the control task to pause operation, then zero the frame
+            // once it has exited
             state.set_kill(true);
+            wait_for_control_task_exit();
+            state.zeroControl();
 
             printf("Returning to CalibrateState for recalibration\n");
             return &CalibrateState::getInstance();
@@ -446,7 +642,8 @@ State *RunningState::execute()
 
 State *TestingState::execute()
 {
-    // Run scripts through it. No state switching ever.
+    // Run scripts through it. No state switching ever. Swap in any other
+    // test from scripts/bench_test.h to run it instead.
 
     test_imu();
     // test_1();
@@ -0,0 +1,112 @@
+#include "utils/profile.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "esp_rom_sys.h"
+
+namespace profile
+{
+#if CONTROL_PROFILE
+
+namespace
+{
+Zone s_zones[MAX_ZONES];
+std::atomic<int> s_zone_count{0};
+
+// Guards adding a zone; lookups by the sites that already have theirs never take it
+std::atomic_flag s_register_lock = ATOMIC_FLAG_INIT;
+} // namespace
+
+Zone *zone(const char *name)
+{
+    while (s_register_lock.test_and_set(std::memory_order_acquire))
+    {
+    }
+
+    Zone *found = nullptr;
+    int count = s_zone_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count && found == nullptr; i++)
+    {
+        if (strcmp(s_zones[i].name, name) == 0)
+            found = &s_zones[i];
+    }
+    if (found == nullptr && count < MAX_ZONES)
+    {
+        found = &s_zones[count];
+        found->name = name;
+        s_zone_count.store(count + 1, std::memory_order_release);
+    }
+
+    s_register_lock.clear(std::memory_order_release);
+    return found;
+}
+
+size_t format(char *out, size_t capacity)
+{
+    if (out == nullptr || capacity == 0)
+        return 0;
+
+    const float cycles_per_us = static_cast<float>(esp_rom_get_cpu_ticks_per_us());
+    size_t length = 0;
+    auto append = [&](const char *fmt, auto... args) {
+        if (length + 1 >= capacity)
+            return;
+        int written = snprintf(out + length, capacity - length, fmt, args...);
+        if (written > 0)
+            length += static_cast<size_t>(written) < capacity - length ? static_cast<size_t>(written) : capacity - length - 1;
+    };
+
+    append("[PROFILE] %-10s %10s %10s %10s %10s %12s\n", "zone", "count", "mean_us", "min_us", "max_us", "total_ms");
+    int count = s_zone_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        const Zone &zone = s_zones[i];
+        uint32_t n = zone.count.load(std::memory_order_relaxed);
+        uint64_t total = zone.totalCycles();
+        uint32_t min = n > 0 ? zone.min_cycles.load(std::memory_order_relaxed) : 0;
+        uint32_t max = zone.max_cycles.load(std::memory_order_relaxed);
+        append("[PROFILE] %-10s %10u %10.2f %10.2f %10.2f %12.3f\n", zone.name, static_cast<unsigned>(n),
+               n > 0 ? total / cycles_per_us / n : 0.0f, min / cycles_per_us, max / cycles_per_us,
+               total / cycles_per_us / 1000.0f);
+    }
+    if (count == 0)
+        append("[PROFILE] no zones run yet\n");
+    return length;
+}
+
+void reset()
+{
+    int count = s_zone_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        Zone &zone = s_zones[i];
+        zone.count.store(0, std::memory_order_relaxed);
+        zone.total_blocks.store(0, std::memory_order_relaxed);
+        zone.total_remainder.store(0, std::memory_order_relaxed);
+        zone.min_cycles.store(UINT32_MAX, std::memory_order_relaxed);
+        zone.max_cycles.store(0, std::memory_order_relaxed);
+    }
+}
+
+#else
+
+Zone *zone(const char *)
+{
+    return nullptr;
+}
+
+size_t format(char *out, size_t capacity)
+{
+    if (out == nullptr || capacity == 0)
+        return 0;
+    int written = snprintf(out, capacity, "[PROFILE] disabled (build with CONTROL_PROFILE=1)\n");
+    return written > 0 && static_cast<size_t>(written) < capacity ? static_cast<size_t>(written) : capacity - 1;
+}
+
+void reset()
+{
+}
+
+#endif
+} // namespace profile
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_cpu.h"
+
+// Scoped profiling zones on the CPU cycle counter.
+//
+//   {
+//       PROFILE_ZONE("adc");
+//       ... timed until the end of the enclosing scope ...
+//   }
+//
+// Each zone name gets one entry in a static table accumulating the number of
+// passes and the total, minimum and maximum cycles per pass. Sites using the
+// same name share an entry, so they must run in the same task: each zone has
+// a single writer. The counter is CCOUNT on the ESP32 and the host
+// stub's esp_cpu_get_cycle_count() (TSC or generic timer) in the host build;
+// nested zones each count their full duration.
+//
+// Build with CONTROL_PROFILE=1 to enable. Otherwise PROFILE_ZONE expands to
+// nothing, the table is not compiled in and format() only says so.
+//
+// Like TimingStats, every field is an independent relaxed 32-bit atomic (64-bit
+// atomics are not lock free on the ESP32 and take a global lock): a snapshot
+// may mix two updates, which is fine for diagnostics.
+
+#ifndef CONTROL_PROFILE
+#define CONTROL_PROFILE 0
+#endif
+
+namespace profile
+{
+constexpr bool ENABLED = CONTROL_PROFILE != 0;
+constexpr int MAX_ZONES = 16;
+
+struct Zone
+{
+    const char *name = nullptr;
+    // The total is kept as whole blocks of 2^20 cycles plus a remainder below
+    // one block, so a snapshot mixing two updates is off by at most a block
+    // (4.4 ms at 240 MHz) rather than wrapping at 2^32 cycles (18 s)
+    static constexpr int BLOCK_BITS = 20;
+
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> total_blocks{0};
+    std::atomic<uint32_t> total_remainder{0};
+    std::atomic<uint32_t> min_cycles{UINT32_MAX};
+    std::atomic<uint32_t> max_cycles{0};
+
+    // Only the zone's own task calls this
+    void record(uint32_t cycles)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        const uint64_t sum = static_cast<uint64_t>(total_remainder.load(std::memory_order_relaxed)) + cycles;
+        if ((sum >> BLOCK_BITS) != 0)
+            total_blocks.fetch_add(static_cast<uint32_t>(sum >> BLOCK_BITS), std::memory_order_relaxed);
+        total_remainder.store(static_cast<uint32_t>(sum & ((1u << BLOCK_BITS) - 1)), std::memory_order_relaxed);
+        if (cycles < min_cycles.load(std::memory_order_relaxed))
+            min_cycles.store(cycles, std::memory_order_relaxed);
+        if (cycles > max_cycles.load(std::memory_order_relaxed))
+            max_cycles.store(cycles, std::memory_order_relaxed);
+    }
+
+    uint64_t totalCycles() const
+    {
+        return (static_cast<uint64_t>(total_blocks.load(std::memory_order_relaxed)) << BLOCK_BITS) +
+               total_remainder.load(std::memory_order_relaxed);
+    }
+};
+
+// The table entry for `name` (a string literal), added on first use. Returns
+// nullptr once the table is full.
+Zone *zone(const char *name);
+
+// Writes the table as text, one zone per line, times in microseconds.
+// Returns the length written (always NUL terminated, truncated to fit).
+size_t format(char *out, size_t capacity);
+
+// Clears every zone's statistics (the zones stay registered)
+void reset();
+
+class Scope
+{
+public:
+    explicit Scope(Zone *zone) : zone(zone), start(esp_cpu_get_cycle_count()) {}
+    ~Scope()
+    {
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        if (zone != nullptr)
+            zone->record(cycles);
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    Zone *zone;
+    uint32_t start;
+};
+} // namespace profile
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if CONTROL_PROFILE
+// The zone lookup runs once per site (function-local static)
+#define PROFILE_ZONE(name)                                                                     \
+    static profile::Zone *const PROFILE_CONCAT(profile_zone_, __LINE__) = profile::zone(name); \
+    profile::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_zone_, __LINE__))
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
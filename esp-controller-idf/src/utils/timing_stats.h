@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Running duration statistics for one code path (e.g. an IMU read or one
+// fast-loop iteration). Written by a single task and read by a reporter on
+// another, so every field is an independent atomic; a snapshot may mix two
+// updates, which is fine for diagnostics.
+struct TimingStats
+{
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> total_us{0};
+    std::atomic<uint32_t> max_us{0};
+    std::atomic<uint32_t> last_us{0};
+
+    void record(int64_t duration_us)
+    {
+        const uint32_t us = duration_us > 0 ? static_cast<uint32_t>(duration_us) : 0;
+        last_us.store(us, std::memory_order_relaxed);
+        total_us.fetch_add(us, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (us > max_us.load(std::memory_order_relaxed))
+        {
+            max_us.store(us, std::memory_order_relaxed);
+        }
+    }
+
+    void reset()
+    {
+        count.store(0, std::memory_order_relaxed);
+        total_us.store(0, std::memory_order_relaxed);
+        max_us.store(0, std::memory_order_relaxed);
+    }
+
+    float averageUs() const
+    {
+        const uint32_t n = count.load(std::memory_order_relaxed);
+        return n > 0 ? static_cast<float>(total_us.load(std::memory_order_relaxed)) / n : 0.0f;
+    }
+};
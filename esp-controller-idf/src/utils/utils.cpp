@@ -1,35 +1,20 @@
-#include <driver/spi_master.h>
-#include "driver/uart.h"
-
 #include "utils/utils.h"
+#include "utils/profile.h"
 
 #include <core/global_state.h>
-#include <core/peripherals.h>
+#include <hal/hal.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include <vector>
+#include <cmath>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
 
 
-namespace {
-int read_adc1283_channel(const ADCAddress& adcAddress) {
-    
-    int value = adc1283_read(adcAddress.adc_gpio_address, adcAddress.channel);
-    
-    return value;
-}
-}
-
-float convert_adc_value_to_current(u_int16_t adc_value) {
-    const float max_adc_value = 4095.0f;
-    const float max_voltage = 3.3f; // Max voltage
-
-    return (adc_value / max_adc_value) * max_voltage / 50 / 0.005;
-}
-
 IMUData readIMU() {
-    return shtp_service();
+    return hal::imuPoll();
 }
 
 
@@ -45,12 +30,12 @@ std::vector<float> retreveCurrentValueFromADC(std::vector<int> mag_ids) {
     }
     
 
+    PROFILE_ZONE("adc");
     for (size_t i = 0; i < mag_ids.size(); ++i) {
         int magnetId = mag_ids[i];
         ADCAddress adcAddress = adcAddresses[i];
-        (void)magnetId;
-        uint16_t raw_value = read_adc1283_channel(adcAddress);
-        float current = convert_adc_value_to_current(raw_value);
+        uint16_t raw_value = hal::adcRead(adcAddress);
+        float current = state.currentFromADC(magnetId, raw_value);
         currentValues.push_back(current);
     }
 
@@ -59,10 +44,91 @@ std::vector<float> retreveCurrentValueFromADC(std::vector<int> mag_ids) {
     return currentValues;
 }
 
+int autoZeroCurrentSense(int samples) {
+    GlobalState& state = GlobalState::instance();
+
+    // Coils off, then give the current time to decay before sampling
+    zeroPWMs();
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    int zeroed = 0;
+    for (int magnetId = 1; magnetId <= 20; ++magnetId) {
+        ADCAddress adcAddress = state.getADCAddress(magnetId);
+        uint32_t sum = 0;
+        for (int k = 0; k < samples; ++k) {
+            sum += hal::adcRead(adcAddress);
+        }
+        float offset_counts = static_cast<float>(sum) / samples;
+
+        float old_offset;
+        float gain;
+        state.getCurrentSense(magnetId, old_offset, gain);
+        if (offset_counts > kMaxZeroOffsetCounts) {
+            // Far too much for an idle coil: keep the old offset rather than
+            // learn a fault
+            printf("Auto-zero: magnet %d reads %.0f counts with coils off, keeping offset %.1f\n",
+                   magnetId, offset_counts, old_offset);
+            continue;
+        }
+        state.setCurrentSense(magnetId, offset_counts, gain);
+        zeroed++;
+    }
+    return zeroed;
+}
+
+float checkCurrentSense(int magnetId, int duty_0_255, float reference_amps, float seconds) {
+    GlobalState& state = GlobalState::instance();
+    if (magnetId < 1 || magnetId > 20 || duty_0_255 <= 0 || duty_0_255 > 255 || seconds <= 0.0f) {
+        printf("Current sense check: bad request (magnet %d, duty %d)\n", magnetId, duty_0_255);
+        return -1.0f;
+    }
+
+    // Let the coil current settle (L/R is a few ms) before averaging
+    const ADCAddress adcAddress = state.getADCAddress(magnetId);
+    const PWMAddress pwmAddress = state.getPWMAddress(magnetId);
+    hal::pwmWrite(pwmAddress, duty_0_255);
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    const int64_t end_us = hal::micros() + static_cast<int64_t>(seconds * 1000000.0f);
+    double sum = 0.0;
+    int samples = 0;
+    while (hal::micros() < end_us) {
+        sum += state.currentFromADC(magnetId, hal::adcRead(adcAddress));
+        samples++;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    hal::pwmWrite(pwmAddress, 0);
+
+    const float measured = samples > 0 ? static_cast<float>(sum / samples) : 0.0f;
+    printf("Current sense check: magnet %d at duty %d reads %.3f A over %d samples\n",
+           magnetId, duty_0_255, measured, samples);
+    if (reference_amps <= 0.0f) {
+        return measured;
+    }
+    if (measured <= 0.0f) {
+        printf("Current sense check: no current measured, gain unchanged\n");
+        return measured;
+    }
+
+    float offset;
+    float gain;
+    state.getCurrentSense(magnetId, offset, gain);
+    const float correction = reference_amps / measured;
+    if (fabsf(correction - 1.0f) > kMaxCurrentSenseGainError) {
+        printf("Current sense check: reference %.3f A is %.0f%% off, gain unchanged\n",
+               reference_amps, (correction - 1.0f) * 100.0f);
+        return measured;
+    }
+    state.setCurrentSense(magnetId, offset, gain * correction);
+    printf("Current sense check: magnet %d gain %.4f -> %.4f\n", magnetId, gain, gain * correction);
+    return measured;
+}
+
 void setPWMOutputs(std::vector<int> magnetIds, std::vector<int> values) {
     GlobalState& state = GlobalState::instance();
     const size_t count = std::min(magnetIds.size(), values.size());
 
+    PROFILE_ZONE("pwm");
 
 
     for (size_t i = 0; i < count; ++i) {
@@ -70,7 +136,7 @@ void setPWMOutputs(std::vector<int> magnetIds, std::vector<int> values) {
         int value = values[i];
         PWMAddress pwmAddress = state.getPWMAddress(magnetId);
         float duty_cycle_256 = value / 16.0f;
-        pca9685_set_pwm(pwmAddress.driver_i2c_address, pwmAddress.channel, static_cast<int>(duty_cycle_256));
+        hal::pwmWrite(pwmAddress, static_cast<int>(duty_cycle_256));
         // printf("Set PWM for magnet %d (I2C addr: 0x%02X, channel: %d) to value %d\n", magnetId, pwmAddress.driver_i2c_address, pwmAddress.channel, value);
 
     }
@@ -84,7 +150,7 @@ void zeroPWMs() {
 
         int duty_cycle_0 = 0;
 
-        pca9685_set_pwm(pwmAddress.driver_i2c_address, pwmAddress.channel, duty_cycle_0);
+        hal::pwmWrite(pwmAddress, duty_cycle_0);
         vTaskDelay(pdTICKS_TO_MS(0.01));
     }
 }
@@ -95,7 +161,7 @@ void serial_print(const char* msg) {
     if (!msg) {
         return;
     }
-    uart_write_bytes(UART_NUM_0, msg, strlen(msg));
+    hal::serialWrite(msg, strlen(msg));
 }
 
 void serial_printf(const char* fmt, ...) {
@@ -117,6 +183,6 @@ void serial_printf(const char* fmt, ...) {
     if (len >= sizeof(buffer)) {
         len = sizeof(buffer) - 1;
     }
-    uart_write_bytes(UART_NUM_0, buffer, len);
+    hal::serialWrite(buffer, len);
 }
 
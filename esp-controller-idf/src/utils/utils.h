@@ -1,9 +1,31 @@
 #include <vector>
-#include <core/peripherals.h>
+#include <hal/hal.h>
 
 
 std::vector<float> retreveCurrentValueFromADC(std::vector<int> mag_ids);
 
+// Largest zero-current reading accepted by auto-zero (about 1 A nominal)
+constexpr float kMaxZeroOffsetCounts = 300.0f;
+
+// Turns all coils off and stores each channel's average reading as its
+// zero-current offset. Only call while the control task is stopped.
+// Returns the number of channels updated.
+int autoZeroCurrentSense(int samples = 64);
+
+// Largest gain correction checkCurrentSense accepts (either way)
+constexpr float kMaxCurrentSenseGainError = 0.25f;
+
+// Current sense gain from an external reference. Auto-zero only finds the
+// offset; the gain starts at the nominal shunt/amplifier scale and nothing on
+// the board can measure it alone. This holds magnet `magnetId` at a fixed
+// duty, open loop, for `seconds` (read a clamp meter on the coil meanwhile)
+// and returns the mean current it measured. With `reference_amps` > 0, the
+// meter's reading at that duty, it also rescales the channel's gain so the
+// two agree; corrections beyond kMaxCurrentSenseGainError are rejected.
+// Only call while the control task is stopped. Returns the measured current
+// before any correction, or a negative value if nothing was measured.
+float checkCurrentSense(int magnetId, int duty_0_255, float reference_amps, float seconds = 3.0f);
+
 void setPWMOutputs(std::vector<int> magnetId, std::vector<int> value);
 void zeroPWMs();
 
@@ -0,0 +1,380 @@
+"""
+Fit each coil's effective direction and torque gain from a coil identification log.
+
+The firmware's identification run (dashboard command 5, see
+src/calibration/coil_identification.h) fires every coil in turn and prints
+one IDENT line per pulse: the ball orientation when the pulse started and
+the world-frame rotation it caused. Capture the console output to a file
+(e.g. `idf.py monitor | tee ident.log`) and run this tool on it.
+
+A coil only pulls while it is in the lower hemisphere, and one run barely
+moves the ball, so do several runs and turn the ball by hand in between:
+each coil needs MIN_SAMPLES pulses with a measurable response. Pass all the
+logs at once (or one log covering all runs).
+
+Model: the ball rolls along the horizontal force the solver expects from
+the coil (BallController::magnetForce, same force curve), scaled by a per-coil
+gain and one shared response constant. For each coil the tool searches the
+sphere for the direction that best explains its pulses, refines it with
+Gauss-Newton, and fits the gain in closed form. A new direction is only
+accepted when it explains the data clearly better than the configured one;
+gains are normalised to a median of 1.
+
+Usage:
+    python fit_magnet_geometry.py ident*.log            # report only
+    python fit_magnet_geometry.py ident*.log --write    # update magnet_config.h and coil_gains.h
+    python fit_magnet_geometry.py --self-test           # fit a synthetic log with known answers
+
+--self-test writes IDENT lines in the firmware's format for a ball whose
+coils sit at the configured directions except for two that are turned away,
+with random gains and sensor noise, and checks that the fit finds those two
+(and only those) and recovers every gain. It exits non-zero if it does not.
+
+After --write, re-run gen_allocation_table.py so the solver shortlist matches.
+Flashing the new geometry invalidates the stored calibration (its geometry ID
+changes), so the board calibrates again on the next boot.
+"""
+
+import argparse
+import math
+import os
+import re
+import sys
+
+import numpy as np
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(HERE, "..", "src")
+MAGNET_CONFIG = os.path.join(SRC, "core", "magnet_config.h")
+COIL_GAINS = os.path.join(SRC, "control", "coil_gains.h")
+
+MAGNET_COUNT = 20
+MIN_ANGLE_COS = math.cos(0.1)  # Mirrors magnet_geometry::MIN_ANGLE_RAD
+
+MIN_SAMPLES = 3            # Pulses with a measurable response needed to fit a coil
+MIN_RESPONSE_RAD = 0.002   # Smaller rotations are treated as "no response"
+ACCEPT_IMPROVEMENT = 0.7   # New direction must cut the residual to this fraction
+GAIN_LIMITS = (0.2, 3.0)
+SEARCH_DIRECTIONS = 4000
+
+ENTRY = re.compile(r"\{\s*(\d+)\s*,\s*\{\s*([-\d.]+)f?\s*,\s*([-\d.]+)f?\s*,\s*([-\d.]+)f?\s*\}")
+
+
+def load_positions(path=MAGNET_CONFIG):
+    """Magnet positions (mm), indexed by magnet ID - 1."""
+    entries = sorted((int(m[0]), [float(m[1]), float(m[2]), float(m[3])]) for m in ENTRY.findall(open(path).read()))
+    if len(entries) != MAGNET_COUNT:
+        raise ValueError(f"Expected {MAGNET_COUNT} magnets in {path}, found {len(entries)}")
+    return np.array([p for _, p in entries])
+
+
+def parse_logs(paths):
+    """IDENT lines -> per-coil lists of (R, response_per_amp_xy, rotation_rad)."""
+    return parse_lines(line for path in paths for line in open(path, errors="replace"))
+
+
+def parse_lines(lines):
+    samples = [[] for _ in range(MAGNET_COUNT)]
+    for line in lines:
+        idx = line.find("IDENT,")
+        if idx < 0:
+            continue
+        fields = line[idx:].strip().split(",")
+        if len(fields) != 12:
+            continue
+        try:
+            magnet_id = int(fields[2])
+            current = float(fields[3])
+            q = np.array([float(v) for v in fields[5:9]])
+            r = np.array([float(v) for v in fields[9:12]])
+        except ValueError:
+            continue
+        if not 1 <= magnet_id <= MAGNET_COUNT or current <= 0.0:
+            continue
+        # Rolling about world axis (rx, ry) moves the ball along (ry, -rx)
+        move = np.array([r[1], -r[0]]) / current
+        samples[magnet_id - 1].append((quat_to_matrix(q / np.linalg.norm(q)), move, float(np.linalg.norm(r[:2]))))
+    return samples
+
+
+def quat_to_matrix(q):
+    """Same convention as BallController::quatToMatrix (body -> world)."""
+    w, x, y, z = q
+    return np.array([
+        [1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)],
+        [2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)],
+        [2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)],
+    ])
+
+
+def model_force(u, rotations):
+    """
+    Horizontal world-frame force per amp of a unit-gain coil at body direction u,
+    for each orientation (BallController::magnetForce without the LUT).
+    u: (3,) or (D, 3); returns (N, 2) or (D, N, 2).
+    """
+    u = np.atleast_2d(u)
+    out = np.zeros((u.shape[0], len(rotations), 2))
+    for n, R in enumerate(rotations):
+        g = R.T @ np.array([0.0, 0.0, -1.0])
+        c = u @ g
+        usable = (c > 0.0) & (c <= MIN_ANGLE_COS)
+        cc = np.clip(c, 0.0, MIN_ANGLE_COS)
+        angle = np.arccos(cc)
+        per_sin = (60.0 / (0.01 + 1.0 - cc)) * np.exp(-2.5 * angle) / 8.0
+        force_body = (u - np.outer(c, g)) * np.where(usable, per_sin, 0.0)[:, None]
+        out[:, n, :] = (force_body @ R.T)[:, :2]
+    return out[0] if out.shape[0] == 1 else out
+
+
+def fit_gain(model, moves, k):
+    """Least-squares gain for fixed direction(s); model (..., N, 2)."""
+    num = np.sum(model * moves, axis=(-2, -1))
+    den = np.sum(model * model, axis=(-2, -1)) * k
+    with np.errstate(divide="ignore", invalid="ignore"):
+        gain = np.where(den > 0.0, num / den, 0.0)
+    return np.clip(gain, 0.0, None)
+
+
+def residual(u, gain, rotations, moves, k):
+    return np.sqrt(np.mean(np.sum((moves - k * gain * model_force(u, rotations)) ** 2, axis=-1)))
+
+
+def fibonacci_sphere(count):
+    i = np.arange(count) + 0.5
+    phi = np.arccos(1.0 - 2.0 * i / count)
+    theta = math.pi * (1.0 + 5.0 ** 0.5) * i
+    return np.stack([np.cos(theta) * np.sin(phi), np.sin(theta) * np.sin(phi), np.cos(phi)], axis=1)
+
+
+def refine(u, rotations, moves, k, iterations=20):
+    """Gauss-Newton on (direction, gain), direction kept on the unit sphere."""
+    gain = float(fit_gain(model_force(u, rotations), moves, k))
+    for _ in range(iterations):
+        # Tangent basis at u
+        ref = np.array([0.0, 0.0, 1.0]) if abs(u[2]) < 0.9 else np.array([1.0, 0.0, 0.0])
+        e1 = np.cross(u, ref)
+        e1 /= np.linalg.norm(e1)
+        e2 = np.cross(u, e1)
+
+        def predict(p):
+            v = u + p[0] * e1 + p[1] * e2
+            v /= np.linalg.norm(v)
+            return (k * p[2] * model_force(v, rotations)).ravel()
+
+        p0 = np.array([0.0, 0.0, gain])
+        r0 = moves.ravel() - predict(p0)
+        J = np.zeros((r0.size, 3))
+        for j, h in enumerate((1e-4, 1e-4, 1e-4 * max(gain, 1.0))):
+            dp = np.zeros(3)
+            dp[j] = h
+            J[:, j] = (predict(p0 + dp) - predict(p0 - dp)) / (2.0 * h)
+        step, *_ = np.linalg.lstsq(J, r0, rcond=None)
+        step[:2] = np.clip(step[:2], -0.1, 0.1)  # At most ~6 degrees per iteration
+
+        # Backtrack while the full step overshoots: the force curve is steep
+        # near the pole, where a linear model of it does not reach far
+        current = residual(u, gain, rotations, moves, k)
+        for _ in range(8):
+            v = u + step[0] * e1 + step[1] * e2
+            v /= np.linalg.norm(v)
+            new_gain = max(gain + step[2], 0.0)
+            if residual(v, new_gain, rotations, moves, k) < current:
+                break
+            step *= 0.5
+        else:
+            break
+        u, gain = v, new_gain
+        if np.linalg.norm(step[:2]) < 1e-6:
+            break
+    return u, gain
+
+
+def fit(positions, samples):
+    units = positions / np.linalg.norm(positions, axis=1, keepdims=True)
+    search = fibonacci_sphere(SEARCH_DIRECTIONS)
+
+    # Shared response constant from all coils at their configured directions
+    num = den = 0.0
+    for i in range(MAGNET_COUNT):
+        if not samples[i]:
+            continue
+        rotations = [R for R, _, _ in samples[i]]
+        moves = np.array([m for _, m, _ in samples[i]])
+        model = model_force(units[i], rotations)
+        num += float(np.sum(model * moves))
+        den += float(np.sum(model * model))
+    if num <= 0.0 or den <= 0.0:
+        raise ValueError("The log shows no response that matches the configured geometry")
+    k = num / den
+
+    results = []
+    for i in range(MAGNET_COUNT):
+        rotations = [R for R, _, _ in samples[i]]
+        moves = np.array([m for _, m, _ in samples[i]]).reshape(-1, 2)
+        responsive = sum(1 for _, _, rotation in samples[i] if rotation >= MIN_RESPONSE_RAD)
+        result = {"id": i + 1, "pulses": len(rotations), "responsive": responsive,
+                  "direction": units[i], "gain": 1.0, "moved_deg": 0.0, "status": "too few responses"}
+        results.append(result)
+        if responsive < MIN_SAMPLES:
+            continue
+
+        config_gain = float(fit_gain(model_force(units[i], rotations), moves, k))
+        config_rms = residual(units[i], config_gain, rotations, moves, k)
+
+        # Coarse search over the sphere, then refine the best direction
+        gains = fit_gain(model_force(search, rotations), moves[None, :, :], k)
+        errors = np.sum((moves[None] - k * gains[:, None, None] * model_force(search, rotations)) ** 2, axis=(1, 2))
+        u, gain = refine(search[int(np.argmin(errors))], rotations, moves, k)
+        rms = residual(u, gain, rotations, moves, k)
+
+        result["config_rms"] = config_rms
+        if rms < ACCEPT_IMPROVEMENT * config_rms:
+            result.update(direction=u, gain=gain, rms=rms, status="moved",
+                          moved_deg=math.degrees(math.acos(np.clip(u @ units[i], -1.0, 1.0))))
+        else:
+            result.update(gain=config_gain, rms=config_rms, status="kept")
+
+    # Gains relative to the typical coil (the shared constant absorbs the rest)
+    fitted = [r["gain"] for r in results if r["status"] != "too few responses" and r["gain"] > 0.0]
+    scale = float(np.median(fitted)) if fitted else 1.0
+    for r in results:
+        if r["status"] != "too few responses":
+            r["gain"] = float(np.clip(r["gain"] / scale, *GAIN_LIMITS))
+    return results
+
+
+def report(results):
+    print(f"{'id':>3} {'pulses':>6} {'resp':>5} {'status':>18} {'moved':>7} {'gain':>6} {'rms cfg':>9} {'rms fit':>9}")
+    for r in results:
+        cfg = f"{r['config_rms']:.2e}" if "config_rms" in r else "-"
+        rms = f"{r['rms']:.2e}" if "rms" in r else "-"
+        print(f"{r['id']:>3} {r['pulses']:>6} {r['responsive']:>5} {r['status']:>18} "
+              f"{r['moved_deg']:>6.1f}d {r['gain']:>6.3f} {cfg:>9} {rms:>9}")
+
+
+def write_config(path, positions, results):
+    text = open(path).read()
+
+    shell = float(np.median(np.linalg.norm(positions, axis=1)))
+
+    def replace(match):
+        i = int(match.group(1)) - 1
+        if results[i]["status"] != "moved":
+            return match.group(0)
+        # Moved coils go on the shell (the median radius): the fit only gives
+        # a direction, and an entry's own radius may be the thing that was wrong
+        p = results[i]["direction"] * shell
+        return f"{{{i + 1}, {{{p[0]:.2f}f, {p[1]:.2f}f, {p[2]:.2f}f}}"
+
+    with open(path, "w") as f:
+        f.write(ENTRY.sub(replace, text))
+
+
+def write_gains(path, results):
+    values = [f"{r['gain']:.3f}f" for r in results]
+    lines = [
+        "// Generated by tools/fit_magnet_geometry.py -- do not edit by hand.",
+        "// Torque gain of each coil relative to the solver model (1 = nominal),",
+        "// indexed by magnet ID - 1. Nominal until a coil identification is fitted.",
+        "#pragma once",
+        "",
+        "namespace coil_gains",
+        "{",
+        "    constexpr float GAIN[20] = {",
+        "        " + ", ".join(values[:10]) + ",",
+        "        " + ", ".join(values[10:]) + ",",
+        "    };",
+        "}",
+        "",
+    ]
+    with open(path, "w") as f:
+        f.write("\n".join(lines))
+
+
+def rotate_towards(u, angle_deg, rng):
+    """u turned by angle_deg about a random axis perpendicular to it."""
+    axis = np.cross(u, rng.normal(size=3))
+    axis /= np.linalg.norm(axis)
+    a = math.radians(angle_deg)
+    return u * math.cos(a) + np.cross(axis, u) * math.sin(a)
+
+
+def synthetic_log(units, gains, rng, rounds=16, current=4.0, k=0.008, noise_rad=0.0005):
+    """IDENT lines, as runCoilIdentification prints them, for coils at `units`."""
+    lines = []
+    for round_index in range(rounds):
+        # Turned by hand between runs; the pulses of one run barely move it
+        q = rng.normal(size=4)
+        q /= np.linalg.norm(q)
+        R = quat_to_matrix(q)
+        for i in range(MAGNET_COUNT):
+            move = k * gains[i] * model_force(units[i], [R])[0] * current
+            r = np.array([-move[1], move[0], 0.0]) + rng.normal(scale=noise_rad, size=3)
+            lines.append("IDENT,%d,%d,%.2f,%.4f,%.5f,%.5f,%.5f,%.5f,%.5f,%.5f,%.5f\n"
+                         % (round_index, i + 1, current, 0.15, *q, *r))
+    return lines
+
+
+def self_test(positions, seed=1):
+    rng = np.random.default_rng(seed)
+    units = positions / np.linalg.norm(positions, axis=1, keepdims=True)
+    truth = units.copy()
+    turned = {5: 11.0, 9: 25.0}  # magnet index -> degrees off the configured direction
+    for i, angle in turned.items():
+        truth[i] = rotate_towards(units[i], angle, rng)
+    gains = rng.uniform(0.7, 1.3, MAGNET_COUNT)
+
+    results = fit(positions, parse_lines(synthetic_log(truth, gains, rng)))
+    report(results)
+
+    failures = []
+    fitted = [i for i, r in enumerate(results) if r["status"] != "too few responses"]
+    scale = float(np.median(gains[fitted]))
+    for i, r in enumerate(results):
+        if r["status"] == "too few responses":
+            failures.append(f"ID {i + 1}: too few responses")
+            continue
+        error_deg = math.degrees(math.acos(np.clip(r["direction"] @ truth[i], -1.0, 1.0)))
+        expected = "moved" if i in turned else "kept"
+        if r["status"] != expected or error_deg > 1.0:
+            failures.append(f"ID {i + 1}: {r['status']}, {error_deg:.2f} deg from the truth (expected {expected})")
+        if abs(r["gain"] - gains[i] / scale) > 0.05 * gains[i] / scale:
+            failures.append(f"ID {i + 1}: gain {r['gain']:.3f}, truth {gains[i] / scale:.3f}")
+
+    for failure in failures:
+        print("FAIL " + failure)
+    print("self-test " + ("failed" if failures else "passed") +
+          ": " + ", ".join(f"ID {i + 1} turned {a:.0f} deg" for i, a in turned.items()))
+    return not failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("logs", nargs="*", help="console logs containing IDENT lines")
+    parser.add_argument("--write", action="store_true", help="update magnet_config.h and coil_gains.h")
+    parser.add_argument("--self-test", action="store_true", help="fit a synthetic log and check the answers")
+    parser.add_argument("--config", default=MAGNET_CONFIG)
+    parser.add_argument("--gains", default=COIL_GAINS)
+    args = parser.parse_args()
+
+    positions = load_positions(args.config)
+    if args.self_test:
+        sys.exit(0 if self_test(positions) else 1)
+    if not args.logs:
+        parser.error("no logs given")
+    samples = parse_logs(args.logs)
+    if not any(samples):
+        sys.exit("No IDENT lines in " + ", ".join(args.logs))
+
+    results = fit(positions, samples)
+    report(results)
+
+    if args.write:
+        write_config(args.config, positions, results)
+        write_gains(args.gains, results)
+        print(f"Wrote {args.config} and {args.gains}; now re-run gen_allocation_table.py")
+
+
+if __name__ == "__main__":
+    main()
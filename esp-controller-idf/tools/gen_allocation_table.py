@@ -0,0 +1,294 @@
+"""
+Generate the gravity-indexed magnet shortlist used by BallController::solve.
+
+The only input to candidate selection that depends on the ball orientation is
+the gravity direction in the body frame. This tool tiles the sphere of gravity
+directions with an octahedral grid (equal-ish area cells with O(1) lookup on
+the device), and for every cell finds the set of magnets that are ever part of
+the optimal single/pair assignment for any target inside that cell. The result
+is written as a constexpr table of 20-bit masks, one per cell.
+
+On the device, solve() then only scores the shortlisted magnets instead of all
+20, which cuts the pair search from ~45 pairs to a handful.
+
+The solver model below mirrors BallController.cpp (force LUT, coil gains,
+current limit, current penalty). Re-run this whenever those,
+core/magnet_config.h or control/coil_gains.h change.
+
+Usage:
+    python gen_allocation_table.py                 # write src/control/allocation_table.h
+    python gen_allocation_table.py --grid 24
+    python gen_allocation_table.py --sweep         # report size vs accuracy, write nothing
+"""
+
+import argparse
+import math
+import os
+import re
+from multiprocessing import Pool
+
+import numpy as np
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(HERE, "..", "src")
+MAGNET_CONFIG = os.path.join(SRC, "core", "magnet_config.h")
+COIL_GAINS = os.path.join(SRC, "control", "coil_gains.h")
+OUTPUT = os.path.join(SRC, "control", "allocation_table.h")
+
+# Mirrors BallController
+MAX_CURRENT = 8.0
+CURRENT_PENALTY = 2.0
+MIN_ANGLE_RAD = 0.1
+MIN_ANGLE_COS = math.cos(MIN_ANGLE_RAD)
+
+# Sampling used to build each cell's shortlist
+CELL_SAMPLES = 5           # gravity samples per cell side
+CELL_MARGIN = 0.25         # sample this fraction of a cell beyond each border
+TARGET_DIRECTIONS = 48
+TARGET_MAGNITUDES = (0.1, 0.4, 0.7, 1.0, 1.42)  # joystick magnitudes, |(x, y)| <= sqrt(2)
+
+
+def load_magnets(path=MAGNET_CONFIG):
+    """Unit magnet directions, indexed like BallController::magnets (id - 1)."""
+    text = open(path).read()
+    pattern = re.compile(r"\{\s*(\d+)\s*,\s*\{\s*([-\d.]+)f?\s*,\s*([-\d.]+)f?\s*,\s*([-\d.]+)f?\s*\}")
+    entries = sorted((int(m[0]), [float(m[1]), float(m[2]), float(m[3])]) for m in pattern.findall(text))
+    if len(entries) != 20:
+        raise ValueError(f"Expected 20 magnets in {path}, found {len(entries)}")
+    magnets = np.array([p for _, p in entries])
+    return magnets / np.linalg.norm(magnets, axis=1, keepdims=True)
+
+
+def load_coil_gains(path=COIL_GAINS):
+    """Per-coil torque gains (control/coil_gains.h), indexed like load_magnets."""
+    text = open(path).read()
+    body = text[text.index("GAIN[20]"):]
+    gains = [float(v) for v in re.findall(r"([-\d.]+)f", body[:body.index("};")])]
+    if len(gains) != 20:
+        raise ValueError(f"Expected 20 coil gains in {path}, found {len(gains)}")
+    return np.array(gains)
+
+
+def octahedral_decode(u, v):
+    """[0, 1]^2 -> unit vector. Inverse of BallController::gravityCell's encoding."""
+    x = 2.0 * u - 1.0
+    y = 2.0 * v - 1.0
+    z = 1.0 - abs(x) - abs(y)
+    if z < 0.0:
+        x, y = (1.0 - abs(y)) * math.copysign(1.0, x), (1.0 - abs(x)) * math.copysign(1.0, y)
+    vec = np.array([x, y, z])
+    return vec / np.linalg.norm(vec)
+
+
+def octahedral_cell(g, grid):
+    """Unit vector -> cell index, identical to the device lookup."""
+    s = abs(g[0]) + abs(g[1]) + abs(g[2])
+    x = g[0] / s
+    y = g[1] / s
+    if g[2] < 0.0:
+        x, y = (1.0 - abs(y)) * math.copysign(1.0, x), (1.0 - abs(x)) * math.copysign(1.0, y)
+    col = min(grid - 1, max(0, int((x * 0.5 + 0.5) * grid)))
+    row = min(grid - 1, max(0, int((y * 0.5 + 0.5) * grid)))
+    return row * grid + col
+
+
+def candidate_forces(magnets, gains, g):
+    """Force vector per amp for each usable magnet at gravity g (BallController::findCandidates)."""
+    ids = []
+    vecs = []
+    for i, m in enumerate(magnets):
+        c = float(m @ g)
+        if c <= 0.0 or c > MIN_ANGLE_COS:
+            continue
+        angle = math.acos(c)
+        s = math.sin(angle)
+        val = (60.0 * s / (0.01 + 1.0 - c)) * math.exp(-2.5 * angle) / 8.0 * gains[i]
+        ids.append(i)
+        vecs.append((m - g * c) * (val / s))
+    return np.array(ids, dtype=int), np.array(vecs).reshape(-1, 3)
+
+
+def tangent_targets(g):
+    """Targets are horizontal in the world, i.e. perpendicular to gravity in the body frame."""
+    ref = np.array([0.0, 0.0, 1.0]) if abs(g[2]) < 0.9 else np.array([0.0, 1.0, 0.0])
+    e1 = np.cross(ref, g)
+    e1 /= np.linalg.norm(e1)
+    e2 = np.cross(g, e1)
+    phi = np.linspace(0.0, 2.0 * math.pi, TARGET_DIRECTIONS, endpoint=False)
+    dirs = np.outer(np.cos(phi), e1) + np.outer(np.sin(phi), e2)
+    return np.concatenate([dirs * m for m in TARGET_MAGNITUDES])
+
+
+def best_assignments(vecs, targets):
+    """
+    Exhaustive single/pair search for every target (rows of `targets`).
+    Returns (score, a, b) arrays with candidate indices, b = -1 for singles.
+    """
+    n = len(vecs)
+    count = len(targets)
+    best_score = np.full(count, np.inf)
+    best_a = np.full(count, -1)
+    best_b = np.full(count, -1)
+    if n == 0:
+        return best_score, best_a, best_b
+
+    # A. Singles
+    len_sq = np.einsum("ij,ij->i", vecs, vecs)
+    proj = targets @ vecs.T
+    current = np.minimum(proj / len_sq, MAX_CURRENT)
+    err = np.linalg.norm(targets[:, None, :] - current[:, :, None] * vecs[None, :, :], axis=2)
+    score = np.where(proj > 0.0, err + CURRENT_PENALTY * current, np.inf)
+    best_a = np.argmin(score, axis=1)
+    best_score = score[np.arange(count), best_a]
+    best_a = np.where(np.isfinite(best_score), best_a, -1)
+
+    if n < 2:
+        return best_score, best_a, best_b
+
+    # B. Pairs, solved in the (t_hat, y_hat) plane like the device
+    t_len = np.linalg.norm(targets, axis=1)
+    t_hat = targets / t_len[:, None]
+    ref = np.where((np.abs(t_hat[:, 2]) < 0.9)[:, None], [0.0, 0.0, 1.0], [0.0, 1.0, 0.0])
+    y_hat = np.cross(ref, t_hat)
+    y_hat /= np.linalg.norm(y_hat, axis=1, keepdims=True)
+    cx = t_hat @ vecs.T
+    cy = y_hat @ vecs.T
+
+    ii, jj = np.triu_indices(n, 1)
+    det = cx[:, ii] * cy[:, jj] - cy[:, ii] * cx[:, jj]
+    with np.errstate(divide="ignore", invalid="ignore"):
+        ia = t_len[:, None] * cy[:, jj] / det
+        ib = -t_len[:, None] * cy[:, ii] / det
+    valid = (np.abs(det) >= 0.0001) & (ia >= 0.0) & (ib >= 0.0)
+    ia = np.minimum(np.where(valid, ia, 0.0), MAX_CURRENT)
+    ib = np.minimum(np.where(valid, ib, 0.0), MAX_CURRENT)
+    produced = ia[:, :, None] * vecs[ii][None, :, :] + ib[:, :, None] * vecs[jj][None, :, :]
+    err = np.linalg.norm(targets[:, None, :] - produced, axis=2)
+    pair_score = np.where(valid, err + CURRENT_PENALTY * (ia + ib), np.inf)
+    best_pair = np.argmin(pair_score, axis=1)
+    pair_best = pair_score[np.arange(count), best_pair]
+
+    use_pair = pair_best < best_score - 0.0001
+    best_score = np.where(use_pair, pair_best, best_score)
+    best_a = np.where(use_pair, ii[best_pair], best_a)
+    best_b = np.where(use_pair, jj[best_pair], -1)
+    return best_score, best_a, best_b
+
+
+def cell_mask(args):
+    """Shortlist mask for one cell: every magnet used by an optimal assignment inside it."""
+    cell, grid, magnets, gains = args
+    row, col = divmod(cell, grid)
+    mask = 0
+    offsets = np.linspace(-CELL_MARGIN, 1.0 + CELL_MARGIN, CELL_SAMPLES)
+    for du in offsets:
+        for dv in offsets:
+            u = min(1.0, max(0.0, (col + du) / grid))
+            v = min(1.0, max(0.0, (row + dv) / grid))
+            g = octahedral_decode(u, v)
+            ids, vecs = candidate_forces(magnets, gains, g)
+            _, a, b = best_assignments(vecs, tangent_targets(g))
+            for k in np.concatenate([a[a >= 0], b[b >= 0]]):
+                mask |= 1 << int(ids[k])
+    return mask
+
+
+def build_table(magnets, gains, grid, pool):
+    return pool.map(cell_mask, [(cell, grid, magnets, gains) for cell in range(grid * grid)], chunksize=4)
+
+
+def evaluate(magnets, gains, grid, masks, cases=4000, seed=1234):
+    """Fraction of random cases where the shortlist search matches the full search, and mean regret."""
+    rng = np.random.default_rng(seed)
+    exact = 0
+    regret = 0.0
+    for _ in range(cases):
+        g = rng.normal(size=3)
+        g /= np.linalg.norm(g)
+        ids, vecs = candidate_forces(magnets, gains, g)
+        if len(ids) == 0:
+            exact += 1
+            continue
+        ref = np.array([0.0, 0.0, 1.0]) if abs(g[2]) < 0.9 else np.array([0.0, 1.0, 0.0])
+        e1 = np.cross(ref, g)
+        e1 /= np.linalg.norm(e1)
+        e2 = np.cross(g, e1)
+        joy = rng.uniform(-1.0, 1.0, size=2)
+        target = (joy[0] * e1 + joy[1] * e2)[None, :]
+
+        full, _, _ = best_assignments(vecs, target)
+        keep = np.array([(masks[octahedral_cell(g, grid)] >> int(i)) & 1 for i in ids], dtype=bool)
+        short, _, _ = best_assignments(vecs[keep], target)
+        if short[0] <= full[0] + 1e-6:
+            exact += 1
+        elif np.isfinite(short[0]):
+            regret += (short[0] - full[0]) / full[0]
+        else:
+            regret += 1.0
+    return exact / cases, regret / cases
+
+
+def describe(masks):
+    sizes = [bin(m).count("1") for m in masks]
+    return sum(sizes) / len(sizes), max(sizes)
+
+
+def write_header(path, grid, masks, accuracy, regret):
+    mean_size, max_size = describe(masks)
+    lines = [
+        "// Generated by tools/gen_allocation_table.py -- do not edit by hand.",
+        "// Re-run the generator after changing core/magnet_config.h, control/coil_gains.h or the solver model.",
+        "//",
+        f"// {grid}x{grid} octahedral gravity grid, {grid * grid * 4} bytes.",
+        f"// Shortlist size: mean {mean_size:.1f}, max {max_size} magnets.",
+        f"// Matches the full search in {accuracy * 100.0:.2f}% of sampled cases (mean regret {regret * 100.0:.3f}%).",
+        "#pragma once",
+        "",
+        "#include <stdint.h>",
+        "",
+        "namespace allocation_table",
+        "{",
+        f"    constexpr int GRID = {grid};",
+        "",
+        "    // Bit i set: magnet index i can be part of the optimal assignment somewhere",
+        "    // in the cell. constexpr data is placed in .rodata, i.e. mapped flash.",
+        "    constexpr uint32_t CELL_MASKS[GRID * GRID] = {",
+    ]
+    for row in range(grid):
+        chunk = masks[row * grid:(row + 1) * grid]
+        lines.append("        " + ", ".join(f"0x{m:05X}" for m in chunk) + ",")
+    lines += ["    };", "}", ""]
+    with open(path, "w") as f:
+        f.write("\n".join(lines))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--grid", type=int, default=16, help="cells per side of the octahedral map")
+    parser.add_argument("--sweep", action="store_true", help="report table size vs accuracy for several grids")
+    parser.add_argument("--cases", type=int, default=4000, help="random cases for the accuracy check")
+    parser.add_argument("--output", default=OUTPUT)
+    args = parser.parse_args()
+
+    magnets = load_magnets()
+    gains = load_coil_gains()
+    with Pool(os.cpu_count()) as pool:
+        if args.sweep:
+            print(f"{'grid':>5} {'bytes':>6} {'mean':>5} {'max':>4} {'exact':>8} {'regret':>8}")
+            for grid in (4, 8, 12, 16, 24, 32):
+                masks = build_table(magnets, gains, grid, pool)
+                accuracy, regret = evaluate(magnets, gains, grid, masks, args.cases)
+                mean_size, max_size = describe(masks)
+                print(f"{grid:>5} {grid * grid * 4:>6} {mean_size:>5.1f} {max_size:>4} {accuracy * 100:>7.2f}% {regret * 100:>7.3f}%")
+            return
+
+        masks = build_table(magnets, gains, args.grid, pool)
+    accuracy, regret = evaluate(magnets, gains, args.grid, masks, args.cases)
+    write_header(args.output, args.grid, masks, accuracy, regret)
+    mean_size, max_size = describe(masks)
+    print(f"Wrote {args.output}: {args.grid}x{args.grid} cells, {args.grid * args.grid * 4} bytes, "
+          f"shortlist mean {mean_size:.1f} / max {max_size}, exact {accuracy * 100:.2f}%, regret {regret * 100:.3f}%")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+"""
+Asks the ESP32 for its profiling zones (esp-controller-idf/src/utils/profile.h)
+and prints the table it sends back to UDP port 5008. The ESP32 sends it to the
+telemetry address (RECV_IP_ADDR), so run this on that machine. The firmware
+must be built with CONTROL_PROFILE=1.
+
+Usage:
+    python profile_dump.py [--reset] [--ip ESP_IP]
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+DEFAULT_ESP_IP = "192.168.4.1"
+COMMAND_PORT = 5006
+PROFILE_PORT = 5008
+PROFILE_COMMAND = 7
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Dump the ESP32's profiling zones")
+    parser.add_argument("--reset", action="store_true", help="clear the zones after the dump")
+    parser.add_argument("--ip", default=DEFAULT_ESP_IP, help="ESP32 address")
+    args = parser.parse_args()
+
+    rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rx.bind(("0.0.0.0", PROFILE_PORT))
+    rx.settimeout(3.0)
+    tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    packet = struct.pack("<BfffI", PROFILE_COMMAND, 1.0 if args.reset else 0.0, 0.0, 0.0, 0)
+    tx.sendto(packet, (args.ip, COMMAND_PORT))
+
+    try:
+        data, _ = rx.recvfrom(4096)
+    except socket.timeout:
+        print("ERROR: no profile received (is this machine the telemetry address?)")
+        return 1
+
+    print(data.decode("ascii", errors="replace"), end="")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -77,7 +77,7 @@ class BallControllerDashboard:
         Send command to ESP32
         
         Args:
-            command_type: 0=direction, 1=calibrate, 2=emergency_stop, 3=start_running
+            command_type: 0=direction, 1=calibrate (x=1: automatic), 2=emergency_stop, 3=start_running, 4=outer_loop, 5=identify_coils, 6=trace, 7=profile, 8=current_sense_check
             x, y, z: Direction vector components
         """
         self.sequence_number += 1
@@ -99,10 +99,64 @@ class BallControllerDashboard:
         """Set ideal direction for ball control"""
         self._send_command(command_type=0, x=x, y=y, z=z)
     
-    def calibrate(self):
-        """Send calibration command"""
-        self._send_command(command_type=1)
+    def calibrate(self, automatic: bool = False):
+        """
+        Send calibration command
+
+        Args:
+            automatic: measure each magnet's pull with the IMU instead of
+                waiting for joystick input (aligns to the IMU world frame)
+        """
+        self._send_command(command_type=1, x=1.0 if automatic else 0.0)
     
+    def identify_coils(self):
+        """
+        Fire every coil in turn and log the ball's response on the device
+        console, for tools/fit_magnet_geometry.py (only from standby or
+        when calibrated and waiting for start)
+        """
+        self._send_command(command_type=5)
+
+    def check_current_sense(self, magnet_id: int, duty: int = 64, reference_amps: float = 0.0):
+        """
+        Hold one coil at a fixed PWM duty for 3 s and print the current the
+        ESP32 measures on its console (only from standby or when calibrated
+        and waiting for start). Read a clamp meter on the coil meanwhile, then
+        repeat with reference_amps set to the meter reading to correct that
+        channel's current sense gain.
+
+        Args:
+            magnet_id: magnet 1-20
+            duty: PWM duty 0-255
+            reference_amps: meter reading at this duty; 0 only measures
+        """
+        self._send_command(command_type=8, x=float(magnet_id), y=float(duty), z=reference_amps)
+
+    def start_trace(self, buffer_kb: int = 96, outputs: bool = False):
+        """
+        Start recording a replayable trace of the controller's inputs on the
+        ESP32 (see trace_capture.py to also collect it)
+
+        Args:
+            buffer_kb: recording buffer; recording stops when it is full
+            outputs: record the PWM writes too, to check a replay against
+        """
+        self._send_command(command_type=6, x=1.0, y=float(buffer_kb), z=1.0 if outputs else 0.0)
+
+    def stop_trace(self):
+        """Stop recording; the ESP32 sends the trace to UDP port 5007"""
+        self._send_command(command_type=6, x=0.0)
+
+    def dump_profile(self, reset: bool = False):
+        """
+        Dump the firmware's profiling zones to its serial port and UDP port
+        5008 (see profile_dump.py); needs a CONTROL_PROFILE=1 build
+
+        Args:
+            reset: clear the zones after the dump
+        """
+        self._send_command(command_type=7, x=1.0 if reset else 0.0)
+
     def stop_running(self):
         """Stop running and return to standby"""
         self._send_command(command_type=2)
@@ -111,6 +165,15 @@ class BallControllerDashboard:
         """Start/resume running"""
         self._send_command(command_type=3)
     
+    def set_outer_loop(self, mode: int, gain_1: float = 0, gain_2: float = 0):
+        """
+        Set the outer-loop controller mode and gains
+        
+        Args:
+            mode: 0=direct, 1=PD (gain_1=kp, gain_2=kd), 2=velocity (gain_1=kv, gain_2=ki)
+        """
+        self._send_command(command_type=4, x=float(mode), y=gain_1, z=gain_2)
+    
     def get_telemetry(self):
         """Get latest telemetry data"""
         return self.latest_telemetry
@@ -0,0 +1,98 @@
+"""
+Records a trace of the controller's inputs on the ESP32 and saves it for
+replay on the host (esp-controller-idf/host: trace_replay).
+
+Starts a recording with the dashboard's trace command, waits, stops it and
+collects the chunks the ESP32 then sends to UDP port 5007. The ESP32 sends
+them to the telemetry address (RECV_IP_ADDR), so run this on that machine.
+
+Usage:
+    python trace_capture.py [--seconds S] [--kb KB] [--outputs] [--out FILE] [--ip ESP_IP]
+
+The recording stops early when its buffer (--kb, default 96) is full; with
+--outputs the PWM writes are recorded too, so the replay can be checked
+against the board, at roughly twice the size.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+DEFAULT_ESP_IP = "192.168.4.1"
+COMMAND_PORT = 5006
+TRACE_PORT = 5007
+TRACE_COMMAND = 6
+CHUNK_HEADER = struct.Struct("<II")  # offset, total
+
+
+def send_trace_command(sock: socket.socket, esp_ip: str, x: float, y: float = 0.0, z: float = 0.0):
+    packet = struct.pack("<BfffI", TRACE_COMMAND, x, y, z, 0)
+    sock.sendto(packet, (esp_ip, COMMAND_PORT))
+
+
+def receive_trace(sock: socket.socket, timeout_s: float) -> bytes:
+    chunks = {}
+    total = None
+    deadline = time.monotonic() + timeout_s
+    while time.monotonic() < deadline:
+        try:
+            data, _ = sock.recvfrom(4096)
+        except socket.timeout:
+            if total is not None:
+                break  # the ESP32 has stopped sending
+            continue
+        if len(data) < CHUNK_HEADER.size:
+            continue
+        offset, total = CHUNK_HEADER.unpack_from(data)
+        chunks[offset] = data[CHUNK_HEADER.size:]
+        if sum(len(c) for c in chunks.values()) >= total:
+            break
+
+    if total is None:
+        raise RuntimeError("no trace received (is this machine the telemetry address?)")
+
+    trace = bytearray(total)
+    received = 0
+    for offset, chunk in chunks.items():
+        trace[offset:offset + len(chunk)] = chunk
+        received += len(chunk)
+    if received < total:
+        raise RuntimeError(f"received {received} of {total} bytes; some chunks were lost")
+    return bytes(trace)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Record a controller trace on the ESP32")
+    parser.add_argument("--seconds", type=float, default=3.0, help="how long to record")
+    parser.add_argument("--kb", type=int, default=96, help="recording buffer on the ESP32 (KB)")
+    parser.add_argument("--outputs", action="store_true", help="record the PWM writes too")
+    parser.add_argument("--out", default="trace.bin", help="where to save the trace")
+    parser.add_argument("--ip", default=DEFAULT_ESP_IP, help="ESP32 address")
+    args = parser.parse_args()
+
+    rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rx.bind(("0.0.0.0", TRACE_PORT))
+    rx.settimeout(1.0)
+    tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    print(f"Recording for {args.seconds:.1f} s ({args.kb} KB buffer{', with outputs' if args.outputs else ''})")
+    send_trace_command(tx, args.ip, 1.0, float(args.kb), 1.0 if args.outputs else 0.0)
+    time.sleep(args.seconds)
+    send_trace_command(tx, args.ip, 0.0)
+
+    try:
+        trace = receive_trace(rx, timeout_s=10.0)
+    except RuntimeError as e:
+        print(f"ERROR: {e}")
+        return 1
+
+    with open(args.out, "wb") as f:
+        f.write(trace)
+    print(f"Saved {len(trace):,} bytes to {args.out}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())